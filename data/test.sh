@@ -1,6 +1,6 @@
 #!/bin/bash -e
 
-rm -f single* search_* blits_*
+rm -f single* batch_* suitedb_* search_* blits_*
 
 hhalign -i query.a3m -t query.a3m
 
@@ -20,6 +20,29 @@ mpirun -np 2 \
 
 mpirun -np 2 cstranslate_mpi -i single -o single_cs219 -b -x 0.3 -c 4 -I a3m
 
+# the -ffindex batch modes build the same databases as the ffindex_apply_mpi runs above
+hhconsensus -i single -oa3m batch_a3m_cons -M a3m -ffindex -v 0
+diff single_a3m_cons.ffdata batch_a3m_cons.ffdata
+
+hhfilter -i single_a3m_cons -o batch_a3m -diff 1000 -ffindex -v 0
+diff single_a3m.ffdata batch_a3m.ffdata
+
+hhmake -i single_a3m -o batch_hhm -ffindex -v 0
+diff <(tr -d '\000' < single_hhm.ffdata | grep -v '^\(DATE\|COM\)') \
+    <(tr -d '\000' < batch_hhm.ffdata | grep -v '^\(DATE\|COM\)')
+
+# hhsuitedb builds the hhm and cs219 databases of the alignments in one pass
+mpirun -np 2 \
+    ffindex_apply_mpi single.ffdata single.ffindex -d single_query_hhm.ffdata -i single_query_hhm.ffindex \
+        -- hhmake -i stdin -o stdout -v 0
+
+cp single.ffdata suitedb_a3m.ffdata
+cp single.ffindex suitedb_a3m.ffindex
+hhsuitedb -d suitedb -hhm_nseq 0 -v 0
+diff <(tr -d '\000' < single_query_hhm.ffdata | grep -v '^\(DATE\|COM\)') \
+    <(tr -d '\000' < suitedb_hhm.ffdata | grep -v '^\(DATE\|COM\)')
+diff single_cs219.ffdata suitedb_cs219.ffdata
+
 hhblits -i query.a3m -d single -blasttab blits_app_res -n 1
 hhblits_omp -i single -d single -blasttab blits_omp_res -n 1
 mpirun -np 2 hhblits_mpi -i single -d single -blasttab blits_mpi_res -n 1
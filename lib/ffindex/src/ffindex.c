@@ -22,9 +22,11 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <libgen.h>
 #include <search.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -32,9 +34,19 @@
 
 #include "ext/fmemopen.h" /* For OS not yet implementing this new standard function */
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 /* XXX Use page size? */
 #define FFINDEX_BUFFER_SIZE 4096
 
+/* Indices with fewer entries are sorted with a single qsort */
+#define FFINDEX_PARALLEL_SORT_MIN_ENTRIES 100000
+
+/* Buffer size for appending whole data files in ffmerge_splits */
+#define FFINDEX_COPY_BUFFER_SIZE (1024 * 1024)
+
 char* ffindex_copyright_text = "Designed and implemented by Andy Hauser <hauser@genzentrum.lmu.de>.";
 
 char* ffindex_copyright()
@@ -392,9 +404,98 @@ FILE* ffindex_fopen_by_name(char *data, ffindex_index_t *index, char *filename)
 }
 
 
+static int ffindex_compare_entries_by_offset(const void *pentry1, const void *pentry2)
+{
+  ffindex_entry_t* entry1 = (ffindex_entry_t*)pentry1;
+  ffindex_entry_t* entry2 = (ffindex_entry_t*)pentry2;
+  if(entry1->offset < entry2->offset)
+    return -1;
+  return entry1->offset > entry2->offset;
+}
+
+
+/* Merge the sorted runs A and B into OUT, taking from A first on ties */
+static void ffindex_merge_runs(const ffindex_entry_t* a, size_t n_a, const ffindex_entry_t* b, size_t n_b,
+                               ffindex_entry_t* out, int (*compare)(const void*, const void*))
+{
+  size_t i = 0, j = 0;
+  while(i < n_a && j < n_b)
+  {
+    if(compare(&b[j], &a[i]) < 0)
+      *out++ = b[j++];
+    else
+      *out++ = a[i++];
+  }
+  memcpy(out, a + i, (n_a - i) * sizeof(ffindex_entry_t));
+  memcpy(out + (n_a - i), b + j, (n_b - j) * sizeof(ffindex_entry_t));
+}
+
+
+/* Sort with one qsort per thread on equal chunks, then merge the sorted chunks pairwise,
+ * the merges of each round in parallel. Without OpenMP or for small indices this is a plain qsort. */
+static void ffindex_parallel_sort(ffindex_entry_t* entries, size_t n_entries, int (*compare)(const void*, const void*))
+{
+  int chunks = 1;
+#ifdef _OPENMP
+  chunks = omp_get_max_threads();
+#endif
+  if(chunks < 2 || n_entries < FFINDEX_PARALLEL_SORT_MIN_ENTRIES)
+  {
+    qsort(entries, n_entries, sizeof(ffindex_entry_t), compare);
+    return;
+  }
+
+  ffindex_entry_t* buffer = (ffindex_entry_t*)malloc(n_entries * sizeof(ffindex_entry_t));
+  size_t* bounds = (size_t*)malloc((chunks + 1) * sizeof(size_t));
+  if(buffer == NULL || bounds == NULL)
+  {
+    free(buffer);
+    free(bounds);
+    qsort(entries, n_entries, sizeof(ffindex_entry_t), compare);
+    return;
+  }
+
+  for(int c = 0; c <= chunks; c++)
+    bounds[c] = n_entries / chunks * c + (n_entries % chunks) * c / chunks;
+
+  #pragma omp parallel for schedule(static)
+  for(int c = 0; c < chunks; c++)
+    qsort(entries + bounds[c], bounds[c + 1] - bounds[c], sizeof(ffindex_entry_t), compare);
+
+  ffindex_entry_t* from = entries;
+  ffindex_entry_t* to = buffer;
+  for(int width = 1; width < chunks; width *= 2)
+  {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int c = 0; c < chunks; c += 2 * width)
+    {
+      size_t begin = bounds[c];
+      size_t middle = bounds[c + width < chunks ? c + width : chunks];
+      size_t end = bounds[c + 2 * width < chunks ? c + 2 * width : chunks];
+      ffindex_merge_runs(from + begin, middle - begin, from + middle, end - middle, to + begin, compare);
+    }
+    ffindex_entry_t* swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if(from != entries)
+    memcpy(entries, from, n_entries * sizeof(ffindex_entry_t));
+
+  free(bounds);
+  free(buffer);
+}
+
+
 void ffindex_sort_index_file(ffindex_index_t *index)
 {
-  qsort(index->entries, index->n_entries, sizeof(ffindex_entry_t), ffindex_compare_entries_by_name);
+  ffindex_parallel_sort(index->entries, index->n_entries, ffindex_compare_entries_by_name);
+}
+
+
+void ffindex_sort_index_by_offset(ffindex_index_t *index)
+{
+  ffindex_parallel_sort(index->entries, index->n_entries, ffindex_compare_entries_by_offset);
 }
 
 
@@ -455,6 +556,51 @@ ffindex_index_t* ffindex_unlink(ffindex_index_t* index, char* name_to_unlink)
   return index;
 }
 
+
+/* Merge two indices sorted by name in one pass; entries of delta replace entries of index with the same name.
+ * The merged index is allocated with malloc and has no index file of its own. */
+ffindex_index_t* ffindex_index_merge(ffindex_index_t* index, ffindex_index_t* delta)
+{
+  size_t num_max_entries = index->n_entries + delta->n_entries;
+  size_t nbytes = sizeof(ffindex_index_t) + (sizeof(ffindex_entry_t) * num_max_entries);
+  ffindex_index_t *merged = (ffindex_index_t *)malloc(nbytes);
+  if(merged == NULL)
+  {
+    fprintf(stderr, "Failed to allocate %ld bytes\n", nbytes);
+    fferror_print(__FILE__, __LINE__, __func__, "malloc failed");
+    return NULL;
+  }
+  merged->filename = NULL;
+  merged->file = NULL;
+  merged->index_data = NULL;
+  merged->index_data_size = 0;
+  merged->num_max_entries = num_max_entries;
+
+  size_t i = 0, j = 0, n = 0;
+  while(i < index->n_entries || j < delta->n_entries)
+  {
+    int cmp;
+    if(j >= delta->n_entries)
+      cmp = -1;
+    else if(i >= index->n_entries)
+      cmp = 1;
+    else
+      cmp = ffindex_compare_entries_by_name(&index->entries[i], &delta->entries[j]);
+
+    if(cmp < 0)
+      merged->entries[n++] = index->entries[i++];
+    else
+    {
+      if(cmp == 0) /* replaced by the entry of delta */
+        i++;
+      merged->entries[n++] = delta->entries[j++];
+    }
+  }
+  merged->n_entries = n;
+
+  return merged;
+}
+
 void ffsort_index(const char* index_filename) {
   FILE* index_fh = fopen(index_filename, "r");
   size_t lines = ffcount_lines(index_filename);
@@ -472,8 +618,12 @@ void ffsort_index(const char* index_filename) {
   if(index_fh == NULL) { perror(index_filename); }
   ffindex_write(index, index_fh);
   fclose(index_fh);
+  ffindex_remove_binary_index(index_filename);
 }
 
+/* Append the split databases DATA_FILENAME.i, INDEX_FILENAME.i for i in [FIRST, LAST]
+ * The data files are appended as a whole and the offsets of their entries shifted accordingly,
+ * so entries are not copied one by one. The collected index is sorted once and written at the end. */
 void ffmerge_splits(const char* data_filename, const char* index_filename,
                     int first_split_index, int last_split_index, int remove_temporary) {
 
@@ -492,6 +642,30 @@ void ffmerge_splits(const char* data_filename, const char* index_filename,
     perror(error_message);
     exit(EXIT_FAILURE);
   }
+  ffindex_remove_binary_index(index_filename);
+
+  // Room for the entries of all splits
+  size_t num_max_entries = 0;
+  for (int i = first_split_index; i <= last_split_index; i++) {
+    char index_file_name_to_add[FILENAME_MAX];
+    snprintf(index_file_name_to_add, FILENAME_MAX, "%s.%d", index_filename, i);
+    num_max_entries += ffcount_lines(index_file_name_to_add);
+  }
+
+  size_t nbytes = sizeof(ffindex_index_t) + (sizeof(ffindex_entry_t) * num_max_entries);
+  ffindex_index_t* index = (ffindex_index_t*)malloc(nbytes);
+  char* buffer = (char*)malloc(FFINDEX_COPY_BUFFER_SIZE);
+  if (index == NULL || buffer == NULL) {
+    fprintf(stderr, "Failed to allocate %ld bytes\n", nbytes);
+    fferror_print(__FILE__, __LINE__, __func__, "malloc failed");
+    exit(EXIT_FAILURE);
+  }
+  index->filename = NULL;
+  index->file = NULL;
+  index->index_data = NULL;
+  index->index_data_size = 0;
+  index->num_max_entries = num_max_entries;
+  index->n_entries = 0;
 
   size_t offset = 0;
 
@@ -536,17 +710,29 @@ void ffmerge_splits(const char* data_filename, const char* index_filename,
       exit(EXIT_FAILURE);
     }
 
-    size_t data_size;
-    char *data_to_add = ffindex_mmap_data(data_file_to_add, &data_size);
     ffindex_index_t* index_to_add = ffindex_index_parse(index_file_to_add, entries);
+    if (index_to_add == NULL) {
+      perror("ffindex_index_parse failed");
+      exit(EXIT_FAILURE);
+    }
 
     for(size_t entry_i = 0; entry_i < index_to_add->n_entries; entry_i++) {
-      ffindex_entry_t *entry = ffindex_get_entry_by_index(index_to_add, entry_i);
-      ffindex_insert_memory(data_file, index_file, &offset,
-                            ffindex_get_data_by_entry(data_to_add, entry),
-                            entry->length - 1, entry->name);
+      ffindex_entry_t* entry = &index->entries[index->n_entries++];
+      *entry = index_to_add->entries[entry_i];
+      entry->offset += offset;
+    }
+
+    size_t read_size;
+    while ((read_size = fread(buffer, sizeof(char), FFINDEX_COPY_BUFFER_SIZE, data_file_to_add)) > 0) {
+      if (fwrite(buffer, sizeof(char), read_size, data_file) != read_size) {
+        fferror_print(__FILE__, __LINE__, __func__, data_filename);
+        exit(EXIT_FAILURE);
+      }
     }
+    offset += size_data_to_add;
 
+    munmap(index_to_add->index_data, index_to_add->index_data_size);
+    free(index_to_add);
     fclose(data_file_to_add);
     fclose(index_file_to_add);
 
@@ -556,10 +742,172 @@ void ffmerge_splits(const char* data_filename, const char* index_filename,
     }
   }
 
+  ffindex_sort_index_file(index);
+  if (ffindex_write(index, index_file) != EXIT_SUCCESS) {
+    fferror_print(__FILE__, __LINE__, __func__, index_filename);
+    exit(EXIT_FAILURE);
+  }
+
+  free(buffer);
+  free(index);
   fclose(data_file);
   fclose(index_file);
+}
+
+
+/* Binary index sidecar INDEX_FILENAME.bin
+ * A header followed by a memory image of ffindex_index_t with its entries sorted by name,
+ * so the index can be mapped at startup instead of being parsed. The sidecar records size,
+ * modification time (with nanoseconds), inode and device of the text index it was generated
+ * from and is ignored when any of them differ. Tools that rewrite a text index remove its
+ * sidecar, see ffindex_remove_binary_index. */
+
+#define FFINDEX_BINARY_MAGIC "FFINDEXB"
+
+typedef struct ffindex_binary_header {
+  char magic[8];
+  uint64_t entry_size;     /* sizeof(ffindex_entry_t) of the writer */
+  uint64_t n_entries;
+  uint64_t index_size;     /* size of the text index */
+  int64_t index_mtime;     /* modification time of the text index, seconds */
+  int64_t index_mtime_nsec;  /* and nanoseconds */
+  uint64_t index_ino;      /* inode and device of the text index */
+  uint64_t index_dev;
+} ffindex_binary_header_t;
+
+static void ffindex_binary_filename(char* binary_filename, const char* index_filename)
+{
+  snprintf(binary_filename, FILENAME_MAX, "%s.bin", index_filename);
+}
+
+static int64_t ffindex_mtime_nsec(const struct stat* sb)
+{
+#ifdef __APPLE__
+  return sb->st_mtimespec.tv_nsec;
+#else
+  return sb->st_mtim.tv_nsec;
+#endif
+}
+
+static int ffindex_binary_header_matches(const ffindex_binary_header_t* header, const struct stat* sb)
+{
+  return (uint64_t) sb->st_size == header->index_size
+         && (int64_t) sb->st_mtime == header->index_mtime
+         && ffindex_mtime_nsec(sb) == header->index_mtime_nsec
+         && (uint64_t) sb->st_ino == header->index_ino
+         && (uint64_t) sb->st_dev == header->index_dev;
+}
+
+int ffindex_remove_binary_index(const char* index_filename)
+{
+  char binary_filename[FILENAME_MAX];
+  ffindex_binary_filename(binary_filename, index_filename);
+  if(unlink(binary_filename) < 0 && errno != ENOENT)
+  {
+    fferror_print(__FILE__, __LINE__, __func__, binary_filename);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int ffindex_write_binary_index(ffindex_index_t* index, const char* index_filename)
+{
+  struct stat sb;
+  if(stat(index_filename, &sb) < 0)
+  {
+    fferror_print(__FILE__, __LINE__, __func__, index_filename);
+    return EXIT_FAILURE;
+  }
+
+  char binary_filename[FILENAME_MAX];
+  ffindex_binary_filename(binary_filename, index_filename);
+  FILE* binary_file = fopen(binary_filename, "w");
+  if(binary_file == NULL)
+  {
+    fferror_print(__FILE__, __LINE__, __func__, binary_filename);
+    return EXIT_FAILURE;
+  }
+
+  ffindex_binary_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FFINDEX_BINARY_MAGIC, sizeof(header.magic));
+  header.entry_size = sizeof(ffindex_entry_t);
+  header.n_entries = index->n_entries;
+  header.index_size = sb.st_size;
+  header.index_mtime = sb.st_mtime;
+  header.index_mtime_nsec = ffindex_mtime_nsec(&sb);
+  header.index_ino = sb.st_ino;
+  header.index_dev = sb.st_dev;
+
+  ffindex_index_t image;
+  memset(&image, 0, sizeof(image));
+  image.num_max_entries = index->n_entries;
+  image.n_entries = index->n_entries;
+
+  int ret = EXIT_SUCCESS;
+  if(fwrite(&header, sizeof(header), 1, binary_file) != 1
+     || fwrite(&image, sizeof(image), 1, binary_file) != 1
+     || fwrite(index->entries, sizeof(ffindex_entry_t), index->n_entries, binary_file) != index->n_entries)
+  {
+    fferror_print(__FILE__, __LINE__, __func__, binary_filename);
+    ret = EXIT_FAILURE;
+  }
+
+  if(fclose(binary_file) != 0)
+    ret = EXIT_FAILURE;
+  return ret;
+}
+
+ffindex_index_t* ffindex_index_mmap_binary(const char* index_filename, size_t* mapped_size)
+{
+  char binary_filename[FILENAME_MAX];
+  ffindex_binary_filename(binary_filename, index_filename);
+
+  int fd = open(binary_filename, O_RDONLY);
+  if(fd < 0)
+    return NULL;
 
-  ffsort_index(index_filename);
+  struct stat sb;
+  ffindex_binary_header_t header;
+  if(fstat(fd, &sb) < 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+     || memcmp(header.magic, FFINDEX_BINARY_MAGIC, sizeof(header.magic)) != 0
+     || header.entry_size != sizeof(ffindex_entry_t)
+     || (size_t) sb.st_size != sizeof(header) + sizeof(ffindex_index_t) + header.n_entries * sizeof(ffindex_entry_t))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  /* Ignore a sidecar that is older or newer than the text index */
+  struct stat index_sb;
+  if(stat(index_filename, &index_sb) == 0 && !ffindex_binary_header_matches(&header, &index_sb))
+  {
+    fprintf(stderr, "Ignoring %s: it does not match %s\n", binary_filename, index_filename);
+    close(fd);
+    return NULL;
+  }
+
+  /* Private mapping: callers may reorder the entries (e.g. by offset) */
+  char* map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return NULL;
+
+  ffindex_index_t* index = (ffindex_index_t*)(map + sizeof(header));
+  index->filename = NULL;
+  index->file = NULL;
+  index->index_data = NULL;
+  index->index_data_size = 0;
+  index->num_max_entries = header.n_entries;
+  index->n_entries = header.n_entries;
+
+  *mapped_size = sb.st_size;
+  return index;
+}
+
+void ffindex_index_munmap_binary(ffindex_index_t* index, size_t mapped_size)
+{
+  munmap((char*)index - sizeof(ffindex_binary_header_t), mapped_size);
 }
 
 
@@ -80,14 +80,21 @@ ffindex_index_t* ffindex_index_parse(FILE *index_file, size_t num_max_entries);
 
 ffindex_entry_t* ffindex_bsearch_get_entry(ffindex_index_t *index, char *name);
 
+/* Sort the entries by name, in parallel with OpenMP */
 void ffindex_sort_index_file(ffindex_index_t *index);
 
+/* Sort the entries by their offset in the data file, in parallel with OpenMP */
+void ffindex_sort_index_by_offset(ffindex_index_t *index);
+
 int ffindex_write(ffindex_index_t* index, FILE* index_file);
 
 ffindex_index_t* ffindex_unlink(ffindex_index_t* index, char *entry_name);
 
 ffindex_index_t* ffindex_unlink_entries(ffindex_index_t* index, char** sorted_names_to_unlink, int n_names);
 
+/* Merge two indices sorted by name in linear time, entries of DELTA replace entries of INDEX with the same name */
+ffindex_index_t* ffindex_index_merge(ffindex_index_t* index, ffindex_index_t* delta);
+
 int ffindex_insert_filestream(FILE *data_file, FILE *index_file, size_t *offset, FILE* file, char *name);
 
 void ffsort_index(const char* index_filename);
@@ -95,6 +102,17 @@ void ffsort_index(const char* index_filename);
 void ffmerge_splits(const char* data_filename, const char* index_filename,
                     int first_split_index, int last_split_index, int remove_temporary);
 
+/* Binary index sidecar INDEX_FILENAME.bin that can be mapped instead of parsing the text index */
+int ffindex_write_binary_index(ffindex_index_t* index, const char* index_filename);
+
+/* Returns NULL if there is no valid sidecar for index_filename */
+ffindex_index_t* ffindex_index_mmap_binary(const char* index_filename, size_t* mapped_size);
+
+void ffindex_index_munmap_binary(ffindex_index_t* index, size_t mapped_size);
+
+/* Remove the sidecar of index_filename, to be called by everything that rewrites the text index */
+int ffindex_remove_binary_index(const char* index_filename);
+
 char* ffindex_copyright();
 
 #endif
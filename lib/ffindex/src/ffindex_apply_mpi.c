@@ -18,7 +18,7 @@
 #define _LARGEFILE64_SOURCE 1
 #define _FILE_OFFSET_BITS 64
 
-#include <limits.h> // PIPE_BUF
+#include <limits.h> // PIPE_BUF, INT_MAX
 #include <stdlib.h> // EXIT_*, system, malloc, free
 #include <unistd.h> // pipe, fork, close, dup2, execvp, write, read, opt*
 #include <stdint.h>
@@ -26,8 +26,11 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <sys/mman.h> // munmap
+#include <sys/uio.h>  // writev
 #include <fcntl.h>    // fcntl, F_*, O_*
-#include <signal.h>   // sigaction, sigemptyset
+#include <signal.h>   // sigaction, sigemptyset, kill
+#include <poll.h>     // poll
+#include <string.h>   // memcpy, strerror
 
 #include <getopt.h>   // getopt_long
 
@@ -176,6 +179,437 @@ ffindex_apply_by_entry(char *data, ffindex_entry_t *entry, char *program_name, c
     return EXIT_SUCCESS;
 }
 
+#ifndef HAVE_MPI
+/* Persistent workers (-w): every worker process is started once and processes one entry
+ * after the other, framed on its stdin and stdout:
+ *   request:  NAME '\t' LENGTH '\n' followed by LENGTH bytes of entry data
+ *   response: STATUS '\t' LENGTH '\n' followed by LENGTH bytes of output
+ * Entries answered with a nonzero STATUS are retried, a worker that exits, breaks the protocol
+ * or exceeds the timeout is restarted first. Requests are written without blocking while responses
+ * are read, so a worker may answer before it has read its whole request.
+ * All output passes through this process, which is the only writer of the output ffindex. */
+
+typedef struct ffindex_worker_s ffindex_worker_t;
+struct ffindex_worker_s {
+    pid_t pid;
+    int fd_request;         // worker's stdin, non-blocking
+    int fd_response;        // worker's stdout, non-blocking
+    ssize_t entry;          // entry in flight, -1 if idle
+    int failed;             // the request could not be written
+    int64_t start;
+    char request_header[FFINDEX_MAX_ENTRY_NAME_LENTH + 32];
+    size_t request_header_length;
+    char *request_data;
+    size_t request_length;  // of header and data
+    size_t request_sent;    // send cursor over header and data
+    char header[64];        // response header read so far
+    size_t header_length;
+    int header_done;
+    int status;
+    char *output;
+    size_t output_length;   // from the response header
+    size_t output_read;
+    size_t output_capacity;
+};
+
+static int64_t now_in_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec) * 1000LL + (tv.tv_usec) / 1000;
+}
+
+int ffindex_worker_start(ffindex_worker_t *worker, char *program_name, char **program_argv) {
+    int pipefd_request[2];
+    int pipefd_response[2];
+
+    // close-on-exec, so workers do not inherit the pipes of other workers
+    if (pipe2(pipefd_request, O_CLOEXEC) != 0) {
+        return errno;
+    }
+    if (pipe2(pipefd_response, O_CLOEXEC) != 0) {
+        int err = errno;
+        close(pipefd_request[0]);
+        close(pipefd_request[1]);
+        return err;
+    }
+
+    posix_spawn_file_actions_t factions;
+    posix_spawn_file_actions_init(&factions);
+    posix_spawn_file_actions_adddup2(&factions, pipefd_request[0], fileno(stdin));
+    posix_spawn_file_actions_adddup2(&factions, pipefd_response[1], fileno(stdout));
+
+    int err = posix_spawnp(&worker->pid, program_name, &factions, NULL, program_argv, environ);
+    posix_spawn_file_actions_destroy(&factions);
+
+    close(pipefd_request[0]);
+    close(pipefd_response[1]);
+    if (err) {
+        close(pipefd_request[1]);
+        close(pipefd_response[0]);
+        return err;
+    }
+
+    worker->fd_request = pipefd_request[1];
+    worker->fd_response = pipefd_response[0];
+    fcntl(worker->fd_request, F_SETFL, fcntl(worker->fd_request, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(worker->fd_response, F_SETFL, fcntl(worker->fd_response, F_GETFL, 0) | O_NONBLOCK);
+    worker->entry = -1;
+    return 0;
+}
+
+void ffindex_worker_stop(ffindex_worker_t *worker, int force) {
+    // workers exit at the end of their input
+    close(worker->fd_request);
+    close(worker->fd_response);
+    if (force) {
+        kill(worker->pid, SIGKILL);
+    }
+    int status;
+    waitpid(worker->pid, &status, 0);
+    worker->entry = -1;
+}
+
+/* Write what the worker takes of its request: 1 if it is complete, 0 if not yet, -1 if the worker failed */
+int ffindex_worker_flush(ffindex_worker_t *worker) {
+    while (worker->request_sent < worker->request_length) {
+        // the rest of the header and the data in one call
+        struct iovec iov[2];
+        int n_iov = 0;
+        size_t data_sent = 0;
+        if (worker->request_sent < worker->request_header_length) {
+            iov[n_iov].iov_base = worker->request_header + worker->request_sent;
+            iov[n_iov++].iov_len = worker->request_header_length - worker->request_sent;
+        } else {
+            data_sent = worker->request_sent - worker->request_header_length;
+        }
+        if (worker->request_length > worker->request_header_length + data_sent) {
+            iov[n_iov].iov_base = worker->request_data + data_sent;
+            iov[n_iov++].iov_len = worker->request_length - worker->request_header_length - data_sent;
+        }
+
+        ssize_t w = writev(worker->fd_request, iov, n_iov);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        worker->request_sent += w;
+    }
+    return 1;
+}
+
+/* Start the request of an entry and write as much of it as the worker takes right away */
+int ffindex_worker_send(ffindex_worker_t *worker, char *data, ffindex_entry_t *entry, size_t entry_index) {
+    // Don't write ffindex trailing '\0'
+    size_t to_write = entry->length == 0 ? 0 : entry->length - 1;
+    int header_length = snprintf(worker->request_header, sizeof(worker->request_header), "%s\t%zu\n",
+                                 entry->name, to_write);
+
+    worker->entry = entry_index;
+    worker->failed = 0;
+    worker->start = now_in_ms();
+    worker->request_header_length = header_length;
+    worker->request_data = ffindex_get_data_by_entry(data, entry);
+    worker->request_length = header_length + to_write;
+    worker->request_sent = 0;
+    worker->header_length = 0;
+    worker->header_done = 0;
+    worker->output_read = 0;
+
+    return ffindex_worker_flush(worker) < 0 ? -1 : 0;
+}
+
+/* Read what is available of the response: 1 if it is complete, 0 if not yet, -1 if the worker failed */
+int ffindex_worker_receive(ffindex_worker_t *worker) {
+    while (!worker->header_done) {
+        // the header is read in chunks, bytes behind it are the start of the output
+        ssize_t r = read(worker->fd_response, worker->header + worker->header_length,
+                         sizeof(worker->header) - 1 - worker->header_length);
+        if (r < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return 0;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        worker->header_length += r;
+
+        char *newline = memchr(worker->header, '\n', worker->header_length);
+        if (newline == NULL) {
+            if (worker->header_length + 1 >= sizeof(worker->header)) {
+                return -1;
+            }
+            continue;
+        }
+
+        *newline = '\0';
+        char *end;
+        worker->status = (int) strtol(worker->header, &end, 10);
+        if (*end != '\t') {
+            return -1;
+        }
+        worker->output_length = strtoull(end + 1, NULL, 10);
+        size_t rest = worker->header_length - (newline + 1 - worker->header);
+        if (rest > worker->output_length) {
+            return -1;
+        }
+        if (worker->output_length > worker->output_capacity) {
+            char *output = realloc(worker->output, worker->output_length);
+            if (output == NULL) {
+                return -1;
+            }
+            worker->output = output;
+            worker->output_capacity = worker->output_length;
+        }
+        if (rest > 0) {
+            memcpy(worker->output, newline + 1, rest);
+        }
+        worker->output_read = rest;
+        worker->header_done = 1;
+    }
+
+    while (worker->output_read < worker->output_length) {
+        ssize_t r = read(worker->fd_response, worker->output + worker->output_read,
+                         worker->output_length - worker->output_read);
+        if (r < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return 0;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        worker->output_read += r;
+    }
+    return 1;
+}
+
+/* Results of ordered output waiting for the entries before them */
+#define FFINDEX_RESULT_PENDING 0
+#define FFINDEX_RESULT_DONE 1
+#define FFINDEX_RESULT_FAILED 2
+
+typedef struct ffindex_apply_result_s ffindex_apply_result_t;
+struct ffindex_apply_result_s {
+    int state;
+    char *output;
+    size_t length;
+};
+
+int ffindex_apply_workers(char *data, ffindex_index_t *index, char *program_name, char **program_argv,
+                          FILE *data_file_out, FILE *index_file_out, FILE *log_file_out, int quiet,
+                          int n_workers, int retries, int ordered, int64_t timeout) {
+    int exit_status = EXIT_SUCCESS;
+    int capture_stdout = (data_file_out != NULL && index_file_out != NULL);
+    size_t n_entries = index->n_entries;
+    size_t offset = 0;
+
+    ffindex_worker_t *workers = calloc(n_workers, sizeof(ffindex_worker_t));
+    // up to two descriptors per worker: its stdout and, while its request is not yet written, its stdin
+    struct pollfd *fds = calloc(2 * (size_t) n_workers, sizeof(struct pollfd));
+    int *pollfd_request = calloc(n_workers, sizeof(int));
+    int *pollfd_response = calloc(n_workers, sizeof(int));
+    int *attempts = calloc(n_entries, sizeof(int));
+    ffindex_apply_result_t *results = NULL;
+    if (ordered) {
+        results = calloc(n_entries, sizeof(ffindex_apply_result_t));
+    }
+    if (workers == NULL || fds == NULL || pollfd_request == NULL || pollfd_response == NULL || attempts == NULL
+        || (ordered && results == NULL)) {
+        fferror_print(__FILE__, __LINE__, __func__, "calloc failed");
+        exit_status = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    for (int w = 0; w < n_workers; w++) {
+        int err = ffindex_worker_start(&workers[w], program_name, program_argv);
+        if (err) {
+            fprintf(stderr, "ERROR starting worker %s: %s\n", program_name, strerror(err));
+            for (int started = 0; started < w; started++) {
+                ffindex_worker_stop(&workers[started], 1);
+            }
+            exit_status = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+
+    // entries are handed out in order, ordered output keeps at most window results in memory
+    const size_t window = 4 * (size_t) n_workers;
+    size_t next_entry = 0;
+    size_t next_output = 0;
+    size_t done = 0;
+
+    while (done < n_entries) {
+        // hand out entries to idle workers, a failed send is handled with the other failures below
+        for (int w = 0; w < n_workers && next_entry < n_entries; w++) {
+            if (workers[w].entry >= 0 || (ordered && next_entry >= next_output + window)) {
+                continue;
+            }
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(index, next_entry);
+            if (ffindex_worker_send(&workers[w], data, entry, next_entry) != 0) {
+                workers[w].failed = 1;
+            }
+            next_entry++;
+        }
+
+        int n_fds = 0;
+        int poll_timeout = -1;
+        int64_t now = now_in_ms();
+        for (int w = 0; w < n_workers; w++) {
+            pollfd_request[w] = -1;
+            pollfd_response[w] = -1;
+            if (workers[w].entry < 0) {
+                continue;
+            }
+            if (workers[w].failed) {
+                poll_timeout = 0;
+                continue;
+            }
+            if (workers[w].request_sent < workers[w].request_length) {
+                fds[n_fds].fd = workers[w].fd_request;
+                fds[n_fds].events = POLLOUT;
+                pollfd_request[w] = n_fds++;
+            }
+            fds[n_fds].fd = workers[w].fd_response;
+            fds[n_fds].events = POLLIN;
+            pollfd_response[w] = n_fds++;
+
+            if (timeout > 0) {
+                int64_t left = workers[w].start + timeout - now;
+                left = left < 0 ? 0 : left;
+                if (poll_timeout < 0 || left < poll_timeout) {
+                    poll_timeout = left > INT_MAX ? INT_MAX : (int) left;
+                }
+            }
+        }
+        if (poll(fds, n_fds, poll_timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            exit_status = EXIT_FAILURE;
+            break;
+        }
+
+        now = now_in_ms();
+        for (int w = 0; w < n_workers; w++) {
+            ffindex_worker_t *worker = &workers[w];
+            if (worker->entry < 0) {
+                continue;
+            }
+            size_t entry_index = worker->entry;
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(index, entry_index);
+
+            // 1 if the response is complete, 0 if not yet, -1 if the worker failed
+            int received = worker->failed ? -1 : 0;
+            if (received == 0 && pollfd_request[w] >= 0 && fds[pollfd_request[w]].revents != 0) {
+                received = ffindex_worker_flush(worker) < 0 ? -1 : 0;
+            }
+            if (received == 0 && pollfd_response[w] >= 0 && fds[pollfd_response[w]].revents != 0) {
+                received = ffindex_worker_receive(worker);
+                // a worker that answers before it has read its whole request would read the rest as the next one
+                if (received > 0 && worker->request_sent < worker->request_length) {
+                    received = -1;
+                }
+            }
+            if (received == 0 && timeout > 0 && now - worker->start >= timeout) {
+                fprintf(stderr, "ERROR: %s timed out on entry %s after %lld ms\n", program_name, entry->name,
+                        (long long) (now - worker->start));
+                received = -1;
+            }
+            if (received == 0) {
+                continue;
+            }
+
+            int status = received < 0 ? -1 : worker->status;
+            if (!quiet) {
+                fprintf(log_file_out, "%s\t%ld\t%ld\t%lld\t%d\n", entry->name, entry->offset, entry->length,
+                        (long long) (now - worker->start), status);
+            }
+
+            if (status != 0) {
+                if (received < 0) {
+                    // restart the worker that has exited, broken the protocol or timed out
+                    ffindex_worker_stop(worker, 1);
+                    int err = ffindex_worker_start(worker, program_name, program_argv);
+                    if (err) {
+                        fprintf(stderr, "ERROR restarting worker %s: %s\n", program_name, strerror(err));
+                        exit_status = EXIT_FAILURE;
+                        goto stop_workers;
+                    }
+                }
+
+                if (attempts[entry_index]++ < retries) {
+                    if (ffindex_worker_send(worker, data, entry, entry_index) != 0) {
+                        worker->failed = 1;
+                    }
+                    continue;
+                }
+
+                fprintf(stderr, "ERROR: %s failed for entry %s after %d attempts\n", program_name, entry->name,
+                        attempts[entry_index]);
+                exit_status = EXIT_FAILURE;
+                worker->entry = -1;
+                done++;
+                if (ordered) {
+                    results[entry_index].state = FFINDEX_RESULT_FAILED;
+                }
+            } else {
+                worker->entry = -1;
+                done++;
+                if (capture_stdout && !ordered) {
+                    ffindex_insert_memory(data_file_out, index_file_out, &offset, worker->output, worker->output_length,
+                                          entry->name);
+                } else if (ordered) {
+                    results[entry_index].state = FFINDEX_RESULT_DONE;
+                    // an empty output stays NULL and is written as an empty entry
+                    if (capture_stdout && worker->output_length > 0) {
+                        results[entry_index].output = malloc(worker->output_length);
+                        if (results[entry_index].output == NULL) {
+                            fferror_print(__FILE__, __LINE__, __func__, "malloc failed");
+                            exit_status = EXIT_FAILURE;
+                            goto stop_workers;
+                        }
+                        memcpy(results[entry_index].output, worker->output, worker->output_length);
+                        results[entry_index].length = worker->output_length;
+                    }
+                }
+            }
+
+            // write the results that are next in input order
+            while (ordered && next_output < n_entries && results[next_output].state != FFINDEX_RESULT_PENDING) {
+                ffindex_apply_result_t *result = &results[next_output];
+                if (result->state == FFINDEX_RESULT_DONE && capture_stdout) {
+                    ffindex_insert_memory(data_file_out, index_file_out, &offset, result->output, result->length,
+                                          ffindex_get_entry_by_index(index, next_output)->name);
+                }
+                free(result->output);
+                result->output = NULL;
+                next_output++;
+            }
+        }
+    }
+
+    stop_workers:
+    for (int w = 0; w < n_workers; w++) {
+        ffindex_worker_stop(&workers[w], exit_status != EXIT_SUCCESS && workers[w].entry >= 0);
+        free(workers[w].output);
+    }
+
+    cleanup:
+    if (results != NULL) {
+        for (size_t i = 0; i < n_entries; i++) {
+            free(results[i].output);
+        }
+    }
+    free(results);
+    free(attempts);
+    free(pollfd_response);
+    free(pollfd_request);
+    free(fds);
+    free(workers);
+    return exit_status;
+}
+#endif
+
 #ifdef HAVE_MPI
 typedef struct ffindex_apply_mpi_data_s ffindex_apply_mpi_data_t;
 struct ffindex_apply_mpi_data_s {
@@ -230,12 +664,23 @@ void usage() {
             "USAGE: ffindex_apply_mpi [-q] [-k] "
 #ifdef HAVE_MPI
                     "[-p PARTS] [-l LOG_FILENAME_PREFIX] "
+#else
+                    "[-w WORKERS [-r RETRIES] [-t SECONDS] [-o]] "
 #endif
                     "[-d DATA_FILENAME_OUT -i INDEX_FILENAME_OUT] DATA_FILENAME INDEX_FILENAME -- PROGRAM [PROGRAM_ARGS]*\n"
                     "\nDesigned and implemented by Andy Hauser <hauser@genzentrum.lmu.de> and Milot Mirdita <milot@mirdita.de>.\n\n"
 #ifdef HAVE_MPI
                     "\t[-p PARTS]\t\tSets how many entries one worker processes per job.\n"
                     "\t[-l LOG_FILE_PREFIX]\tPrefix for filename for the per worker process logfiles.\n"
+#else
+                    "\t[-w WORKERS]\t\tStart WORKERS persistent PROGRAM processes (0: one per core) that read\n"
+                    "\t\t\t\tentries from stdin and answer on stdout instead of running PROGRAM per entry.\n"
+                    "\t\t\t\tRequest:  NAME<TAB>LENGTH<NEWLINE> followed by LENGTH bytes of entry data.\n"
+                    "\t\t\t\tResponse: STATUS<TAB>LENGTH<NEWLINE> followed by LENGTH bytes of output.\n"
+                    "\t[-r RETRIES]\t\tRetry entries that failed or crashed a worker up to RETRIES times (default 1).\n"
+                    "\t[-t SECONDS]\t\tRestart a worker that takes longer than SECONDS for an entry and count the\n"
+                    "\t\t\t\tentry as failed (default 0: no timeout).\n"
+                    "\t[-o]\t\t\tWrite the output data in the order of the input index.\n"
 #endif
                     "\t[-q]\t\t\tSilence the logging of every processed entry.\n"
                     "\t[-k]\t\t\tKeep unmerged ffindex splits.\n"
@@ -260,6 +705,11 @@ int main(int argn, char **argv) {
 #ifdef HAVE_MPI
     size_t parts = 1;
     char *log_filename = NULL;
+#else
+    int n_workers = -1;
+    int retries = 1;
+    int ordered = 0;
+    int timeout = 0;
 #endif
 
     static struct option long_options[] =
@@ -267,6 +717,11 @@ int main(int argn, char **argv) {
 #ifdef HAVE_MPI
                     {"parts", required_argument, NULL, 'p'},
                     {"logfile", required_argument, NULL, 'l'},
+#else
+                    {"workers", required_argument, NULL, 'w'},
+                    {"retries", required_argument, NULL, 'r'},
+                    {"ordered", no_argument, NULL, 'o'},
+                    {"timeout", required_argument, NULL, 't'},
 #endif
                     {"data", required_argument, NULL, 'd'},
                     {"index", required_argument, NULL, 'i'},
@@ -281,7 +736,7 @@ int main(int argn, char **argv) {
 #ifdef HAVE_MPI
         const char *short_options = "kql:p:d:i:";
 #else
-        const char* short_options = "kqd:i:";
+        const char* short_options = "kqw:r:t:od:i:";
 #endif
         opt = getopt_long(argn, argv, short_options, long_options, &option_index);
 
@@ -296,6 +751,19 @@ int main(int argn, char **argv) {
             case 'l':
                 log_filename = optarg;
                 break;
+#else
+            case 'w':
+                n_workers = atoi(optarg);
+                break;
+            case 'r':
+                retries = atoi(optarg);
+                break;
+            case 'o':
+                ordered = 1;
+                break;
+            case 't':
+                timeout = atoi(optarg);
+                break;
 #endif
             case 'd':
                 data_filename_out = optarg;
@@ -500,25 +968,38 @@ int main(int argn, char **argv) {
         }
     }
 
-    size_t offset = 0;
-    for (size_t i = 0; i < index->n_entries; i++)
+    if (n_workers >= 0)
     {
-        ffindex_entry_t *entry = ffindex_get_entry_by_index(index, i);
-        if (entry == NULL)
-        {
-            exit_status = errno;
-            break;
+        if (n_workers == 0) {
+            n_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
         }
-
-        int error = ffindex_apply_by_entry(data, entry,
-                                           program_name, program_argv,
-                                           data_file_out, index_file_out, stdout,
-                                           &offset, quiet);
-        if (error != 0)
+        exit_status = ffindex_apply_workers(data, index, program_name, program_argv,
+                                            data_file_out, index_file_out, stdout, quiet,
+                                            n_workers < 1 ? 1 : n_workers, retries, ordered,
+                                            timeout > 0 ? timeout * 1000LL : 0);
+    }
+    else
+    {
+        size_t offset = 0;
+        for (size_t i = 0; i < index->n_entries; i++)
         {
-            perror(entry->name);
-            exit_status = errno;
-            break;
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(index, i);
+            if (entry == NULL)
+            {
+                exit_status = errno;
+                break;
+            }
+
+            int error = ffindex_apply_by_entry(data, entry,
+                                               program_name, program_argv,
+                                               data_file_out, index_file_out, stdout,
+                                               &offset, quiet);
+            if (error != 0)
+            {
+                perror(entry->name);
+                exit_status = errno;
+                break;
+            }
         }
     }
 
@@ -528,6 +1009,11 @@ int main(int argn, char **argv) {
     if (data_file_out) {
         fclose(data_file_out);
     }
+
+    // workers finish entries out of order
+    if (n_workers >= 0 && index_filename_out != NULL) {
+        ffsort_index(index_filename_out);
+    }
 #endif
 
     munmap(index->index_data, index->index_data_size);
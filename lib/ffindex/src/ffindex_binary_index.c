@@ -0,0 +1,65 @@
+/*
+ * ffindex_binary_index
+ * Please add your name here if you distribute modified versions.
+ *
+ * FFindex is provided under the Create Commons license "Attribution-ShareAlike
+ * 4.0", which basically captures the spirit of the Gnu Public License (GPL).
+ *
+ * See:
+ * http://creativecommons.org/licenses/by-sa/4.0/
+ *
+ * ffindex_binary_index
+ * Writes the binary sidecar INDEX_FILENAME.bin of an FFindex index file.
+ * Programs that find an up-to-date sidecar map it instead of parsing the text index.
+ * The sidecar is ignored once the text index is modified, so it has to be
+ * regenerated after the index was changed.
+*/
+
+#define _GNU_SOURCE 1
+#define _LARGEFILE64_SOURCE 1
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "ffindex.h"
+#include "ffutil.h"
+
+
+int main(int argc, char **argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "USAGE: %s INDEX_FILENAME [INDEX_FILENAME ...]\n"
+                    "\tWrites INDEX_FILENAME.bin for each index file.\n",
+                    argv[0]);
+    return -1;
+  }
+
+  int status = EXIT_SUCCESS;
+  for(int i = 1; i < argc; i++)
+  {
+    char *index_filename = argv[i];
+
+    FILE *index_file = fopen(index_filename, "r");
+    if(index_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], index_filename);  exit(EXIT_FAILURE); }
+
+    size_t entries = ffcount_lines(index_filename);
+    ffindex_index_t* index = ffindex_index_parse(index_file, entries);
+    if(index == NULL) { fferror_print(__FILE__, __LINE__, "ffindex_index_parse", index_filename);  exit(EXIT_FAILURE); }
+    fclose(index_file);
+
+    ffindex_sort_index_file(index);
+    if(ffindex_write_binary_index(index, index_filename) != EXIT_SUCCESS)
+      status = EXIT_FAILURE;
+
+    munmap(index->index_data, index->index_data_size);
+    free(index);
+  }
+
+  return status;
+}
+
+/* vim: ts=2 sw=2 et
+*/
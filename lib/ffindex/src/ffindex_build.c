@@ -165,6 +165,9 @@ int main(int argn, char** argv)
     if(index_file == NULL) { perror(index_filename); return EXIT_FAILURE; }
   }
 
+  /* a binary index sidecar does not know the entries added below */
+  if(ffindex_remove_binary_index(index_filename) != EXIT_SUCCESS) return EXIT_FAILURE;
+
 
   /* For each list_file insert */
   if(list_filenames_index > 0)
@@ -150,6 +150,7 @@ int main(int argn, char **argv)
     perror(index_filename);
     return EXIT_FAILURE;
   }
+  err += ffindex_remove_binary_index(index_filename);
   err += ffindex_write(index, index_file);
   return err;
 }
@@ -2,10 +2,10 @@
  * ffindex_order
  * written by Milot Mirdita <milot@mirdita.de>.
  * Please add your name here if you distribute modified versions.
- * 
+ *
  * FFindex is provided under the Create Commons license "Attribution-ShareAlike
  * 4.0", which basically captures the spirit of the Gnu Public License (GPL).
- * 
+ *
  * See:
  * http://creativecommons.org/licenses/by-sa/4.0/
  *
@@ -13,6 +13,10 @@
  * Reorders the entries in a FFindex data file by the order given by file
  * Each line of the order file must contain a key from the FFindex index.
  * The FFindex data file entries will have the same order as the order file.
+ * Instead of an order file the entries can be laid out by name (-n) or in the
+ * data file order of another FFindex (-i), e.g. the cs219 database that the
+ * prefilter reads, so that the entries are stored in the order they are accessed.
+ * The new data file is written in parallel with OpenMP (see OMP_NUM_THREADS).
 */
 
 #define _GNU_SOURCE 1
@@ -22,109 +26,232 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+
+#include <getopt.h>
 
 #include "ffindex.h"
 #include "ffutil.h"
 
 
+void usage(char *program_name)
+{
+  fprintf(stderr, "USAGE: %s [-n | -i ORDER_INDEX_FILENAME | ORDER_FILENAME] DATA_FILENAME INDEX_FILENAME SORTED_DATA_OUT_FILE SORTED_INDEX_OUT_FILE\n"
+                  "\tORDER_FILENAME\tthe entries are written in the order of the keys in this file, one per line\n"
+                  "\t-n\t\twrite the entries ordered by name\n"
+                  "\t-i FFINDEX_FILE\twrite the entries in the data file order of another ffindex,\n"
+                  "\t\t\te.g. the cs219 index of the same database\n"
+                  "\nDesigned and implemented by Milot Mirdita <milot@mirdita.de>.\n",
+                  program_name);
+}
+
+
+/* Parse an index file, NULL on failure */
+static ffindex_index_t* parse_index(char *program_name, char *index_filename)
+{
+  FILE *index_file = fopen(index_filename, "r");
+  if(index_file == NULL) { fferror_print(__FILE__, __LINE__, program_name, index_filename);  return NULL; }
+
+  size_t entries = ffcount_lines(index_filename);
+  ffindex_index_t* index = ffindex_index_parse(index_file, entries);
+  fclose(index_file);
+  if(index == NULL)
+    perror("ffindex_index_parse failed");
+  return index;
+}
+
+
+/* Append ENTRY to ORDERED and remember its offset in the input data file */
+static void append_entry(ffindex_index_t* ordered, size_t* source_offsets, ffindex_entry_t* entry)
+{
+  source_offsets[ordered->n_entries] = entry->offset;
+  ordered->entries[ordered->n_entries++] = *entry;
+}
+
+
 int main(int argc, char **argv)
 {
-  if(argc < 6)
+  int by_name = 0;
+  char *order_index_filename = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "ni:")) != -1)
   {
-    fprintf(stderr, "USAGE: %s ORDER_FILENAME DATA_FILENAME INDEX_FILENAME SORTED_DATA_OUT_FILE SORTED_INDEX_OUT_FILE\n"
-                    "\nDesigned and implemented by Milot Mirdita <milot@mirdita.de>.\n",
-                    argv[0]);
-    return -1;
+    switch (opt)
+    {
+      case 'n':
+        by_name = 1;
+        break;
+      case 'i':
+        order_index_filename = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
   }
-  
-  char *order_filename = argv[1];
-  
-  char *data_filename  = argv[2];
-  char *index_filename = argv[3];
-  
-  char *sorted_data_filename  = argv[4];
-  char *sorted_index_filename = argv[5];
 
-  FILE *order_file = fopen(order_filename, "r");
+  int order_file_given = !by_name && order_index_filename == NULL;
+  if(argc - optind != 4 + order_file_given || (by_name && order_index_filename != NULL))
+  {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-  FILE *data_file  = fopen(data_filename,  "r");
-  FILE *index_file = fopen(index_filename, "r");
+  char *order_filename = order_file_given ? argv[optind++] : NULL;
 
-  FILE *sorted_data_file  = fopen(sorted_data_filename,  "w+");
-  FILE *sorted_index_file = fopen(sorted_index_filename, "w+");
+  char *data_filename  = argv[optind++];
+  char *index_filename = argv[optind++];
 
-  if(order_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], order_filename);  exit(EXIT_FAILURE); }
+  char *sorted_data_filename  = argv[optind++];
+  char *sorted_index_filename = argv[optind++];
 
+  FILE *data_file  = fopen(data_filename,  "r");
   if( data_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], data_filename);  exit(EXIT_FAILURE); }
-  if(index_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], index_filename);  exit(EXIT_FAILURE); }
-
-  if( sorted_data_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], sorted_data_filename);  exit(EXIT_FAILURE); }
-  if(sorted_index_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], sorted_index_filename);  exit(EXIT_FAILURE); }
 
   size_t data_size;
   char *data = ffindex_mmap_data(data_file, &data_size);
 
-  size_t entries = ffcount_lines(index_filename);
-  ffindex_index_t* index = ffindex_index_parse(index_file, entries);
-  if(index == NULL)  {   
-    perror("ffindex_index_parse failed");
+  ffindex_index_t* index = parse_index(argv[0], index_filename);
+  if(index == NULL)
+    exit(EXIT_FAILURE);
+  // lookups by name need the index sorted by name
+  ffindex_sort_index_file(index);
+
+  // The entries in their new order, with their offsets in the input data file
+  size_t nbytes = sizeof(ffindex_index_t) + sizeof(ffindex_entry_t) * index->n_entries;
+  ffindex_index_t* ordered = (ffindex_index_t*)malloc(nbytes);
+  size_t* source_offsets = (size_t*)malloc(sizeof(size_t) * (index->n_entries + 1));
+  if(ordered == NULL || source_offsets == NULL)
+  {
+    fferror_print(__FILE__, __LINE__, argv[0], "malloc failed");
     exit(EXIT_FAILURE);
   }
+  ordered->filename = NULL;
+  ordered->file = NULL;
+  ordered->index_data = NULL;
+  ordered->index_data_size = 0;
+  ordered->num_max_entries = index->n_entries;
+  ordered->n_entries = 0;
 
+  if(by_name)
+  {
+    for(size_t i = 0; i < index->n_entries; i++)
+      append_entry(ordered, source_offsets, &index->entries[i]);
+  }
+  else if(order_index_filename != NULL)
+  {
+    ffindex_index_t* order_index = parse_index(argv[0], order_index_filename);
+    if(order_index == NULL)
+      exit(EXIT_FAILURE);
+    ffindex_sort_index_by_offset(order_index);
 
-  char message[LINE_MAX];
-  char line[LINE_MAX];
-  int i = 0;
-  size_t offset = 0;
-  while (fgets(line, sizeof(line), order_file)) {
-    size_t len = strlen(line);
-    if (len && (line[len - 1] != '\n')) {
-      // line is incomplete
-      snprintf(message, LINE_MAX, "Warning: Line %d of order file %s was too long and cut-off.", i, order_filename);
-      fferror_print(__FILE__, __LINE__, argv[0], message);
+    for(size_t i = 0; i < order_index->n_entries && ordered->n_entries < index->n_entries; i++)
+    {
+      ffindex_entry_t* entry = ffindex_get_entry_by_name(index, order_index->entries[i].name);
+      if(entry != NULL)
+        append_entry(ordered, source_offsets, entry);
     }
+    munmap(order_index->index_data, order_index->index_data_size);
+    free(order_index);
+  }
+  else
+  {
+    FILE *order_file = fopen(order_filename, "r");
+    if(order_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], order_filename);  exit(EXIT_FAILURE); }
+
+    char message[LINE_MAX];
+    char line[LINE_MAX];
+    int i = 0;
+    while (fgets(line, sizeof(line), order_file) && ordered->n_entries < index->n_entries) {
+      size_t len = strlen(line);
+      if (len && (line[len - 1] != '\n')) {
+        // line is incomplete
+        snprintf(message, LINE_MAX, "Warning: Line %d of order file %s was too long and cut-off.", i, order_filename);
+        fferror_print(__FILE__, __LINE__, argv[0], message);
+      }
 
-    // remove new line
-    char *name = ffnchomp(line, len);
-    ffindex_entry_t* entry = ffindex_get_entry_by_name(index, name);
+      // remove new line
+      char *name = ffnchomp(line, len);
+      ffindex_entry_t* entry = ffindex_get_entry_by_name(index, name);
+      if (entry != NULL)
+        append_entry(ordered, source_offsets, entry);
 
-    if (entry != NULL) {
-      char* filedata = ffindex_get_data_by_entry(data, entry);
-      size_t entryLength = (entry->length == 0 ) ? 0 : entry->length - 1;
-      ffindex_insert_memory(sorted_data_file, sorted_index_file, &offset, filedata, entryLength, name);
+      i++;
     }
+    fclose(order_file);
+  }
+
+  // Lay out the entries one after the other, each followed by '\0'
+  size_t offset = 0;
+  for(size_t i = 0; i < ordered->n_entries; i++)
+  {
+    ffindex_entry_t* entry = &ordered->entries[i];
+    size_t entry_length = (entry->length == 0) ? 0 : entry->length - 1;
+    entry->offset = offset;
+    entry->length = entry_length + 1;
+    offset += entry->length;
+  }
+
+  FILE *sorted_data_file  = fopen(sorted_data_filename,  "w+");
+  if( sorted_data_file == NULL) { fferror_print(__FILE__, __LINE__, argv[0], sorted_data_filename);  exit(EXIT_FAILURE); }
 
-    i++;
+  // The file is created at its final size filled with '\0', so the threads only write the entry contents
+  int sorted_data_fd = fileno(sorted_data_file);
+  if(ftruncate(sorted_data_fd, offset) != 0)
+  {
+    fferror_print(__FILE__, __LINE__, argv[0], sorted_data_filename);
+    exit(EXIT_FAILURE);
+  }
+
+  int err = EXIT_SUCCESS;
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for(size_t i = 0; i < ordered->n_entries; i++)
+  {
+    ffindex_entry_t* entry = &ordered->entries[i];
+    char* from = ffindex_get_data_by_offset(data, source_offsets[i]);
+    size_t remaining = entry->length - 1;
+    size_t written = 0;
+    while(remaining > 0)
+    {
+      ssize_t n = pwrite(sorted_data_fd, from + written, remaining, entry->offset + written);
+      if(n <= 0)
+      {
+        #pragma omp critical
+        {
+          fferror_print(__FILE__, __LINE__, argv[0], entry->name);
+          err = EXIT_FAILURE;
+        }
+        break;
+      }
+      written += n;
+      remaining -= n;
+    }
   }
-  
-  // cleanup
   fclose(sorted_data_file);
-  fclose(index_file);
   fclose(data_file);
-  fclose(order_file);
 
   // sort FFindex index
-  fclose(sorted_index_file);
-  sorted_index_file = fopen(sorted_index_filename, "r+");
-  entries = ffcount_lines(index_filename);
-  index = ffindex_index_parse(sorted_index_file, entries);
-  if(index == NULL)  {   
-    perror("ffindex_index_parse failed");
-    exit(EXIT_FAILURE);
-  }
-  fclose(sorted_index_file);
-  
-  ffindex_sort_index_file(index);
-  sorted_index_file = fopen(sorted_index_filename, "w");
+  ffindex_sort_index_file(ordered);
+  FILE *sorted_index_file = fopen(sorted_index_filename, "w");
   if(sorted_index_file == NULL) {
     perror(sorted_index_filename);
     return EXIT_FAILURE;
   }
-  int err = ffindex_write(index, sorted_index_file);
+  if(ffindex_remove_binary_index(sorted_index_filename) != EXIT_SUCCESS)
+    err = EXIT_FAILURE;
+  if(ffindex_write(ordered, sorted_index_file) != EXIT_SUCCESS)
+    err = EXIT_FAILURE;
   fclose(sorted_index_file);
- 
+
+  free(source_offsets);
+  free(ordered);
+  munmap(index->index_data, index->index_data_size);
+  free(index);
+
   return err;
 }
 
@@ -117,7 +117,8 @@ int compressed_a3m::compress_a3m(std::istream* input,
 
 int compressed_a3m::compress_a3m(char* input, size_t input_size,
     ffindex_index_t* ffindex_sequence_database_index,
-    char* ffindex_sequence_database_data, std::ostream* output) {
+    char* ffindex_sequence_database_data, std::ostream* output,
+    const SequenceNameIndex* name_index) {
 
   bool sequence_flag = false;
   bool consensus_flag = false;
@@ -167,7 +168,7 @@ int compressed_a3m::compress_a3m(char* input, size_t input_size,
           std::string short_id = getShortIdFromHeader(id);
           if(compressed_a3m::compress_sequence(short_id, sequence,
               ffindex_sequence_database_index, ffindex_sequence_database_data,
-              output)) {
+              output, name_index)) {
             nr_sequences++;
           }
         }
@@ -183,7 +184,7 @@ int compressed_a3m::compress_a3m(char* input, size_t input_size,
       }
 
       //copy line without new line
-      header = std::string(&input[start_index], index - start_index);
+      header.assign(&input[start_index], index - start_index);
 
       id = getNameFromHeader(header);
 
@@ -196,13 +197,13 @@ int compressed_a3m::compress_a3m(char* input, size_t input_size,
       size_t start_index = index;
       while(index + 1 < input_size && input[index + 1] != '>' && input[index] != '\0') {
         if(input[index] == '\n') {
-          sequence += std::string(&input[start_index], index - start_index);
+          sequence.append(&input[start_index], index - start_index);
           start_index = index + 1;
         }
         index++;
       }
 
-      sequence += std::string(&input[start_index], index - start_index);
+      sequence.append(&input[start_index], index - start_index);
     }
 
     index++;
@@ -222,7 +223,7 @@ int compressed_a3m::compress_a3m(char* input, size_t input_size,
       std::string short_id = getShortIdFromHeader(id);
       if(compressed_a3m::compress_sequence(short_id, sequence,
           ffindex_sequence_database_index, ffindex_sequence_database_data,
-          output)) {
+          output, name_index)) {
         nr_sequences++;
       }
     }
@@ -353,14 +354,39 @@ void compressed_a3m::extract_a3m(char* data, size_t data_size,
   }
 }
 
-int compressed_a3m::compress_sequence(std::string id,
-    std::string aligned_sequence,
-    ffindex_index_t* ffindex_sequence_database_index,
-    char* ffindex_sequence_database_data, std::ostream* output) {
+void compressed_a3m::build_name_index(ffindex_index_t* ffindex_sequence_database_index,
+    SequenceNameIndex& name_index) {
+  name_index.clear();
+  name_index.reserve(ffindex_sequence_database_index->n_entries);
 
-  ffindex_entry_t* entry = ffindex_get_entry_by_name(
-      ffindex_sequence_database_index, const_cast<char*>(id.c_str()));
+  for (size_t i = 0; i < ffindex_sequence_database_index->n_entries; i++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(ffindex_sequence_database_index, i);
+    name_index[entry->name] = i;
+  }
+}
 
+int compressed_a3m::compress_sequence(const std::string& id,
+    const std::string& aligned_sequence,
+    ffindex_index_t* ffindex_sequence_database_index,
+    char* ffindex_sequence_database_data, std::ostream* output,
+    const SequenceNameIndex* name_index) {
+
+  ffindex_entry_t* entry = NULL;
+  uint32_t entry_index = 0;
+  if (name_index != NULL) {
+    SequenceNameIndex::const_iterator it = name_index->find(id);
+    if (it != name_index->end()) {
+      entry_index = it->second;
+      entry = ffindex_get_entry_by_index(ffindex_sequence_database_index, entry_index);
+    }
+  }
+  else {
+    entry = ffindex_get_entry_by_name(ffindex_sequence_database_index, const_cast<char*>(id.c_str()));
+    if (entry != NULL) {
+      ffindex_entry_t* entry_zero = ffindex_get_entry_by_index(ffindex_sequence_database_index, 0);
+      entry_index = entry - entry_zero;
+    }
+  }
 
   if (entry == NULL) {
     //TODO: proper errors
@@ -369,9 +395,6 @@ int compressed_a3m::compress_sequence(std::string id,
     return 0;
   }
 
-  ffindex_entry_t* entry_zero = ffindex_get_entry_by_index(ffindex_sequence_database_index, 0);
-  uint32_t entry_index = entry - entry_zero;
-
   char* full_sequence = ffindex_get_data_by_entry(
       ffindex_sequence_database_data, entry);
   if (full_sequence == NULL) {
@@ -390,49 +413,9 @@ int compressed_a3m::compress_sequence(std::string id,
     return 0;
   }
 
-  writeU32(*output, entry_index);
-  writeU16(*output, start_pos);
-
-  //count blocks
-  unsigned short int index = 0;
-  unsigned short int nr_blocks = 0;
-  while (index < aligned_sequence.size()) {
-    int nr_matches = 0;
-    while (aligned_sequence[index] != '-' && isupper(aligned_sequence[index]) && index < aligned_sequence.size()) {
-      nr_matches++;
-      index++;
-    }
-
-    int nr_insertions = 0;
-    while (islower(aligned_sequence[index]) && index < aligned_sequence.size()) {
-      nr_insertions++;
-      index++;
-    }
-
-    int nr_gaps = 0;
-    while (nr_insertions == 0 && aligned_sequence[index] == '-'
-        && index < aligned_sequence.size()) {
-      nr_gaps++;
-      index++;
-    }
-
-    while(nr_gaps != 0 || nr_insertions != 0 || nr_matches != 0) {
-      if(index == aligned_sequence.size() && nr_matches == 0 && nr_insertions == 0) {
-        break;
-      }
-
-      nr_matches -= std::min(nr_matches, SCHAR_MAX);
-      nr_gaps -= std::min(nr_gaps, SCHAR_MAX);
-      nr_insertions -= std::min(nr_insertions, SCHAR_MAX);
-
-      nr_blocks++;
-    }
-  }
-
-  writeU16(*output, nr_blocks);
-
-  index = 0;
-  //count gaps
+  //encode the blocks of matches followed by insertions or gaps in one pass
+  std::string blocks;
+  size_t index = 0;
   while (index < aligned_sequence.size()) {
     int nr_matches = 0;
     while (aligned_sequence[index] != '-' && isupper(aligned_sequence[index]) && index < aligned_sequence.size()) {
@@ -465,36 +448,38 @@ int compressed_a3m::compress_sequence(std::string id,
       nr_gaps -= print_gaps;
       nr_insertions -= print_insertions;
 
-      output->put(print_matches);
-      print_insertions > 0?output->put(print_insertions):output->put((-1)*print_gaps);
+      blocks.push_back(print_matches);
+      blocks.push_back(print_insertions > 0 ? print_insertions : (-1)*print_gaps);
     }
   }
 
+  writeU32(*output, entry_index);
+  writeU16(*output, start_pos);
+  writeU16(*output, blocks.size() / 2);
+  output->write(blocks.data(), blocks.size());
+
   return 1;
 }
 
 //returns pos not index
-unsigned short int compressed_a3m::get_start_pos(std::string aligned_sequence,
-    char* full_sequence, size_t full_sequence_length) {
-  aligned_sequence.erase(
-      std::remove(aligned_sequence.begin(), aligned_sequence.end(), '-'),
-      aligned_sequence.end());
-
-  for (unsigned short int i = 0; i < full_sequence_length; i++) {
-    bool match = true;
-    for (unsigned short int j = 0; j < aligned_sequence.size(); j++) {
-      if (full_sequence[i+j] != toupper(aligned_sequence[j])) {
-        match = false;
-        break;
-      }
+unsigned short int compressed_a3m::get_start_pos(const std::string& aligned_sequence,
+    const char* full_sequence, size_t full_sequence_length) {
+  std::string residues;
+  residues.reserve(aligned_sequence.size());
+  for (size_t i = 0; i < aligned_sequence.size(); i++) {
+    if (aligned_sequence[i] != '-') {
+      residues.push_back(toupper(aligned_sequence[i]));
     }
+  }
 
-    if (match) {
-      return i + 1;
-    }
+  // memmem is a two-way string search in glibc, linear in the length of the full sequence
+  const char* match = static_cast<const char*>(memmem(full_sequence, full_sequence_length,
+      residues.data(), residues.size()));
+  if (match == NULL || match - full_sequence >= USHRT_MAX) {
+    return 0;
   }
 
-  return 0;
+  return match - full_sequence + 1;
 }
 
 // trim from end
@@ -16,23 +16,33 @@
 #include <algorithm>
 #include <cstring>
 #include <climits>
+#include <cstdint>
+#include <unordered_map>
 
 extern "C" {
   #include <ffindex.h>     // fast index-based database reading
 }
 
 namespace compressed_a3m {
+  // Entry index of each name in the sequence database; built once with build_name_index
+  // and shared by all threads, so that member sequences are found without a binary search
+  typedef std::unordered_map<std::string, uint32_t> SequenceNameIndex;
+
+  void build_name_index(ffindex_index_t* ffindex_sequence_database_index, SequenceNameIndex& name_index);
+
   int compress_a3m(std::istream* input, ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data, std::ostream* output);
-  int compress_a3m(char* input, size_t input_size, ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data, std::ostream* output);
+  int compress_a3m(char* input, size_t input_size, ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data, std::ostream* output,
+      const SequenceNameIndex* name_index = NULL);
 
-  int compress_sequence(std::string id, std::string sequence, ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data, std::ostream* output);
+  int compress_sequence(const std::string& id, const std::string& sequence, ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data, std::ostream* output,
+      const SequenceNameIndex* name_index = NULL);
 
   void extract_a3m(char* data, size_t data_size,
       ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data,
       ffindex_index_t* ffindex_header_database_index, char* ffindex_header_data, std::ostream* output);
 
 
-  unsigned short int get_start_pos(std::string aligned_sequence, char* full_sequence, size_t full_sequence_length);
+  unsigned short int get_start_pos(const std::string& aligned_sequence, const char* full_sequence, size_t full_sequence_length);
 
   void writeU16(std::ostream& file, uint16_t);
   void readU16(char** ptr, uint16_t &result);
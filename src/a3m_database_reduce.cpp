@@ -7,13 +7,20 @@
 
 
 #include "a3m_compress.h"
+#include "ffindexdatabase.h"
+#include "hhutil.h"
 
 #include <iostream>
 #include <getopt.h>
 #include <sstream>
+#include <stdio.h>
+#ifdef OPENMP
+#include <omp.h>
+#endif
 
 void usage() {
   std::cout << "a3m_database_reduce -i [ffindex_a3m_database_prefix] -o [ffindex_ca3m_database_prefix] -d [ffindex_sequence_database_prefix]" << std::endl;
+  std::cout << " The alignments are compressed in parallel by all OpenMP threads (OMP_NUM_THREADS)." << std::endl;
 }
 
 int main(int argc, char **argv) {
@@ -60,25 +67,6 @@ int main(int argc, char **argv) {
     exit(0);
   }
 
-  //prepare ffindex ca3m database
-  std::string ca3mDataFile = ffindex_ca3m_db_prefix+".ffdata";
-  std::string ca3mIndexFile = ffindex_ca3m_db_prefix+".ffindex";
-
-  FILE *ca3m_data_fh  = fopen(ca3mDataFile.c_str(), "w");
-  FILE *ca3m_index_fh = fopen(ca3mIndexFile.c_str(), "w");
-
-  if (ca3m_data_fh == NULL) {
-    std::cerr << "ERROR: Could not open ffindex ca3m data file! (" << ca3mDataFile << ")!" << std::endl;
-    exit(1);
-  }
-
-  if(ca3m_index_fh == NULL) {
-    std::cerr << "ERROR: Could not open ffindex ca3m index file! (" << ca3mIndexFile << ")!" << std::endl;
-    exit(1);
-  }
-
-  size_t ca3m_offset = 0;
-
   //prepare ffindex a3m database
   std::string a3mDataFile = ffindex_a3m_db_prefix+".ffdata";
   std::string a3mIndexFile = ffindex_a3m_db_prefix+".ffindex";
@@ -98,7 +86,8 @@ int main(int argc, char **argv) {
 
   size_t a3m_offset;
   char* a3m_data = ffindex_mmap_data(a3m_data_fh, &a3m_offset);
-  ffindex_index_t* a3m_index = ffindex_index_parse(a3m_index_fh, 0);
+  // +1: ffindex_index_parse would fall back to its default maximum for an empty index
+  ffindex_index_t* a3m_index = ffindex_index_parse(a3m_index_fh, CountLinesInFile(a3mIndexFile.c_str()) + 1);
 
   if(a3m_index == NULL) {
     std::cerr << "ERROR: A3M index could not be loaded!" << std::endl;
@@ -124,49 +113,54 @@ int main(int argc, char **argv) {
 
   size_t sequence_data_size;
   char* sequence_data = ffindex_mmap_data(sequence_data_fh, &sequence_data_size);
-  ffindex_index_t* sequence_index = ffindex_index_parse(sequence_index_fh, 80000000);
+  ffindex_index_t* sequence_index = ffindex_index_parse(sequence_index_fh, CountLinesInFile(sequenceIndexFile.c_str()) + 1);
 
   if(sequence_index == NULL) {
     std::cerr << "ERROR: Sequence index could not be loaded!" << std::endl;
     exit(1);
   }
 
-  //prepare input stream
-  size_t a3m_range_start = 0;
-  size_t a3m_range_end = a3m_index->n_entries;
+  compressed_a3m::SequenceNameIndex name_index;
+  compressed_a3m::build_name_index(sequence_index, name_index);
 
-  // Foreach entry
-  #pragma omp parallel for shared(a3m_index, a3m_data, ca3m_data_fh, ca3m_index_fh, ca3m_offset)
-  for(size_t entry_index = a3m_range_start; entry_index < a3m_range_end; entry_index++)
+  //prepare ffindex ca3m database, written as one shard per thread and merged at the end
+  int shards = 1;
+#ifdef OPENMP
+  shards = omp_get_max_threads();
+#endif
+  FFindexShardedWriter ca3m_writer(ffindex_ca3m_db_prefix, shards);
+
+  #pragma omp parallel num_threads(shards) shared(a3m_index, a3m_data, sequence_index, sequence_data, name_index, ca3m_writer)
   {
-    //fprintf(stderr, "index %ld\n", entry_index);
-    ffindex_entry_t* entry = ffindex_get_entry_by_index(a3m_index, entry_index);
-    if(entry == NULL) { perror(entry->name); continue; }
+    int thread = 0;
+#ifdef OPENMP
+    thread = omp_get_thread_num();
+#endif
 
-    char* data = ffindex_get_data_by_entry(a3m_data, entry);
+    std::stringstream out_buffer;
 
-    std::stringstream* out_buffer = new std::stringstream();
-    int ret = compressed_a3m::compress_a3m(data, entry->length, sequence_index, sequence_data, out_buffer);
+    // Foreach entry; alignments differ a lot in size, so they are handed out dynamically
+    #pragma omp for schedule(dynamic, 16)
+    for(size_t entry_index = 0; entry_index < a3m_index->n_entries; entry_index++)
+    {
+      ffindex_entry_t* entry = ffindex_get_entry_by_index(a3m_index, entry_index);
+      if(entry == NULL) { continue; }
 
-    if(ret) {
-      std::string out_string = out_buffer->str();
+      char* data = ffindex_get_data_by_entry(a3m_data, entry);
 
-      #pragma omp critical
-      {
-        ffindex_insert_memory(ca3m_data_fh, ca3m_index_fh, &ca3m_offset, const_cast<char*>(out_string.c_str()), out_string.size(), entry->name);
-      }
+      out_buffer.str("");
+      int ret = compressed_a3m::compress_a3m(data, entry->length, sequence_index, sequence_data, &out_buffer, &name_index);
 
+      if(ret) {
+        ca3m_writer.insert(thread, out_buffer.str(), entry->name);
+      }
+      else {
+        #pragma omp critical
+        std::cerr << "WARNING: Could not compress A3M! ("<< entry->name << ")" << std::endl;
+      }
     }
-    else {
-      std::cerr << "WARNING: Could not compress A3M! ("<< entry->name << ")" << std::endl;
-    }
-
-    delete out_buffer;
   }
 
-  fclose(ca3m_index_fh);
-  fclose(ca3m_data_fh);
-
-  ffsort_index(ca3mIndexFile.c_str());
+  // merges and sorts the shards and removes them
+  ca3m_writer.merge();
 }
-
@@ -0,0 +1,109 @@
+// Class for Arena memory allocation
+// * hands out memory from a few large, aligned blocks instead of one heap allocation per array
+// * arrays cannot be freed individually; all memory is released at once with Clear() or by the destructor
+// * Reset() makes all memory available again but keeps the blocks, so an arena that is refilled
+//   many times (e.g. an Alignment reused for the entries of a database) does not go back to the heap
+// * every returned pointer is aligned to ALIGN_INT, so arrays can be read with aligned SIMD loads
+//
+// Applications
+// * many small arrays with the same lifetime, e.g. the residue rows X[k] and insert rows I[k] of an Alignment
+//
+// Time complexity:
+// * Allocate(): O(1) (a kept or new block is taken when the current one is exhausted)
+// * Swap(), Reset(): O(1)
+// * Clear(), ~Arena(): O(number of blocks)
+//
+// Implementation:
+// Blocks grow geometrically from MIN_BLOCK to MAX_BLOCK bytes, so small alignments
+// cost little memory while large ones need only a few hundred blocks.
+// Requests larger than the current block size get a block of their own.
+// After Reset() the kept blocks are handed out again in order; a request that does not
+// fit into the next kept block gets a new block that is inserted before it.
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#include "simd.h"
+
+class Arena
+{
+public:
+  Arena() : used(0), cur(NULL), remaining(0), next_block(MIN_BLOCK) {}
+  ~Arena() { Clear(); }
+
+  // Return size bytes of uninitialized memory aligned to ALIGN_INT
+  void* Allocate(size_t size) {
+    size = ((size + ALIGN_INT - 1) / ALIGN_INT) * ALIGN_INT;
+    if (size > remaining) {
+      if (used < blocks.size() && size <= block_sizes[used]) {
+        cur = blocks[used];
+        remaining = block_sizes[used];
+      } else {
+        size_t block = next_block;
+        if (size > block)
+          block = size;
+        cur = (char*) mem_align(ALIGN_INT, block);
+        blocks.insert(blocks.begin() + used, cur);
+        block_sizes.insert(block_sizes.begin() + used, block);
+        remaining = block;
+        if (next_block < MAX_BLOCK)
+          next_block *= 2;
+      }
+      ++used;
+    }
+    void* ptr = cur;
+    cur += size;
+    remaining -= size;
+    return ptr;
+  }
+
+  // Exchange the blocks of two arenas
+  void Swap(Arena& other) {
+    blocks.swap(other.blocks);
+    block_sizes.swap(other.block_sizes);
+    std::swap(used, other.used);
+    std::swap(cur, other.cur);
+    std::swap(remaining, other.remaining);
+    std::swap(next_block, other.next_block);
+  }
+
+  // Release all memory handed out so far
+  void Clear() {
+    for (size_t b = 0; b < blocks.size(); ++b)
+      free(blocks[b]);
+    blocks.clear();
+    block_sizes.clear();
+    used = 0;
+    cur = NULL;
+    remaining = 0;
+    next_block = MIN_BLOCK;
+  }
+
+  // Make all memory handed out so far available again, keeping the blocks for reuse
+  void Reset() {
+    used = 0;
+    cur = NULL;
+    remaining = 0;
+  }
+
+private:
+  static const size_t MIN_BLOCK = 64 * 1024;
+  static const size_t MAX_BLOCK = 4 * 1024 * 1024;
+
+  std::vector<char*> blocks;  // all blocks allocated since the last Clear()
+  std::vector<size_t> block_sizes;  // size of each block in bytes
+  size_t used;                // blocks[0..used-1] have been handed out from since the last Reset()
+  char* cur;                  // next free byte in the current block
+  size_t remaining;           // free bytes left in the current block
+  size_t next_block;          // size of the next block to allocate
+
+  // Arenas own their blocks and must not be copied
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+};
+
+#endif
@@ -0,0 +1,153 @@
+// blockcompresseddata.cpp
+
+#include "blockcompresseddata.h"
+#include "log.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+// The blocks inflated last by this thread
+struct BlockCache {
+  uint64_t id;
+  size_t first;
+  size_t last;
+  std::vector<char> buffer;
+
+  BlockCache() : id(0), first(1), last(0) {}
+};
+
+thread_local BlockCache cache;
+std::atomic<uint64_t> next_id(1);
+}
+
+BlockCompressedData::BlockCompressedData(const char* data, const size_t size)
+    : data(data), header((const BlockCompressedHeader*) data), id(next_id++) {
+  offsets = (const uint64_t*) (data + sizeof(BlockCompressedHeader));
+
+  bool valid = isBlockCompressed(data, size) && header->block_size > 0
+      && header->n_blocks == (header->data_size + header->block_size - 1) / header->block_size
+      && size >= sizeof(BlockCompressedHeader) + (header->n_blocks + 1) * sizeof(uint64_t);
+  for (size_t b = 0; valid && b < header->n_blocks; b++) {
+    valid = offsets[b] <= offsets[b + 1];
+  }
+  if (!valid || offsets[header->n_blocks] > size) {
+    HH_LOG(ERROR) << "Block-compressed data file is truncated or corrupted!" << std::endl;
+    exit(1);
+  }
+
+#ifndef HAVE_ZLIB
+  HH_LOG(ERROR) << "Reading block-compressed data files needs HH-suite compiled with zlib!" << std::endl;
+  exit(1);
+#endif
+}
+
+bool BlockCompressedData::isBlockCompressed(const char* data, const size_t size) {
+  return data != NULL && size >= sizeof(BlockCompressedHeader)
+      && memcmp(data, BLOCKCOMPRESSED_MAGIC, sizeof(BLOCKCOMPRESSED_MAGIC)) == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Inflate the blocks that hold [offset, offset+length) unless the calling thread has inflated them already
+/////////////////////////////////////////////////////////////////////////////////////
+char* BlockCompressedData::get(const size_t offset, const size_t length) {
+  if (length == 0 || offset + length > header->data_size) {
+    HH_LOG(ERROR) << "Entry at offset " << offset << " exceeds the block-compressed data file!" << std::endl;
+    exit(1);
+  }
+
+  const size_t first = offset / header->block_size;
+  const size_t last = (offset + length - 1) / header->block_size;
+  if (cache.id != id || first < cache.first || last > cache.last) {
+    cache.buffer.resize((last - first + 1) * header->block_size);
+    inflateBlocks(first, last, &cache.buffer[0]);
+    cache.id = id;
+    cache.first = first;
+    cache.last = last;
+  }
+
+  return &cache.buffer[0] + (offset - cache.first * header->block_size);
+}
+
+void BlockCompressedData::getStoredRange(const size_t offset, const size_t length, const char*& stored,
+    size_t& stored_length) const {
+  const size_t first = std::min<size_t>(offset / header->block_size, header->n_blocks);
+  const size_t last = std::min<size_t>((offset + length + header->block_size - 1) / header->block_size, header->n_blocks);
+  stored = data + offsets[first];
+  stored_length = offsets[last] - offsets[first];
+}
+
+void BlockCompressedData::inflateBlocks(const size_t first, const size_t last, char* buffer) {
+#ifdef HAVE_ZLIB
+  for (size_t b = first; b <= last; b++) {
+    uLongf expected = std::min<uint64_t>(header->block_size, header->data_size - b * header->block_size);
+    uLongf inflated = expected;
+    int status = uncompress((Bytef*) buffer, &inflated, (const Bytef*) (data + offsets[b]), offsets[b + 1] - offsets[b]);
+    if (status != Z_OK || inflated != expected) {
+      HH_LOG(ERROR) << "Could not inflate block " << b << " of block-compressed data file!" << std::endl;
+      exit(1);
+    }
+    buffer += expected;
+  }
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Write header, offset table and the independently compressed blocks
+/////////////////////////////////////////////////////////////////////////////////////
+bool BlockCompressedData::compress(const char* data, const size_t size, FILE* out, const size_t block_size,
+    const int level) {
+#ifdef HAVE_ZLIB
+  BlockCompressedHeader header;
+  memcpy(header.magic, BLOCKCOMPRESSED_MAGIC, sizeof(header.magic));
+  header.block_size = block_size;
+  header.data_size = size;
+  header.n_blocks = (size + block_size - 1) / block_size;
+
+  std::vector<uint64_t> offsets(header.n_blocks + 1);
+  offsets[0] = sizeof(header) + offsets.size() * sizeof(uint64_t);
+
+  // the offset table is written again once the sizes of the blocks are known
+  if (fwrite(&header, sizeof(header), 1, out) != 1
+      || fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), out) != offsets.size()) {
+    return false;
+  }
+
+  std::vector<Bytef> compressed(compressBound(block_size));
+  for (size_t b = 0; b < header.n_blocks; b++) {
+    const size_t length = std::min<size_t>(block_size, size - b * block_size);
+    uLongf compressed_length = compressed.size();
+    if (compress2(&compressed[0], &compressed_length, (const Bytef*) (data + b * block_size), length, level) != Z_OK
+        || fwrite(&compressed[0], 1, compressed_length, out) != compressed_length) {
+      return false;
+    }
+    offsets[b + 1] = offsets[b] + compressed_length;
+  }
+
+  return fseeko(out, sizeof(header), SEEK_SET) == 0
+      && fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), out) == offsets.size();
+#else
+  HH_LOG(ERROR) << "Compressing data files needs HH-suite compiled with zlib!" << std::endl;
+  return false;
+#endif
+}
+
+bool BlockCompressedData::decompress(FILE* out) {
+  std::vector<char> buffer(header->block_size);
+  for (size_t b = 0; b < header->n_blocks; b++) {
+    const size_t length = std::min<uint64_t>(header->block_size, header->data_size - b * header->block_size);
+    inflateBlocks(b, b, &buffer[0]);
+    if (fwrite(&buffer[0], 1, length, out) != length) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,64 @@
+// blockcompresseddata.h
+//
+// Block-compressed ffindex data files
+//
+// The data of an ffindex database is cut into blocks of block_size bytes that are compressed
+// independently with zlib, so an entry can be read by inflating only the blocks it overlaps:
+//
+//   BlockCompressedHeader                magic, block size, size of the uncompressed data
+//   uint64_t offsets[n_blocks + 1]       file offset of each compressed block and of the end of the last
+//   compressed blocks
+//
+// The offsets in the ffindex index refer to the uncompressed data, so the index of a database
+// stays valid when its data file is compressed with ffdata_compress.
+// FFindexDatabase recognizes compressed data files by their magic and inflates entries on access.
+
+#ifndef BLOCKCOMPRESSEDDATA_H_
+#define BLOCKCOMPRESSEDDATA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+const char BLOCKCOMPRESSED_MAGIC[8] = {'\0', 'F', 'F', 'B', 'L', 'K', 'Z', 1};
+
+struct BlockCompressedHeader {
+  char magic[8];          // BLOCKCOMPRESSED_MAGIC
+  uint64_t block_size;    // uncompressed size of all blocks but the last
+  uint64_t data_size;     // size of the uncompressed data
+  uint64_t n_blocks;      // number of compressed blocks
+};
+
+class BlockCompressedData {
+public:
+  // Use the compressed file mapped at data[0..size); exits if the file is truncated
+  BlockCompressedData(const char* data, const size_t size);
+
+  // Check whether data[0..size) starts with the header of a block-compressed file
+  static bool isBlockCompressed(const char* data, const size_t size);
+
+  // Return the uncompressed data [offset, offset+length).
+  // The data is inflated into a buffer of the calling thread and stays valid until
+  // this thread reads the next entry that is not inside the same blocks
+  char* get(const size_t offset, const size_t length);
+
+  // Return the compressed blocks that hold the uncompressed data [offset, offset+length)
+  void getStoredRange(const size_t offset, const size_t length, const char*& stored, size_t& stored_length) const;
+
+  // Compress data[0..size) into out; returns false on write errors
+  static bool compress(const char* data, const size_t size, FILE* out, const size_t block_size, const int level);
+
+  // Write the uncompressed data to out; returns false on write errors
+  bool decompress(FILE* out);
+
+private:
+  const char* data;
+  const BlockCompressedHeader* header;
+  const uint64_t* offsets;
+  uint64_t id;  // identifies the buffers of this file in the thread caches
+
+  // Inflate blocks [first, last] to buffer
+  void inflateBlocks(const size_t first, const size_t last, char* buffer);
+};
+
+#endif
@@ -31,6 +31,11 @@ Alignment<Abc>::Alignment(FILE* fin, AlignmentFormat format) {
     Read(fin, format);
 }
 
+template<class Abc>
+Alignment<Abc>::Alignment(const char* data, size_t length, AlignmentFormat format) {
+    Read(data, length, format);
+}
+
 template<class Abc>
 Alignment<Abc>::Alignment(size_t ncols, size_t nseqs) {
     // Fill alignment matrix with gaps and assign empty headers
@@ -133,6 +138,34 @@ void Alignment<Abc>::Read(FILE* fin, AlignmentFormat format) {
     LOG(DEBUG4) << *this;
 }
 
+template<class Abc>
+void Alignment<Abc>::Read(const char* data, size_t length, AlignmentFormat format) {
+    LOG(DEBUG4) << "Reading alignment from memory ...";
+
+    std::vector<std::string> headers;
+    std::vector<std::string> seqs;
+    ReadFastaFlavors(data, length, headers, seqs);
+    switch (format) {
+        case FASTA_ALIGNMENT:
+            // Convert all characters to match characters
+            for (std::vector<std::string>::iterator it = seqs.begin();
+                 it != seqs.end(); ++it)
+                transform(it->begin(), it->end(), it->begin(), to_match_chr);
+            break;
+        case A2M_ALIGNMENT:
+            break;
+        case A3M_ALIGNMENT:
+            ConvertA3MToA2M(headers, seqs);
+            break;
+        default:
+            throw Exception("Unsupported alignment input format %i!", format);
+    }
+
+    Init(headers, seqs);
+
+    LOG(DEBUG4) << *this;
+}
+
 template<class Abc>
 void Alignment<Abc>::FilterSequencesByHeaders(std::vector<std::string>& headers, std::vector<std::string>& seqs) {
     std::vector<std::string> ignored_headers;
@@ -208,6 +241,58 @@ void Alignment<Abc>::ReadFastaFlavors(FILE* fin, std::vector<std::string>& heade
         throw Exception("Bad alignment: no alignment data found in stream!");
 }
 
+template<class Abc>
+void Alignment<Abc>::ReadFastaFlavors(const char* data, size_t length, std::vector<std::string>& headers, std::vector<std::string>& seqs) {
+    headers.clear();
+    seqs.clear();
+
+    // Same line semantics as fgetline: lines end at '\n', trailing control
+    // characters are removed and the data ends at the first '\0'
+    const char* end = static_cast<const char*>(memchr(data, '\0', length));
+    if (end == NULL) end = data + length;
+    const char* ptr = data;
+    std::string line;
+    while (ptr < end) {
+        // Read header
+        bool header = false;
+        while (ptr < end) {
+            ptr = memgetline(ptr, end, line);
+            if (!strscn(line.c_str())) continue;
+            if (line[0] == '#') {
+                name_ = line.substr(1);
+            } else if (line[0] == '>') {
+                if (headers.empty() &&
+                    (line.compare(0, 4, ">ss_") == 0 || line.compare(0, 4, ">sa_") == 0)) {
+                  while (ptr < end && *ptr != '>')
+                    ptr = memgetline(ptr, end, line);
+                  continue;
+                }
+                headers.push_back(line.substr(1));
+                header = true;
+                break;
+            } else {
+                throw Exception("Header of sequence %i starts with:\n%s",
+                                headers.size() + 1, line.c_str());
+            }
+        }
+        if (!header) break;
+
+        // Read sequence
+        seqs.push_back("");
+        while (ptr < end) {
+            ptr = memgetline(ptr, end, line);
+            seqs.back().append(line);
+            if (ptr < end && *ptr == '>') break;
+        }
+        // Remove whitespace
+        seqs.back().erase(remove_if(seqs.back().begin(), seqs.back().end(), isspace), seqs.back().end());
+
+        LOG(DEBUG2) << headers.back();
+    }
+    if (headers.empty())
+        throw Exception("Bad alignment: no alignment data found in stream!");
+}
+
 template<class Abc>
 void Alignment<Abc>::ReadPsi(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs) {
     headers.clear();
@@ -279,7 +364,11 @@ void Alignment<Abc>::ReadA2M(FILE* fin, std::vector<std::string>& headers, std::
 template<class Abc>
 void Alignment<Abc>::ReadA3M(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs) {
     ReadFastaFlavors(fin, headers, seqs);
+    ConvertA3MToA2M(headers, seqs);
+}
 
+template<class Abc>
+void Alignment<Abc>::ConvertA3MToA2M(std::vector<std::string>& headers, std::vector<std::string>& seqs) {
     FilterSequencesByHeaders(headers, seqs);
 
     // Check number of match states
@@ -88,9 +88,15 @@ class Alignment {
 	  // Reads an alignment in A3M format from given stream.
 	  void ReadA3M(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs);
 
+	  // Converts sequences read from an A3M alignment into A2M sequences.
+	  void ConvertA3MToA2M(std::vector<std::string>& headers, std::vector<std::string>& seqs);
+
 	  // Helper method that reads a FASTA, A2M, or A3M formatted alignment.
 	  void ReadFastaFlavors(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs);
 
+	  // Helper method that reads a FASTA, A2M, or A3M formatted alignment from memory.
+	  void ReadFastaFlavors(const char* data, size_t length, std::vector<std::string>& headers, std::vector<std::string>& seqs);
+
 	  // Reads an alignment in PSI format.
 	  void ReadPsi(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs);
 
@@ -105,6 +111,10 @@ class Alignment {
     // stream.
     Alignment(FILE* fin, AlignmentFormat format);
 
+    // Constructs alignment from a FASTA, A2M or A3M formatted alignment in
+    // data[0..length), e.g. an ffindex entry.
+    Alignment(const char* data, size_t length, AlignmentFormat format);
+
     // Constructs an all-gaps alignment with 'ncols' columns and 'nseqs' sequences
     Alignment(size_t ncols, size_t nseqs);
 
@@ -168,6 +178,10 @@ class Alignment {
     // stream.
     void Read(FILE* fin, AlignmentFormat format);
 
+    // Initializes object with an alignment in FASTA, A2M or A3M format read
+    // from data[0..length). Reading stops at the first '\0'.
+    void Read(const char* data, size_t length, AlignmentFormat format);
+
     // Writes the alignment in given format to ouput stream.
     void Write(FILE* fout, AlignmentFormat format, size_t width = 100) const;
 
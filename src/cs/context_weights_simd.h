@@ -0,0 +1,214 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CS_CONTEXT_WEIGHTS_SIMD_H_
+#define CS_CONTEXT_WEIGHTS_SIMD_H_
+
+#include "count_profile-inl.h"
+#include "context_library-inl.h"
+#include "crf-inl.h"
+#include "sequence-inl.h"
+
+#include "simd.h"
+
+namespace cs {
+
+// Single precision copy of the context weights of a CRF or a context library for
+// calculating the pseudocounts of a sequence window with SIMD instructions.
+//
+// The weights are stored window-transposed and state-major: all states of one window
+// column j and letter a are contiguous, weights_[(j * Abc::kSizeAny + a) * nstates_ + k],
+// so the scores of all states for a window are summed up vector by vector. The number of
+// states is padded to a multiple of VECSIZE_FLOAT with states that get probability zero.
+//
+// The posterior state probabilities are computed with simdf32_fpow2 from simd.h
+// (relative deviation < 2.3E-7); scores and pseudocounts agree with the double
+// precision evaluation to about single precision.
+template<class Abc>
+class ContextWeightsSimd {
+  public:
+    // Uses the context weights, bias weights and pseudocounts of the CRF states.
+    explicit ContextWeightsSimd(const Crf<Abc>& crf)
+            : wlen_(crf.wlen()), center_(crf.center()) {
+        Init(crf.size());
+        for (size_t k = 0; k < crf.size(); ++k) {
+            bias_[k] = crf[k].bias_weight;
+            for (size_t j = 0; j < wlen_; ++j)
+                for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                    weight(j, a)[k] = crf[k].context_weights[j][a];
+            for (size_t a = 0; a < Abc::kSize; ++a)
+                pc(a)[k] = crf[k].pc[a];
+        }
+        CenterRows(crf.size());
+    }
+
+    // Uses the log-space context profiles of the library with the positional window
+    // weights of Emission, i.e. weights w_j * log p_k(j,a) and bias weights log prior_k.
+    ContextWeightsSimd(const ContextLibrary<Abc>& lib, double weight_center, double weight_decay)
+            : wlen_(lib.wlen()), center_(lib.center()) {
+        Init(lib.size());
+        Vector<double> wpos(wlen_);
+        wpos[center_] = weight_center;
+        for (size_t i = 1; i <= center_; ++i) {
+            double w = weight_center * pow(weight_decay, i);
+            wpos[center_ - i] = w;
+            wpos[center_ + i] = w;
+        }
+        for (size_t k = 0; k < lib.size(); ++k) {
+            assert(lib[k].is_log);
+            bias_[k] = lib[k].prior;
+            for (size_t j = 0; j < wlen_; ++j)
+                for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                    weight(j, a)[k] = wpos[j] * lib[k].probs[j][a];
+            for (size_t a = 0; a < Abc::kSize; ++a)
+                pc(a)[k] = lib[k].pc[a];
+        }
+        CenterRows(lib.size());
+    }
+
+    ~ContextWeightsSimd() {
+        free(weights_);
+        free(bias_);
+        free(pcs_);
+    }
+
+    // Number of floats in the scores buffer passed to CalculatePseudocounts.
+    size_t nstates() const { return nstates_; }
+
+    // Calculates the unnormalized pseudocount vector pc of the sequence window centered
+    // at 'idx'. 'scores' is a SIMD aligned buffer of nstates() floats.
+    void CalculatePseudocounts(const Sequence<Abc>& seq, size_t idx, float* scores, double* pc) const {
+        const size_t beg = MAX(0, static_cast<int>(idx - center_));
+        const size_t end = MIN(seq.length(), idx + center_ + 1);
+        const float* rows[wlen_];
+        float coeffs[wlen_];
+        size_t nrows = 0;
+        for(size_t i = beg, j = beg - idx + center_; i < end; ++i, ++j) {
+            rows[nrows] = weight(j, seq[i]);
+            coeffs[nrows++] = 1.0f;
+        }
+        Calculate(rows, coeffs, nrows, scores, pc);
+    }
+
+    // Calculates the unnormalized pseudocount vector pc of the count profile window
+    // centered at 'idx'. 'scores' is a SIMD aligned buffer of nstates() floats.
+    void CalculatePseudocounts(const CountProfile<Abc>& cp, size_t idx, float* scores, double* pc) const {
+        const size_t beg = MAX(0, static_cast<int>(idx - center_));
+        const size_t end = MIN(cp.counts.length(), idx + center_ + 1);
+        const float* rows[wlen_ * Abc::kSize];
+        float coeffs[wlen_ * Abc::kSize];
+        size_t nrows = 0;
+        for(size_t i = beg, j = beg - idx + center_; i < end; ++i, ++j) {
+            for (size_t a = 0; a < Abc::kSize; ++a) {
+                // zero counts do not change the scores
+                if (cp.counts[i][a] == 0.0) continue;
+                rows[nrows] = weight(j, a);
+                coeffs[nrows++] = cp.counts[i][a];
+            }
+        }
+        Calculate(rows, coeffs, nrows, scores, pc);
+    }
+
+  private:
+    void Init(size_t size) {
+        nstates_ = (size + VECSIZE_FLOAT - 1) / VECSIZE_FLOAT * VECSIZE_FLOAT;
+        weights_ = (float*) malloc_simd_float(wlen_ * Abc::kSizeAny * nstates_ * sizeof(float));
+        bias_ = (float*) malloc_simd_float(nstates_ * sizeof(float));
+        pcs_ = (float*) malloc_simd_float(Abc::kSize * nstates_ * sizeof(float));
+        memset(weights_, 0, wlen_ * Abc::kSizeAny * nstates_ * sizeof(float));
+        memset(pcs_, 0, Abc::kSize * nstates_ * sizeof(float));
+        // padding states never contribute, exp(score - max) underflows to zero
+        for (size_t k = 0; k < nstates_; ++k) bias_[k] = -1e30f;
+    }
+
+    // Subtracts the maximum over all states from each row of weights. This adds the same
+    // value to the scores of all states, which cancels in the posterior probabilities, but
+    // keeps the summed weights of well fitting states small and thus precise in single precision.
+    void CenterRows(size_t size) {
+        for (size_t j = 0; j < wlen_; ++j) {
+            for (size_t a = 0; a < Abc::kSizeAny; ++a) {
+                float* row = weight(j, a);
+                float max = -FLT_MAX;
+                for (size_t k = 0; k < size; ++k) max = MAX(max, row[k]);
+                if (max == -FLT_MAX) continue;
+                for (size_t k = 0; k < size; ++k) row[k] -= max;
+            }
+        }
+    }
+
+    float* weight(size_t j, size_t a) const { return weights_ + (j * Abc::kSizeAny + a) * nstates_; }
+    float* pc(size_t a) const { return pcs_ + a * nstates_; }
+
+    // Sums the coefficient-weighted rows of the window into the state scores,
+    // transforms them into unnormalized posterior probabilities and mixes the pseudocounts
+    void Calculate(const float** rows, const float* coeffs, size_t nrows, float* scores, double* pc_out) const {
+        simd_float vmax = simdf32_set(-FLT_MAX);
+        for (size_t k = 0; k < nstates_ / VECSIZE_FLOAT; ++k) {
+            simd_float score = simdf32_load(bias_ + k * VECSIZE_FLOAT);
+            for (size_t r = 0; r < nrows; ++r)
+                score = simdf32_add(score, simdf32_mul(simdf32_set(coeffs[r]), simdf32_load(rows[r] + k * VECSIZE_FLOAT)));
+            simdf32_store(scores + k * VECSIZE_FLOAT, score);
+            vmax = simdf32_max(vmax, score);
+        }
+        float max = HorizontalMax(vmax);
+
+        // exp(score - max) = 2^((score - max) * log2(e))
+        const simd_float vlog2e = simdf32_set(1.442695041f);
+        const simd_float vmaxs = simdf32_set(max);
+        for (size_t k = 0; k < nstates_; k += VECSIZE_FLOAT) {
+            simd_float x = simdf32_mul(simdf32_sub(simdf32_load(scores + k), vmaxs), vlog2e);
+            simdf32_store(scores + k, simdf32_fpow2(x));
+        }
+
+        for (size_t a = 0; a < Abc::kSize; ++a) {
+            const float* pca = pc(a);
+            simd_float sum = simdf32_setzero();
+            for (size_t k = 0; k < nstates_; k += VECSIZE_FLOAT)
+                sum = simdf32_add(sum, simdf32_mul(simdf32_load(scores + k), simdf32_load(pca + k)));
+            pc_out[a] = HorizontalSum(sum);
+        }
+    }
+
+    static float HorizontalMax(simd_float v) {
+        float __attribute__((aligned(ALIGN_FLOAT))) tmp[VECSIZE_FLOAT];
+        simdf32_store(tmp, v);
+        return simd_hmax(tmp, VECSIZE_FLOAT);
+    }
+
+    static double HorizontalSum(simd_float v) {
+        float __attribute__((aligned(ALIGN_FLOAT))) tmp[VECSIZE_FLOAT];
+        simdf32_store(tmp, v);
+        double sum = 0.0;
+        for (size_t i = 0; i < VECSIZE_FLOAT; ++i) sum += tmp[i];
+        return sum;
+    }
+
+    size_t wlen_;      // size of context window
+    size_t center_;    // index of central column in context window
+    size_t nstates_;   // number of states padded to a multiple of VECSIZE_FLOAT
+    float* weights_;   // context weights [j][a][k]
+    float* bias_;      // bias weights [k]
+    float* pcs_;       // pseudocounts [a][k]
+
+    DISALLOW_COPY_AND_ASSIGN(ContextWeightsSimd);
+};  // class ContextWeightsSimd
+
+}  // namespace cs
+
+#endif  // CS_CONTEXT_WEIGHTS_SIMD_H_
@@ -25,46 +25,30 @@
 namespace cs {
 
 template<class Abc>
-CrfPseudocounts<Abc>::CrfPseudocounts(const Crf<Abc>& crf) : crf_(crf) {}
+CrfPseudocounts<Abc>::CrfPseudocounts(const Crf<Abc>& crf) : crf_(crf), weights_(crf) {}
 
 template<class Abc>
 void CrfPseudocounts<Abc>::AddToSequence(const Sequence<Abc>& seq, Profile<Abc>& p) const {
   assert_eq(seq.length(), p.length());
   LOG(INFO) << "Adding CRF pseudocounts to sequence ...";
 
-  const size_t center = crf_.center();
-  Matrix<double> pp(seq.length(), crf_.size(), 0.0);  // posterior probabilities
   int len = static_cast<int>(seq.length());
 
   // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-  for (int i = 0; i < len; ++i) {
-    double* ppi = &pp[i][0];
-
-    // Calculate posterior probability ppi[k] of state k given sequence window
-    // around position 'i'
-    double max = -DBL_MAX;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = crf_[k].bias_weight +
-        ContextScore(crf_[k].context_weights, seq, i, center);
-      if (ppi[k] > max)
-        max = ppi[k];  // needed for log-sum-exp trick
+#pragma omp parallel
+  {
+    float* scores = (float*) malloc_simd_float(weights_.nstates() * sizeof(float));
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < len; ++i) {
+      // Calculate pseudocount vector P(a|X_i) from the posterior probabilities
+      // of the states given the sequence window around position 'i'
+      double* pc = p[i];
+      weights_.CalculatePseudocounts(seq, i, scores, pc);
+      Normalize(&pc[0], Abc::kSize);
     }
 
-    // Log-sum-exp trick begins here
-    double sum = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k)
-      sum += exp(ppi[k] - max);
-    double tmp = max + log(sum);
-    // Calculate pseudocount vector P(a|X_i)
-    double* pc = p[i];
-    for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = exp(ppi[k] - tmp);
-      for(size_t a = 0; a < Abc::kSize; ++a)
-        pc[a] += ppi[k] * crf_[k].pc[a];
-    }
-    Normalize(&pc[0], Abc::kSize);
+    free(scores);
   }
 }
 
@@ -73,39 +57,23 @@ void CrfPseudocounts<Abc>::AddToProfile(const CountProfile<Abc>& cp, Profile<Abc
   assert_eq(cp.counts.length(), p.length());
   LOG(INFO) << "Adding library pseudocounts to profile ...";
 
-  const size_t center = crf_.center();
-  Matrix<double> pp(cp.counts.length(), crf_.size(), 0.0);  // posterior probs
   int len = static_cast<int>(cp.length());
 
   // Calculate and add pseudocounts for each sequence window X_i separately
-  #pragma omp parallel for schedule(static)
-  for (int i = 0; i < len; ++i) {
-    double* ppi = &pp[i][0];
-
-    // Calculate posterior probability ppi[k] of state k given sequence window
-    // around position 'i'
-    double max = -DBL_MAX;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = crf_[k].bias_weight +
-        ContextScore(crf_[k].context_weights, cp, i, center);
-      if (ppi[k] > max)
-        max = ppi[k];  // needed for log-sum-exp trick
+#pragma omp parallel
+  {
+    float* scores = (float*) malloc_simd_float(weights_.nstates() * sizeof(float));
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < len; ++i) {
+      // Calculate pseudocount vector P(a|X_i) from the posterior probabilities
+      // of the states given the count profile window around position 'i'
+      double* pc = p[i];
+      weights_.CalculatePseudocounts(cp, i, scores, pc);
+      Normalize(&pc[0], Abc::kSize);
     }
 
-     // Log-sum-exp trick begins here
-    double sum = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k)
-      sum += exp(ppi[k] - max);
-    double tmp = max + log(sum);
-    // Calculate pseudocount vector P(a|X_i)
-    double* pc = p[i];
-    for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = exp(ppi[k] - tmp);
-      for(size_t a = 0; a < Abc::kSize; ++a)
-        pc[a] += ppi[k] * crf_[k].pc[a];
-    }
-    Normalize(&pc[0], Abc::kSize);  
+    free(scores);
   }
 }
 
@@ -26,6 +26,7 @@
 #include "pseudocounts-inl.h"
 #include "sequence-inl.h"
 #include "crf-inl.h"
+#include "context_weights_simd.h"
 
 namespace cs {
 
@@ -44,6 +45,8 @@ class CrfPseudocounts : public Pseudocounts<Abc> {
  private:
   // CRF with context weights and pseudocount emission weights.
   const Crf<Abc>& crf_;
+  // Single precision weights of the CRF for SIMD evaluation.
+  const ContextWeightsSimd<Abc> weights_;
 
   DISALLOW_COPY_AND_ASSIGN(CrfPseudocounts);
 };  // CrfPseudocounts
@@ -42,6 +42,7 @@
 #endif
 
 #include <sstream>
+#include <sys/time.h>
 
 using namespace GetOpt;
 using std::string;
@@ -126,9 +127,15 @@ namespace cs {
   template<class Abc>
   class CSTranslateApp : public Application {
   public:
+    CSTranslateApp() : as_nstates_(0), as_probs_(NULL), as_priors_(NULL) { }
+
+    virtual ~CSTranslateApp() {
+      free(as_probs_);
+      free(as_priors_);
+    }
+
     // Runs the csbuild application.
     virtual int Run() {
-      SetupEmissions();
       SetupPseudocountEngine();
       SetupAbstractStateEngine();
 
@@ -249,110 +256,88 @@ namespace cs {
                               const_cast<char *>(input_index_file.c_str()), isCa3m);
         input.ensureLinearAccess();
 
-        //prepare output ffindex cs219 database
-        std::string output_data_file = opts_.outfile + ".ffdata";
-        std::string output_index_file = opts_.outfile + ".ffindex";
-
-        FILE *output_data_fh = fopen(output_data_file.c_str(), "w");
-        FILE *output_index_fh = fopen(output_index_file.c_str(), "w");
-
-        if (output_data_fh == NULL) {
-          LOG(ERROR) << "Could not open ffindex output data file! (" << output_data_file << ")!" << std::endl;
-          exit(1);
-        }
-
-        if (output_index_fh == NULL) {
-          LOG(ERROR) << "Could not open ffindex output index file! (" << output_index_file << ")!" << std::endl;
-          exit(1);
-        }
-
-        size_t output_offset = 0;
-
-        size_t input_range_start = 0;
-        size_t input_range_end = input.db_index->n_entries;
+        const size_t n_entries = input.db_index->n_entries;
+        const size_t progress_step = MAX<size_t>(1000, n_entries / 100);
+        size_t translated = 0;
 
-        // Foreach entry
-        #pragma omp parallel for shared(input, sequence_db, header_db)
-        for (size_t entry_index = input_range_start; entry_index < input_range_end; entry_index++) {
-          ffindex_entry_t *entry = ffindex_get_entry_by_index(input.db_index, entry_index);
+        // prepare output ffindex cs219 database: every thread writes its own shard, merged at the end
+        int shards = 1;
+#ifdef OPENMP
+        shards = omp_get_max_threads();
+#endif
+        FFindexShardedWriter output(opts_.outfile, shards);
 
-          if (entry == NULL) {
-            LOG(WARNING) << "Could not open entry " << entry_index << " from input ffindex!" << std::endl;
-            continue;
-          }
+        timeval start;
+        gettimeofday(&start, NULL);
 
-          if (opts_.verbose) {
-            fprintf(out_, "Processing entry: %s\n", entry->name);
-          }
+        #pragma omp parallel num_threads(shards) shared(input, sequence_db, header_db, output)
+        {
+          int thread = 0;
+#ifdef OPENMP
+          thread = omp_get_thread_num();
+#endif
 
           std::ostringstream a3m_buffer;
           std::string a3m_string;
-          FILE *inf;
-          if (isCa3m) {
-            char *data = ffindex_get_data_by_entry(input.db_data, entry);
-
-            compressed_a3m::extract_a3m(data, entry->length,
-                                        sequence_db->db_index, sequence_db->db_data,
-                                        header_db->db_index, header_db->db_data,
-                                        &a3m_buffer);
+          std::string out_string;
 
-            a3m_string = a3m_buffer.str();
-
-            inf = fmemopen(static_cast<void *>(const_cast<char *>(a3m_string.c_str())), a3m_string.length(), "r");
-          } else {
-            inf = ffindex_fopen_by_entry(input.db_data, entry);
-          }
+          // Foreach entry; entries differ a lot in size, so they are handed out dynamically
+          #pragma omp for schedule(dynamic, 16)
+          for (size_t entry_index = 0; entry_index < n_entries; entry_index++) {
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(input.db_index, entry_index);
 
-          if (inf == NULL) {
-            LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
-            continue;
-          }
-
-          string header;
-          CountProfile<Abc> profile;  // input profile we want to translate
-          try {
-            ReadProfile(inf, header, profile);
-          } catch (const Exception &e) {
-            fprintf(out_, "Could not read entry: %s, Message: %s\n", entry->name, e.what());
-            continue;
-          }
-
-          size_t profile_counts_length = profile.counts.length();
+            if (entry == NULL) {
+              LOG(WARNING) << "Could not open entry " << entry_index << " from input ffindex!" << std::endl;
+              continue;
+            }
 
-          CountProfile<AS219> as_profile(profile_counts_length);  // output profile
-          Translate(profile, as_profile);
+            string header;
+            CountProfile<Abc> profile;  // input profile we want to translate
+            try {
+              // parse the entry directly from the mapped (or extracted ca3m) data
+              if (isCa3m) {
+                a3m_buffer.str("");
+                compressed_a3m::extract_a3m(input.getData(entry), entry->length,
+                                            sequence_db->db_index, sequence_db->db_data,
+                                            header_db->db_index, header_db->db_data,
+                                            &a3m_buffer);
+                a3m_string = a3m_buffer.str();
+                ReadProfile(a3m_string.c_str(), a3m_string.length(), header, profile);
+              } else {
+                ReadProfile(input.getData(entry), entry->length, header, profile);
+              }
+            } catch (const Exception &e) {
+              fprintf(out_, "Could not read entry: %s, Message: %s\n", entry->name, e.what());
+              continue;
+            }
 
-          // Prepare abstract sequence in AS219 format
-          Sequence<AS219> as_seq(profile_counts_length);
-          as_seq.set_header(header);
-          BuildSequence(as_profile, profile_counts_length, as_seq);
+            if (opts_.outformat == "seq") {
+              TranslateToSequence(profile, out_string);
+            } else {
+              CountProfile<AS219> as_profile(profile.counts.length());  // output profile
+              Translate(profile, as_profile);
 
-          std::stringstream out_buffer;
+              std::stringstream out_buffer;
+              WriteStateProfile(as_profile, out_buffer);
+              out_string = out_buffer.str();
+            }
 
-          if (opts_.outformat == "seq") {
-            WriteStateSequence(as_seq, out_buffer);
-          } else {
-            WriteStateProfile(as_profile, out_buffer);
-          }
+            output.insert(thread, out_string, entry->name);
 
-          std::string out_string = out_buffer.str();
-          #pragma omp critical
-          {
-            ffindex_insert_memory(output_data_fh, output_index_fh, &output_offset,
-                                  const_cast<char *>(out_string.c_str()),
-                                  out_string.size(), entry->name);
+            size_t done;
+            #pragma omp atomic capture
+            done = ++translated;
+            if (opts_.verbose && done % progress_step == 0) {
+              PrintProgress(done, n_entries, start);
+            }
           }
-
-          // FIXME: we are leaking inf, but if we fclose we get weird crashes
-          //fclose(inf);
-
         }
 
-        fclose(output_index_fh);
-        fclose(output_data_fh);
-
+        output.merge();
 
-        ffsort_index(output_index_file.c_str());
+        if (opts_.verbose) {
+          PrintProgress(translated, n_entries, start);
+        }
 
         if (isCa3m) {
           delete sequence_db;
@@ -428,6 +413,15 @@ namespace cs {
       fputs("Usage: cstranslate -i <infile> [options]\n", out_);
     };
 
+    // Sets up the engines for translating entries in-process (e.g. by hhsuitedb)
+    // with the given options instead of the command line
+    void Init(const CSTranslateAppOptions &opts, FILE *out) {
+      opts_ = opts;
+      out_ = out;
+      SetupPseudocountEngine();
+      SetupAbstractStateEngine();
+    };
+
     // Setup pseudocount engine
     void SetupPseudocountEngine() {
       if (opts_.modelfile.empty())
@@ -498,11 +492,22 @@ namespace cs {
 
       TransformToLog(*as_lib_);
       fclose(fin);
-    };
 
-    void SetupEmissions() {
-      emission_.reset(new Emission<Abc>(1, this->opts_.weight_as, 1.0));
-    }
+      // State-major copy of the log probabilities of the abstract states for scoring all states
+      // of a column with SIMD instructions, as_probs_[a * as_nstates_ + k]. The padding states
+      // get the lowest possible prior and are never chosen.
+      as_nstates_ = (as_lib_->size() + VECSIZE_DOUBLE - 1) / VECSIZE_DOUBLE * VECSIZE_DOUBLE;
+      free(as_probs_);
+      free(as_priors_);
+      as_probs_ = (double *) malloc_simd_double(Abc::kSize * as_nstates_ * sizeof(double));
+      as_priors_ = (double *) malloc_simd_double(as_nstates_ * sizeof(double));
+      for (size_t k = 0; k < as_nstates_; ++k) {
+        as_priors_[k] = k < as_lib_->size() ? (*as_lib_)[k].prior : -DBL_MAX;
+        for (size_t a = 0; a < Abc::kSize; ++a) {
+          as_probs_[a * as_nstates_ + k] = k < as_lib_->size() ? (*as_lib_)[k].probs[0][a] : 0.0;
+        }
+      }
+    };
 
     // Writes abstract state sequence to outfile
     void WriteStateSequence(const Sequence<AS219> &seq, string outfile, bool append = false) const {
@@ -551,7 +556,7 @@ namespace cs {
         else header = profile.name;
 
         if (pc_) {
-          if (opts_.verbose)
+          if (opts_.verbose && !opts_.ffindex)
             fprintf(out_, "Adding cs-pseudocounts (admix=%.2f) ...\n", opts_.pc_admix);
           CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
           profile.counts = pc_->AddTo(profile, admix);
@@ -564,7 +569,7 @@ namespace cs {
         profile = CountProfile<Abc>(seq);
 
         if (pc_) {
-          if (opts_.verbose)
+          if (opts_.verbose && !opts_.ffindex)
             fprintf(out_, "Adding cs-pseudocounts (admix=%.2f) ...\n", opts_.pc_admix);
           ConstantAdmix admix(opts_.pc_admix);
           profile.counts = pc_->AddTo(seq, admix);
@@ -573,31 +578,71 @@ namespace cs {
       } else {  // build profile from alignment
         AlignmentFormat f = AlignmentFormatFromString(opts_.informat);
         Alignment<Abc> ali(fin, f);
-        header = ali.name();
+        BuildProfile(ali, f, header, profile);
+      }
+      fclose(fin);  // close input file
+    };
 
-        if (f == FASTA_ALIGNMENT) {
-          if (opts_.match_assign == CSTranslateAppOptions::kAssignMatchColsByQuery)
-            ali.AssignMatchColumnsBySequence(0);
-          else
-            ali.AssignMatchColumnsByGapRule(opts_.match_assign);
+    // Reads the profile from an input entry in memory, e.g. of an ffindex database.
+    // FASTA, A2M and A3M alignments are parsed directly from the buffer.
+    void ReadProfile(const char *data, size_t length, string &header, CountProfile<Abc> &profile) {
+      if (opts_.informat != "prf" && opts_.informat != "seq") {
+        AlignmentFormat f = AlignmentFormatFromString(opts_.informat);
+        if (f == FASTA_ALIGNMENT || f == A2M_ALIGNMENT || f == A3M_ALIGNMENT) {
+          Alignment<Abc> ali(data, length, f);
+          BuildProfile(ali, f, header, profile);
+          return;
         }
-        profile = CountProfile<Abc>(ali);
+      }
 
-        if (pc_) {
-          if (opts_.verbose)
-            fprintf(out_, "Adding cs-pseudocounts (admix=%.2f) ...\n", opts_.pc_admix);
-          CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
-          profile.counts = pc_->AddTo(profile, admix);
-          Normalize(profile.counts, profile.neff);
-        }
+      FILE *fin = fmemopen(static_cast<void *>(const_cast<char *>(data)), length, "r");
+      if (!fin)
+        throw Exception("Unable to read input entry!");
+      ReadProfile(fin, header, profile);
+    };
+
+    // Builds the count profile of the alignment and adds pseudocounts
+    void BuildProfile(Alignment<Abc> &ali, AlignmentFormat f, string &header, CountProfile<Abc> &profile) {
+      header = ali.name();
+
+      if (f == FASTA_ALIGNMENT) {
+        if (opts_.match_assign == CSTranslateAppOptions::kAssignMatchColsByQuery)
+          ali.AssignMatchColumnsBySequence(0);
+        else
+          ali.AssignMatchColumnsByGapRule(opts_.match_assign);
+      }
+      profile = CountProfile<Abc>(ali);
+
+      if (pc_) {
+        if (opts_.verbose && !opts_.ffindex)
+          fprintf(out_, "Adding cs-pseudocounts (admix=%.2f) ...\n", opts_.pc_admix);
+        CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
+        profile.counts = pc_->AddTo(profile, admix);
+        Normalize(profile.counts, profile.neff);
       }
-      fclose(fin);  // close input file
     };
 
+    // Calculates the posterior probabilities of the abstract states for each column,
+    // as CalculatePosteriorProbs with an Emission of window length one and weight weight_as
     void Translate(CountProfile<Abc> &profile, CountProfile<cs::AS219> &as_profile) {
+      double *scores = (double *) malloc_simd_double(as_nstates_ * sizeof(double));
       for (size_t i = 0; i < as_profile.length(); ++i) {
-        CalculatePosteriorProbs(*as_lib_, *emission_, profile, i, as_profile.counts[i]);
+        ScoreStates(profile, i, scores);
+
+        // Log-sum-exp trick
+        double max = -FLT_MAX;
+        for (size_t k = 0; k < AS219::kSize; ++k) {
+          if (scores[k] > max)
+            max = scores[k];
+        }
+        double sum = 0.0;
+        for (size_t k = 0; k < AS219::kSize; ++k)
+          sum += exp(scores[k] - max);
+        double tmp = max + log(sum);
+        for (size_t k = 0; k < AS219::kSize; ++k)
+          as_profile.counts[i][k] = exp(scores[k] - tmp);
       }
+      free(scores);
       as_profile.name = GetBasename(opts_.infile, false);
       as_profile.name = as_profile.name.substr(0, as_profile.name.length() - 1);
     };
@@ -619,6 +664,47 @@ namespace cs {
       }
     };
 
+    // Translates the profile directly into the abstract state sequence with one state
+    // character per column. The state with the maximal posterior probability is the
+    // state with the maximal score, so the posterior probabilities are not needed.
+    void TranslateToSequence(const CountProfile<Abc> &profile, std::string &as_seq) {
+      double *scores = (double *) malloc_simd_double(as_nstates_ * sizeof(double));
+      as_seq.resize(profile.counts.length());
+      for (size_t i = 0; i < profile.counts.length(); ++i) {
+        ScoreStates(profile, i, scores);
+        size_t k_max = 0;
+        for (size_t k = 1; k < AS219::kSize; ++k) {
+          if (scores[k] > scores[k_max])
+            k_max = k;
+        }
+        as_seq[i] = (char) k_max;
+      }
+      free(scores);
+    };
+
+    // Calculates the scores of all abstract states for column i of the profile, the log
+    // prior plus weight_as times the log probability of the column counts under the state.
+    void ScoreStates(const CountProfile<Abc> &profile, size_t i, double *scores) const {
+      const simd_double weight = simdf64_set(opts_.weight_as);
+      for (size_t k = 0; k < as_nstates_; k += VECSIZE_DOUBLE) {
+        simd_double sum = simdf64_setzero();
+        for (size_t a = 0; a < Abc::kSize; ++a) {
+          sum = simdf64_add(sum, simdf64_mul(simdf64_set(profile.counts[i][a]),
+                                             simdf64_load(as_probs_ + a * as_nstates_ + k)));
+        }
+        simdf64_store(scores + k, simdf64_add(simdf64_load(as_priors_ + k), simdf64_mul(weight, sum)));
+      }
+    };
+
+    // Prints the number of translated entries and the throughput since start
+    void PrintProgress(size_t done, size_t total, const timeval &start) const {
+      timeval now;
+      gettimeofday(&now, NULL);
+      double seconds = (now.tv_sec - start.tv_sec) + 1E-6 * (now.tv_usec - start.tv_usec);
+      fprintf(out_, "Translated %zu of %zu entries (%.1f entries/s)\n", done, total,
+              seconds > 0.0 ? done / seconds : 0.0);
+    };
+
     // Parameter wrapper
     CSTranslateAppOptions opts_;
     // Profile library with abstract states
@@ -629,8 +715,12 @@ namespace cs {
     scoped_ptr<Crf<Abc> > pc_crf_;
     // Pseudocount engine
     scoped_ptr<Pseudocounts<Abc> > pc_;
-    // Emissions
-    scoped_ptr<Emission<Abc> > emission_;
+    // Number of abstract states padded to a multiple of VECSIZE_DOUBLE
+    size_t as_nstates_;
+    // Log probabilities of the abstract states [a][k]
+    double *as_probs_;
+    // Log priors of the abstract states [k]
+    double *as_priors_;
   };  // class CSTranslateApp
 
 }  // namespace cs
@@ -59,7 +59,6 @@ namespace cs {
         if (MPQ_rank == MPQ_MASTER) {
           MPQ_Master(1);
         } else {
-          this->SetupEmissions();
           this->SetupPseudocountEngine();
           this->SetupAbstractStateEngine();
 
@@ -152,61 +151,42 @@ namespace cs {
           fprintf(this->log_file, "Processing entry: %s\n", entry->name);
         }
 
-        std::ostringstream a3m_buffer;
-        std::string a3m_string;
-        FILE *inf;
-        if (this->opts_.informat == "ca3m") {
-          char *entry_data = ffindex_get_data_by_entry(this->input_data, entry);
-
-          compressed_a3m::extract_a3m(entry_data, entry->length,
-                                      this->input_sequence_index, this->input_sequence_data,
-                                      this->input_header_index, this->input_header_data,
-                                      &a3m_buffer);
-
-          a3m_string = a3m_buffer.str();
-
-          inf = fmemopen(static_cast<void *>(const_cast<char *>(a3m_string.c_str())), a3m_string.length(), "r");
-        } else {
-          inf = ffindex_fopen_by_entry(this->input_data, entry);
-        }
-
-        if (inf == NULL) {
-          fprintf(this->log_file, "Could not open input entry (%s)!\n", entry->name);
-          continue;
-        }
-
         string header;
         CountProfile<Abc> profile;  // input profile we want to translate
         try {
-          this->ReadProfile(inf, header, profile);
+          if (this->opts_.informat == "ca3m") {
+            std::ostringstream a3m_buffer;
+            char *entry_data = ffindex_get_data_by_entry(this->input_data, entry);
+
+            compressed_a3m::extract_a3m(entry_data, entry->length,
+                                        this->input_sequence_index, this->input_sequence_data,
+                                        this->input_header_index, this->input_header_data,
+                                        &a3m_buffer);
+
+            std::string a3m_string = a3m_buffer.str();
+            this->ReadProfile(a3m_string.c_str(), a3m_string.length(), header, profile);
+          } else {
+            this->ReadProfile(ffindex_get_data_by_entry(this->input_data, entry), entry->length, header, profile);
+          }
         } catch (const Exception &e) {
           fprintf(this->log_file, "Could not read entry: %s, Message: %s\n", entry->name, e.what());
           continue;
         }
 
-        size_t profile_counts_length = profile.counts.length();
-
-        CountProfile<AS219> as_profile(profile_counts_length);  // output profile
-        this->Translate(profile, as_profile);
-
-        // Prepare abstract sequence in AS219 format
-        Sequence<AS219> as_seq(profile_counts_length);
-        as_seq.set_header(header);
-        this->BuildSequence(as_profile, profile_counts_length, as_seq);
-
-        std::stringstream out_buffer;
+        std::string out_string;
         if (this->opts_.outformat == "seq") {
-          this->WriteStateSequence(as_seq, out_buffer);
+          this->TranslateToSequence(profile, out_string);
         } else {
+          CountProfile<AS219> as_profile(profile.counts.length());  // output profile
+          this->Translate(profile, as_profile);
+
+          std::stringstream out_buffer;
           this->WriteStateProfile(as_profile, out_buffer);
+          out_string = out_buffer.str();
         }
-        std::string out_string = out_buffer.str();
         ffindex_insert_memory(this->data_file_out, this->index_file_out,
                               &(this->offset), const_cast<char *>(out_string.c_str()), out_string.size(), entry->name);
 
-        // FIXME: we are leaking inf, but if we fclose we get weird crashes
-        //fclose(inf);
-
         if (entry_index % 1000 == 0) {
           fflush(this->data_file_out);
           fflush(this->index_file_out);
@@ -56,6 +56,18 @@ inline char* fgetline(char* str, int maxlen, FILE* file) {
   return(str);
 }
 
+// Reads the line that starts at ptr in the memory range [ptr,end) into str like
+// fgetline, i.e. without the newline and trailing control characters. Returns
+// the start of the next line.
+inline const char* memgetline(const char* ptr, const char* end, std::string& str) {
+  const char* eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+  const char* next = eol ? eol + 1 : end;
+  if (!eol) eol = end;
+  while (eol > ptr && *(eol - 1) < 32) --eol;
+  str.assign(ptr, eol);
+  return next;
+}
+
 // Returns leftmost integer in ptr and sets the pointer to first char after
 // the integer. If no integer is found, returns INT_MIN and sets ptr to NULL
 inline int strtoi(const char*& ptr) {
@@ -28,30 +28,30 @@ template<class Abc>
 LibraryPseudocounts<Abc>::LibraryPseudocounts(const ContextLibrary<Abc>& lib,
                                               double weight_center,
                                               double weight_decay)
-        : lib_(lib), emission_(lib.wlen(), weight_center, weight_decay) {}
+        : lib_(lib), weights_(lib, weight_center, weight_decay) {}
 
 template<class Abc>
 void LibraryPseudocounts<Abc>::AddToSequence(const Sequence<Abc>& seq, Profile<Abc>& p) const {
     assert_eq(seq.length(), p.length());
     LOG(INFO) << "Adding library pseudocounts to sequence ...";
 
-    Matrix<double> pp(seq.length(), lib_.size(), 0.0);  // posterior probabilities
     int len = static_cast<int>(seq.length());
 
     // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-    for (int i = 0; i < len; ++i) {
-        double* ppi = &pp[i][0];
-        // Calculate posterior probability of state k given sequence window around 'i'
-        CalculatePosteriorProbs(lib_, emission_, seq, i, ppi);
-        // Calculate pseudocount vector P(a|X_i)
-        double* pc = p[i];
-        for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-        for (size_t k = 0; k < lib_.size(); ++k) {
-            for(size_t a = 0; a < Abc::kSize; ++a)
-                pc[a] += ppi[k] * lib_[k].pc[a];
+#pragma omp parallel
+    {
+        float* scores = (float*) malloc_simd_float(weights_.nstates() * sizeof(float));
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < len; ++i) {
+            // Calculate pseudocount vector P(a|X_i) from the posterior probabilities
+            // of the states given the sequence window around 'i'
+            double* pc = p[i];
+            weights_.CalculatePseudocounts(seq, i, scores, pc);
+            Normalize(&pc[0], Abc::kSize);
         }
-        Normalize(&pc[0], Abc::kSize);
+
+        free(scores);
     }
 }
 
@@ -60,23 +60,23 @@ void LibraryPseudocounts<Abc>::AddToProfile(const CountProfile<Abc>& cp, Profile
     assert_eq(cp.counts.length(), p.length());
     LOG(INFO) << "Adding library pseudocounts to profile ...";
 
-    Matrix<double> pp(cp.counts.length(), lib_.size(), 0.0);  // posterior probs
     int len = static_cast<int>(cp.length());
 
     // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-    for (int i = 0; i < len; ++i) {
-        double* ppi = &pp[i][0];
-        // Calculate posterior probability of state k given sequence window around 'i'
-        CalculatePosteriorProbs(lib_, emission_, cp, i, ppi);
-        // Calculate pseudocount vector P(a|X_i)
-        double* pc = p[i];
-        for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-        for (size_t k = 0; k < lib_.size(); ++k) {
-            for(size_t a = 0; a < Abc::kSize; ++a)
-                pc[a] += ppi[k] * lib_[k].pc[a];
+#pragma omp parallel
+    {
+        float* scores = (float*) malloc_simd_float(weights_.nstates() * sizeof(float));
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < len; ++i) {
+            // Calculate pseudocount vector P(a|X_i) from the posterior probabilities
+            // of the states given the count profile window around 'i'
+            double* pc = p[i];
+            weights_.CalculatePseudocounts(cp, i, scores, pc);
+            Normalize(&pc[0], Abc::kSize);
         }
-        Normalize(&pc[0], Abc::kSize);
+
+        free(scores);
     }
 }
 
@@ -26,6 +26,7 @@
 #include "pseudocounts-inl.h"
 #include "sequence-inl.h"
 #include "context_library-inl.h"
+#include "context_weights_simd.h"
 
 namespace cs {
 
@@ -45,8 +46,8 @@ class LibraryPseudocounts : public Pseudocounts<Abc> {
   private:
     // Profile library with context profiles.
     const ContextLibrary<Abc>& lib_;
-    // Needed to compute emission probabilities of context profiles.
-    const Emission<Abc> emission_;
+    // Single precision weights of the library for SIMD evaluation.
+    const ContextWeightsSimd<Abc> weights_;
 
     DISALLOW_COPY_AND_ASSIGN(LibraryPseudocounts);
 };  // LibraryPseudocounts
@@ -0,0 +1,128 @@
+/*
+ * ffdata_compress.cpp
+ *
+ * Compress the data file of an ffindex database into independently
+ * compressed blocks (see blockcompresseddata.h), or restore the plain data file.
+ * The index file of the database is not changed and stays valid for both.
+ */
+
+#include "blockcompresseddata.h"
+
+extern "C" {
+#include <ffindex.h>
+}
+
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <sys/mman.h>
+
+void usage() {
+  std::cout
+      << "USAGE: ffdata_compress [-b block_size] [-l level] -i input.ffdata -o output.ffdata" << std::endl
+      << "       ffdata_compress -d -i input.ffdata -o output.ffdata" << std::endl
+      << " -b  uncompressed size of the blocks in KB (default=64)" << std::endl
+      << " -l  zlib compression level 1-9 (default=9)" << std::endl
+      << " -d  restore the plain data file from a block-compressed data file" << std::endl
+      << "The ffindex index file is valid for the plain and the compressed data file." << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool iflag = false;
+  bool oflag = false;
+  bool decompress = false;
+  size_t block_size = 64 * 1024;
+  int level = 9;
+
+  std::string input;
+  std::string output;
+
+  int c;
+  while ((c = getopt(argc, argv, "i:o:b:l:dh")) != -1) {
+    switch (c) {
+      case 'i':
+        iflag = 1;
+        input = optarg;
+        break;
+      case 'o':
+        oflag = 1;
+        output = optarg;
+        break;
+      case 'b':
+        block_size = (size_t) atoi(optarg) * 1024;
+        break;
+      case 'l':
+        level = atoi(optarg);
+        break;
+      case 'd':
+        decompress = true;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (!iflag || !oflag) {
+    usage();
+    exit(0);
+  }
+
+  if (block_size == 0 || level < 1 || level > 9) {
+    std::cerr << "ERROR: Block size must be positive and level between 1 and 9!" << std::endl;
+    return 1;
+  }
+
+  FILE* in_fh = fopen(input.c_str(), "r");
+  if (in_fh == NULL) {
+    std::cerr << "ERROR: Could not open input file " << input << "!" << std::endl;
+    return 1;
+  }
+  size_t size = 0;
+  char* data = ffindex_mmap_data(in_fh, &size);
+  if (size > 0 && (data == NULL || data == MAP_FAILED)) {
+    std::cerr << "ERROR: Could not map input file " << input << "!" << std::endl;
+    return 1;
+  }
+
+  bool compressed = BlockCompressedData::isBlockCompressed(data, size);
+  if (compressed != decompress) {
+    std::cerr << "ERROR: " << input << (compressed ? " is already" : " is not") << " block-compressed!" << std::endl;
+    return 1;
+  }
+
+  FILE* out_fh = fopen(output.c_str(), "w");
+  if (out_fh == NULL) {
+    std::cerr << "ERROR: Could not open output file " << output << "!" << std::endl;
+    return 1;
+  }
+
+  bool ok;
+  if (decompress) {
+    BlockCompressedData blocks(data, size);
+    ok = blocks.decompress(out_fh);
+  }
+  else {
+    ok = BlockCompressedData::compress(data, size, out_fh, block_size, level);
+  }
+
+  if (fclose(out_fh) != 0 || !ok) {
+    std::cerr << "ERROR: Could not write output file " << output << "!" << std::endl;
+    return 1;
+  }
+
+  munmap(data, size);
+  fclose(in_fh);
+  return 0;
+}
@@ -1,8 +1,15 @@
 #include "ffindexdatabase.h"
 #include "hhutil.h"
 #include <cstring>
+#include <sstream>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef OPENMP
+#include <omp.h>
+#endif
 
 FFindexDatabase::FFindexDatabase(const char* data_filename, const char* index_filename, bool isCompressed)
     : data_filename(strdup(data_filename)), isCompressed(isCompressed) {
@@ -11,14 +18,21 @@ FFindexDatabase::FFindexDatabase(const char* data_filename, const char* index_fi
         OpenFileError(data_filename, __FILE__, __LINE__, __func__);
     }
 
-    FILE* db_index_fh = fopen(index_filename, "r");
-    if (db_index_fh == NULL) {
-        OpenFileError(index_filename, __FILE__, __LINE__, __func__);
-    }
+    // Map an up-to-date binary index (see ffindex_binary_index) instead of parsing the text index
+    binary_index_size = 0;
+    db_index = ffindex_index_mmap_binary(index_filename, &binary_index_size);
+    if (db_index == NULL) {
+        binary_index_size = 0;
+
+        FILE* db_index_fh = fopen(index_filename, "r");
+        if (db_index_fh == NULL) {
+            OpenFileError(index_filename, __FILE__, __LINE__, __func__);
+        }
 
-    size_t ca3m_data_size = CountLinesInFile(index_filename);
-    db_index = ffindex_index_parse(db_index_fh, ca3m_data_size);
-    fclose(db_index_fh);
+        size_t ca3m_data_size = CountLinesInFile(index_filename);
+        db_index = ffindex_index_parse(db_index_fh, ca3m_data_size);
+        fclose(db_index_fh);
+    }
 
     if (db_index == NULL) {
         HH_LOG(WARNING) << "In " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
@@ -26,15 +40,265 @@ FFindexDatabase::FFindexDatabase(const char* data_filename, const char* index_fi
     }
 
     db_data = ffindex_mmap_data(db_data_fh, &data_size);
+
+    blocks = NULL;
+    if (BlockCompressedData::isBlockCompressed(db_data, data_size)) {
+        blocks = new BlockCompressedData(db_data, data_size);
+    }
+}
+
+char* FFindexDatabase::getData(ffindex_entry_t* entry) {
+    if (blocks != NULL) {
+        return blocks->get(entry->offset, entry->length);
+    }
+    return ffindex_get_data_by_entry(db_data, entry);
+}
+
+void FFindexDatabase::getStoredRange(ffindex_entry_t* entry, const char*& data, size_t& length) {
+    if (blocks != NULL) {
+        blocks->getStoredRange(entry->offset, entry->length, data, length);
+    } else {
+        data = ffindex_get_data_by_entry(db_data, entry);
+        length = entry->length;
+    }
 }
 
 void FFindexDatabase::ensureLinearAccess() {
     std::sort(db_index->entries, db_index->entries + db_index->n_entries, compareEntryByOffset());
 }
 
+void FFindexDatabase::adviseHugePages() {
+    advise_huge_pages(db_data, data_size);
+}
+
 FFindexDatabase::~FFindexDatabase() {
     free(data_filename);
+    delete blocks;
     munmap(db_data, data_size);
-    free(db_index);
+    if (binary_index_size > 0) {
+        ffindex_index_munmap_binary(db_index, binary_index_size);
+    } else {
+        free(db_index);
+    }
     fclose(db_data_fh);
 }
+
+FFindexShardedWriter::FFindexShardedWriter(const std::string& base, const int shards, const bool append)
+    : base(base), append(append), data_fh(shards), index_fh(shards), offsets(shards, 0), n_entries(0) {
+    const std::string shard_base = append ? base + ".delta" : base;
+    for (int s = 0; s < shards; s++) {
+        std::stringstream data_filename;
+        std::stringstream index_filename;
+        data_filename << shard_base << ".ffdata." << s;
+        index_filename << shard_base << ".ffindex." << s;
+
+        data_fh[s] = fopen(data_filename.str().c_str(), "w");
+        index_fh[s] = fopen(index_filename.str().c_str(), "w");
+        if (data_fh[s] == NULL) {
+            OpenFileError(data_filename.str().c_str(), __FILE__, __LINE__, __func__);
+        }
+        if (index_fh[s] == NULL) {
+            OpenFileError(index_filename.str().c_str(), __FILE__, __LINE__, __func__);
+        }
+    }
+}
+
+void FFindexShardedWriter::insert(const int shard, const std::string& data, const char* name) {
+    ffindex_insert_memory(data_fh[shard], index_fh[shard], &offsets[shard],
+                          const_cast<char*>(data.c_str()), data.size(), const_cast<char*>(name));
+    #pragma omp atomic
+    n_entries++;
+}
+
+void FFindexShardedWriter::merge(const bool binary_index, const std::set<std::string>& replaced) {
+    for (size_t s = 0; s < data_fh.size(); s++) {
+        fclose(data_fh[s]);
+        fclose(index_fh[s]);
+    }
+
+    const std::string merged_base = append ? base + ".delta" : base;
+    std::string data_filename = merged_base + ".ffdata";
+    std::string index_filename = merged_base + ".ffindex";
+    ffmerge_splits(data_filename.c_str(), index_filename.c_str(), 0, data_fh.size() - 1, true);
+
+    if (append) {
+        AppendFFindexDatabase(base, merged_base, binary_index, replaced);
+        remove(data_filename.c_str());
+        remove(index_filename.c_str());
+    }
+    else if (binary_index) {
+        WriteFFindexBinaryIndex(index_filename);
+    }
+}
+
+void ForEachEntryParallel(FFindexDatabase& reader, const int threads, FFindexEntryProcessor& processor) {
+    // read the entries in the order of the data file
+    reader.ensureLinearAccess();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int thread = 0;
+#ifdef OPENMP
+        thread = omp_get_thread_num();
+#endif
+        processor.beginThread(thread);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (size_t i = 0; i < reader.db_index->n_entries; i++) {
+            ffindex_entry_t* entry = ffindex_get_entry_by_index(reader.db_index, i);
+            char* data = reader.getData(entry);
+            if (data == NULL || entry->length <= 1) {
+                HH_LOG(WARNING) << "Skipping empty or unreadable entry " << entry->name << "!" << std::endl;
+                continue;
+            }
+            processor.process(thread, entry, data);
+        }
+
+        processor.endThread(thread);
+    }
+}
+
+// Size of a file, exits if it cannot be read
+static size_t FileSize(const std::string& filename) {
+    struct stat sb;
+    if (stat(filename.c_str(), &sb) < 0)
+        OpenFileError(filename.c_str(), __FILE__, __LINE__, __func__);
+    return sb.st_size;
+}
+
+void WriteFFindexBinaryIndex(const std::string& index_filename) {
+    FILE* index_fh = fopen(index_filename.c_str(), "r");
+    if (index_fh == NULL)
+        OpenFileError(index_filename.c_str(), __FILE__, __LINE__, __func__);
+
+    ffindex_index_t* index = ffindex_index_parse(index_fh, CountLinesInFile(index_filename.c_str()));
+    fclose(index_fh);
+    if (index == NULL) {
+        HH_LOG(ERROR) << "Could not parse index " << index_filename << "!" << std::endl;
+        exit(1);
+    }
+
+    if (ffindex_write_binary_index(index, index_filename.c_str()) != EXIT_SUCCESS) {
+        HH_LOG(ERROR) << "Could not write binary index of " << index_filename << "!" << std::endl;
+        exit(1);
+    }
+
+    munmap(index->index_data, index->index_data_size);
+    free(index);
+}
+
+void AppendFFindexDatabase(const std::string& base, const std::string& delta, const bool binary_index,
+                           const std::set<std::string>& replaced) {
+    const std::string data_filename = base + ".ffdata";
+    const std::string index_filename = base + ".ffindex";
+    const std::string delta_data_filename = delta + ".ffdata";
+    const std::string delta_index_filename = delta + ".ffindex";
+
+    const size_t delta_entries = CountLinesInFile(delta_index_filename.c_str());
+    if (delta_entries == 0 && replaced.empty())
+        return;
+
+    ffindex_index_t* delta_index;
+    if (delta_entries > 0) {
+        FILE* delta_index_fh = fopen(delta_index_filename.c_str(), "r");
+        if (delta_index_fh == NULL)
+            OpenFileError(delta_index_filename.c_str(), __FILE__, __LINE__, __func__);
+        delta_index = ffindex_index_parse(delta_index_fh, delta_entries);
+        fclose(delta_index_fh);
+        if (delta_index == NULL) {
+            HH_LOG(ERROR) << "Could not parse index " << delta_index_filename << "!" << std::endl;
+            exit(1);
+        }
+    }
+    else {
+        // ffindex_index_parse would size an empty index for its default maximum
+        delta_index = (ffindex_index_t*) calloc(1, sizeof(ffindex_index_t));
+    }
+
+    // new entries are stored behind the current data
+    const size_t data_size = FileSize(data_filename);
+    for (size_t i = 0; i < delta_index->n_entries; i++)
+        delta_index->entries[i].offset += data_size;
+
+    ffindex_index_t* merged;
+    {
+        FFindexDatabase db(data_filename.c_str(), index_filename.c_str(), false);
+        if (db.db_index == NULL) {
+            HH_LOG(ERROR) << "Could not read index " << index_filename << "!" << std::endl;
+            exit(1);
+        }
+        if (db.isBlockCompressed()) {
+            HH_LOG(ERROR) << "Cannot append to the block-compressed data file " << data_filename
+                << ", decompress it with ffdata_compress -d first!" << std::endl;
+            exit(1);
+        }
+        // the remaining entries of <base>, without those that are replaced
+        ffindex_index_t* kept = db.db_index;
+        if (!replaced.empty()) {
+            kept = (ffindex_index_t*) malloc(sizeof(ffindex_index_t) + sizeof(ffindex_entry_t) * db.db_index->n_entries);
+            if (kept == NULL) {
+                HH_LOG(ERROR) << "Could not allocate the index of " << index_filename << "!" << std::endl;
+                exit(1);
+            }
+            *kept = *db.db_index;
+            kept->n_entries = 0;
+            for (size_t i = 0; i < db.db_index->n_entries; i++) {
+                if (replaced.find(db.db_index->entries[i].name) == replaced.end())
+                    kept->entries[kept->n_entries++] = db.db_index->entries[i];
+            }
+        }
+
+        merged = ffindex_index_merge(kept, delta_index);
+        if (kept != db.db_index)
+            free(kept);
+        if (merged == NULL) {
+            HH_LOG(ERROR) << "Could not merge index " << delta_index_filename << " into " << index_filename << "!" << std::endl;
+            exit(1);
+        }
+    }
+
+    FILE* data_fh = fopen(data_filename.c_str(), "a");
+    FILE* delta_data_fh = fopen(delta_data_filename.c_str(), "r");
+    if (data_fh == NULL)
+        OpenFileError(data_filename.c_str(), __FILE__, __LINE__, __func__);
+    if (delta_data_fh == NULL)
+        OpenFileError(delta_data_filename.c_str(), __FILE__, __LINE__, __func__);
+    std::vector<char> buffer(1 << 20);
+    size_t n;
+    while ((n = fread(&buffer[0], 1, buffer.size(), delta_data_fh)) > 0) {
+        if (fwrite(&buffer[0], 1, n, data_fh) != n) {
+            HH_LOG(ERROR) << "Could not write to " << data_filename << "!" << std::endl;
+            exit(1);
+        }
+    }
+    fclose(delta_data_fh);
+    fclose(data_fh);
+
+    // the index is replaced only when it is complete
+    const std::string tmp_index_filename = index_filename + ".tmp";
+    FILE* index_fh = fopen(tmp_index_filename.c_str(), "w");
+    if (index_fh == NULL)
+        OpenFileError(tmp_index_filename.c_str(), __FILE__, __LINE__, __func__);
+    if (ffindex_write(merged, index_fh) != EXIT_SUCCESS || fclose(index_fh) != 0
+        || rename(tmp_index_filename.c_str(), index_filename.c_str()) != 0) {
+        HH_LOG(ERROR) << "Could not write index " << index_filename << "!" << std::endl;
+        exit(1);
+    }
+
+    // a sidecar of the old index would be ignored from now on, so it is rewritten
+    const std::string binary_index_filename = index_filename + ".bin";
+    if (binary_index || access(binary_index_filename.c_str(), F_OK) == 0) {
+        if (ffindex_write_binary_index(merged, index_filename.c_str()) != EXIT_SUCCESS) {
+            HH_LOG(ERROR) << "Could not write binary index of " << index_filename << "!" << std::endl;
+            exit(1);
+        }
+    }
+
+    HH_LOG(INFO) << "Appended " << delta_index->n_entries << " entries to " << base
+        << ", which now has " << merged->n_entries << " entries" << std::endl;
+
+    if (delta_index->index_data != NULL)
+        munmap(delta_index->index_data, delta_index->index_data_size);
+    free(delta_index);
+    free(merged);
+}
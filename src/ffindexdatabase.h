@@ -5,6 +5,12 @@ extern "C" {
 #include <ffindex.h>
 }
 
+#include "blockcompresseddata.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
 class FFindexDatabase {
 public:
     FFindexDatabase(const char* data_filename, const char* index_filename, bool isCompressed);
@@ -12,6 +18,18 @@ public:
 
     void ensureLinearAccess();
 
+    // Ask for transparent huge pages for the mapped data file (only effective on kernels with file THP)
+    void adviseHugePages();
+
+    // Data of an entry; inflated if the data file is block-compressed (see blockcompresseddata.h),
+    // in which case it is only valid until the calling thread reads another entry
+    char* getData(ffindex_entry_t* entry);
+
+    // Bytes of the data file that hold the data of an entry
+    void getStoredRange(ffindex_entry_t* entry, const char*& data, size_t& length);
+
+    bool isBlockCompressed() const { return blocks != NULL; }
+
     ffindex_index_t* db_index;
     char* db_data;
 
@@ -21,6 +39,8 @@ public:
 private:
     size_t data_size;
     FILE* db_data_fh;
+    size_t binary_index_size; // size of the mapped binary index, 0 if the text index was parsed
+    BlockCompressedData* blocks; // NULL if the data file is not block-compressed
 
     struct compareEntryByOffset {
         bool operator() (const ffindex_entry_t& lhs, const ffindex_entry_t& rhs) const {
@@ -29,4 +49,62 @@ private:
     };
 };
 
+// ffindex database written by several threads at once
+// Every thread inserts into its own shard <base>.ffdata.<shard>, <base>.ffindex.<shard> without locking;
+// merge() combines the shards into <base>.ffdata and the index <base>.ffindex sorted by name.
+// When appending, the shards are named after the delta database <base>.delta instead, which merge()
+// appends to the existing database <base> (see AppendFFindexDatabase)
+class FFindexShardedWriter {
+public:
+    FFindexShardedWriter(const std::string& base, const int shards, const bool append = false);
+
+    void insert(const int shard, const std::string& data, const char* name);
+
+    // Close the shards and merge them, no entries can be inserted afterwards
+    // The binary index sidecar of <base>.ffindex is written if binary_index is set; when appending,
+    // the entries of <base> named in replaced are dropped (see AppendFFindexDatabase)
+    void merge(const bool binary_index = false, const std::set<std::string>& replaced = std::set<std::string>());
+
+    size_t entries() const { return n_entries; }
+
+    const std::string base;
+    const bool append;
+
+private:
+    std::vector<FILE*> data_fh;
+    std::vector<FILE*> index_fh;
+    std::vector<size_t> offsets;
+    size_t n_entries;
+};
+
+// Work done by ForEachEntryParallel on the entries of a database
+class FFindexEntryProcessor {
+public:
+    virtual ~FFindexEntryProcessor() {}
+
+    // Set up and release the state a thread reuses for all of its entries (e.g. an Alignment);
+    // called by every thread before its first and after its last entry
+    virtual void beginThread(const int thread) {}
+    virtual void endThread(const int thread) {}
+
+    // Process one entry; called concurrently by the threads 0..threads-1 for different entries
+    virtual void process(const int thread, ffindex_entry_t* entry, char* data) = 0;
+};
+
+// Hand all entries of reader to processor on the given number of threads, in the order of the data file.
+// The entries differ a lot in size, so they are handed out one at a time; empty or unreadable entries
+// are skipped with a warning
+void ForEachEntryParallel(FFindexDatabase& reader, const int threads, FFindexEntryProcessor& processor);
+
+// Append the ffindex database <delta> to the database <base>
+// The data of <delta> is appended to <base>.ffdata, the sorted indices are merged in one pass over both;
+// entries of <delta> replace entries of <base> with the same name, their old data stays unreferenced.
+// Entries of <base> named in replaced are dropped as well, also if <delta> has no entry of that name.
+// The binary index sidecar is rewritten if binary_index is set or if <base> already has one
+void AppendFFindexDatabase(const std::string& base, const std::string& delta, const bool binary_index,
+                           const std::set<std::string>& replaced = std::set<std::string>());
+
+// Write the binary index sidecar (see ffindex_binary_index) of a sorted index file
+void WriteFFindexBinaryIndex(const std::string& index_filename);
+
 #endif
@@ -0,0 +1,222 @@
+// Class for a flat hash with string keys
+// * same use as Hash<Typ> in hash.h: keys are strings of type char*, data elements are of type Typ
+// * open addressing with linear probing in a power-of-two table; the table grows when it gets half full
+// * keys are copied into one shared character buffer and data elements are stored in one vector,
+//   so adding a key does not allocate memory of its own
+// * keys are read out in the order in which they were added
+//
+// Applications
+// * bookkeeping of hits and database entries that is queried many times per search iteration,
+//   e.g. the hits found in previous iterations of HHblits
+//
+// Time complexity: (L is the length of the key string)
+// * Show(key), Add(key), Remove(key), Contains(key): O(L) on average
+// * ReadNext(): O(1) on average
+// * RemoveAll(): O(table size)
+//
+// Implementation:
+// table[] holds for every slot the index of an element in elements[], EMPTY, or REMOVED.
+// An element holds the full hash value of its key, the offset of the key in keys[] and the data.
+// Removed elements and their keys stay in elements[] and keys[] until the table is rebuilt, which happens when
+// the table gets more than half full of elements and REMOVED marks.
+
+#ifndef FLATHASH_H_
+#define FLATHASH_H_
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+template<class Typ>
+class FlatHash
+{
+public:
+  // size is the expected number of keys
+  FlatHash(int size = 1024, Typ fail = Typ()) : fail(fail), num_keys(0), num_removed(0), curr(0) {
+    size_t num_slots = 16;
+    while (num_slots < 2 * (size_t) size)
+      num_slots *= 2;
+    table.assign(num_slots, EMPTY);
+  }
+
+  // Set 'fail' element to be returned when the supplied key is not defined
+  void Null(Typ f) {fail = f;}
+
+  // Return data element for key. Returns 'fail' if key does not exist
+  Typ Show(const char* key) {
+    int e = Find(key, HashValue(key));
+    return (e >= 0) ? elements[e].data : fail;
+  }
+
+  // Returns 1 if the hash contains key, 0 otherwise
+  int Contains(const char* key) {
+    return Find(key, HashValue(key)) >= 0;
+  }
+
+  // Add/replace key/data pair to hash and return address of data element for key
+  Typ* Add(const char* key, Typ data) {
+    Typ* d = Add(key);
+    *d = data;
+    return d;
+  }
+
+  // Add key to hash and return address of data element. If key exists leave data element unchanged, else set it to 'fail'.
+  Typ* Add(const char* key) {
+    const uint64_t h = HashValue(key);
+    int e = Find(key, h);
+    if (e >= 0)
+      return &elements[e].data;
+
+    if (2 * (elements.size() + 1) > table.size())
+      Rebuild();
+
+    Element element;
+    element.hash = h;
+    element.key = keys.size();
+    element.removed = false;
+    element.data = fail;
+    keys.insert(keys.end(), key, key + strlen(key) + 1);
+    elements.push_back(element);
+
+    size_t i = h & (table.size() - 1);
+    while (table[i] >= 0)
+      i = (i + 1) & (table.size() - 1);
+    if (table[i] == REMOVED)
+      num_removed--;
+    table[i] = elements.size() - 1;
+    num_keys++;
+    return &elements.back().data;
+  }
+
+  // Remove key from hash and return data element for key ('fail' if key does not exist)
+  Typ Remove(const char* key) {
+    const uint64_t h = HashValue(key);
+    size_t i = h & (table.size() - 1);
+    for (; table[i] != EMPTY; i = (i + 1) & (table.size() - 1)) {
+      if (table[i] >= 0 && Matches(table[i], key, h)) {
+        Element& element = elements[table[i]];
+        element.removed = true;
+        table[i] = REMOVED;
+        num_removed++;
+        num_keys--;
+        return element.data;
+      }
+    }
+    return fail;
+  }
+
+  // Remove all keys from hash
+  void RemoveAll() {
+    table.assign(table.size(), EMPTY);
+    elements.clear();
+    keys.clear();
+    num_keys = num_removed = 0;
+    curr = 0;
+  }
+
+  // Reset readout of keys to the first key added
+  void Reset() {
+    curr = 0;
+    SkipRemoved();
+  }
+
+  // Returns 1 if the readout has arrived at the end, 0 otherwise
+  int End() {
+    return curr >= elements.size();
+  }
+
+  // Return data of next key. Return 'fail' data if at end
+  Typ ReadNext() {
+    if (End())
+      return fail;
+    Typ data = elements[curr++].data;
+    SkipRemoved();
+    return data;
+  }
+
+  // Return number of keys
+  int Size() {
+    return num_keys;
+  }
+
+private:
+  enum { EMPTY = -1, REMOVED = -2 };
+
+  struct Element {
+    uint64_t hash;         // full hash value of key
+    size_t key;            // offset of key in keys[]
+    bool removed;          // key was removed from hash
+    Typ data;              // data for key
+  };
+
+  Typ fail;
+  std::vector<int> table;          // index into elements[], EMPTY or REMOVED for each slot
+  std::vector<Element> elements;   // key/data pairs in the order they were added
+  std::vector<char> keys;          // all keys including their terminating \0
+  int num_keys;                    // number of keys in hash
+  size_t num_removed;              // number of REMOVED marks in table
+  size_t curr;                     // index of next element for ReadNext()
+
+  // FNV-1a hash of key
+  static uint64_t HashValue(const char* key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const unsigned char* c = (const unsigned char*) key; *c; ++c)
+      h = (h ^ *c) * 1099511628211ULL;
+    return h ^ (h >> 32);
+  }
+
+  bool Matches(int e, const char* key, uint64_t h) {
+    return elements[e].hash == h && !strcmp(&keys[elements[e].key], key);
+  }
+
+  // Index of the element with key, -1 if key does not exist
+  int Find(const char* key, uint64_t h) {
+    for (size_t i = h & (table.size() - 1); table[i] != EMPTY; i = (i + 1) & (table.size() - 1))
+      if (table[i] >= 0 && Matches(table[i], key, h))
+        return table[i];
+    return -1;
+  }
+
+  void SkipRemoved() {
+    while (curr < elements.size() && elements[curr].removed)
+      curr++;
+  }
+
+  // Drop removed elements and their keys and rebuild the table; doubles the table if more than half of it would be in use
+  void Rebuild() {
+    size_t n = 0;
+    for (size_t e = 0; e < elements.size(); e++) {
+      if (e == curr)
+        curr = n;
+      if (!elements[e].removed)
+        elements[n++] = elements[e];
+    }
+    if (curr > n)
+      curr = n;
+
+    if (n < elements.size()) {
+      std::vector<char> kept;
+      for (size_t e = 0; e < n; e++) {
+        const char* key = &keys[elements[e].key];
+        elements[e].key = kept.size();
+        kept.insert(kept.end(), key, key + strlen(key) + 1);
+      }
+      keys.swap(kept);
+      elements.resize(n);
+    }
+
+    size_t num_slots = table.size();
+    while (2 * (n + 1) > num_slots)
+      num_slots *= 2;
+    table.assign(num_slots, EMPTY);
+    for (size_t e = 0; e < n; e++) {
+      size_t i = elements[e].hash & (num_slots - 1);
+      while (table[i] != EMPTY)
+        i = (i + 1) & (num_slots - 1);
+      table[i] = e;
+    }
+    num_removed = 0;
+  }
+};
+
+#endif
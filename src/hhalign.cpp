@@ -595,7 +595,7 @@ void HHalign::run(FILE* query_fh, char* query_path) {
   int seqs_found = 0;
 
   Hit hit_cur;
-  Hash<Hit>* previous_hits = new Hash<Hit>(1631, hit_cur);
+  FlatHash<Hit>* previous_hits = new FlatHash<Hit>(1631, hit_cur);
 
   Qali = new Alignment(par.maxseq, par.maxres);
   Qali_allseqs = new Alignment(par.maxseq, par.maxres);
@@ -607,8 +607,10 @@ void HHalign::run(FILE* query_fh, char* query_path) {
   // Read input file (HMM, HHM, or alignment format), and add pseudocounts etc.
   Qali->N_in = 0;
   char input_format = 0;
-  ReadQueryFile(par, query_fh, input_format, par.wg, q, Qali, query_path, pb,
+  int status = ReadQueryFile(par, query_fh, input_format, par.wg, q, Qali, query_path, pb,
           S, Sim);
+  if (status)
+    exit(status);
   PrepareQueryHMM(par, input_format, q, pc_hhm_context_engine,
           pc_hhm_context_mode, pb, R);
   q_vec.MapOneHMM(q);
@@ -625,12 +627,12 @@ void HHalign::run(FILE* query_fh, char* query_path) {
   }
 
   int max_template_length = getMaxTemplateLength(new_entries);
+#pragma omp parallel for schedule(static, 1)
   for(int i = 0; i < par.threads; i++) {
     viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
   }
 
-  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-  std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec, new_entries, par.qsc_db, pb, S, Sim, R, par.ssm, S73, S33, S37);
+  std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec, new_entries, par.qsc_db, pb, S, Sim, R, par.ssm, S73, S33, S37);
 
   hitlist.N_searched = new_entries.size();
   add_hits_to_hitlist(hits_to_add, hitlist);
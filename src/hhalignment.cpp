@@ -28,11 +28,15 @@ Alignment::Alignment(int maxseq, int maxres) : maxseq(maxseq), maxres(maxres) {
   display = new char[maxseq + 2];
   wg = new float[maxseq + 2];
   nseqs = new int[maxres + 2];
+  converted = new char[maxseq + 2];
   N_in = L = 0;
+  N_converted = L_converted = 0;
   nres = NULL;           // number of residues per sequence k
   first = NULL;          // first residue in sequence k
   last = NULL;           // last  residue in sequence k
   ksort = NULL;          // sequence indices sorted by descending nres[k]
+  Xcol = NULL;           // column-major copy of X, built on demand
+  Xcol_stride = 0;
   name[0] = '\0';        // no name defined yet
   longname[0] = '\0';    // no name defined yet
   fam[0] = '\0';         // no name defined yet
@@ -48,8 +52,6 @@ Alignment::~Alignment() {
   for (int k = 0; k < N_in; ++k) {
     delete[] sname[k];
     delete[] seq[k];
-    free(X[k]);
-    delete[] I[k];
   }
   delete[] sname;
   delete[] seq;
@@ -60,20 +62,85 @@ Alignment::~Alignment() {
   delete[] display;
   delete[] wg;
   delete[] nseqs;
+  delete[] converted;
   delete[] nres;
   delete[] first;
   delete[] last;
   delete[] ksort;
+  DeleteColumnMajorResidues();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Allocate residue row X[k] and insert row I[k] from the arenas of this alignment
+// Rows of consecutive sequences are adjacent in memory and are released together
+/////////////////////////////////////////////////////////////////////////////////////
 char * Alignment::initX(int len) {
   int seqSimdLength = (len) / (VECSIZE_INT * 4) + 2;
   seqSimdLength *= (VECSIZE_INT * 4);
-  char * ptr = (char *) malloc_simd_int(seqSimdLength);
+  char * ptr = (char *) X_arena.Allocate(seqSimdLength);
   std::fill(ptr, ptr + seqSimdLength, GAP);
   return ptr;
 }
 
+short unsigned int * Alignment::initI(int len) {
+  return (short unsigned int *) I_arena.Allocate(len * sizeof(short unsigned int));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Transpose X[k][i] (i=0..L+1) into the column-major array Xcol
+// Column passes over all sequences then read contiguous memory instead of touching N_in rows
+/////////////////////////////////////////////////////////////////////////////////////
+void Alignment::BuildColumnMajorResidues() {
+  const int block = 64;  // columns per block; keeps the written cache lines resident while reading rows
+  DeleteColumnMajorResidues();
+  Xcol_stride = ((N_in + ALIGN_INT - 1) / ALIGN_INT) * ALIGN_INT;
+  Xcol = (char*) mem_align(ALIGN_INT, (size_t) (L + 2) * Xcol_stride);
+
+#pragma omp parallel for schedule(static) if((long) N_in * L > NCELLS_PARALLEL)
+  for (int ib = 0; ib <= L + 1; ib += block) {
+    const int iend = imin(ib + block, L + 2);
+    for (int k = 0; k < N_in; ++k) {
+      const char* Xk = X[k];
+      for (int i = ib; i < iend; ++i)
+        Xcol[(size_t) i * Xcol_stride + k] = Xk[i];
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Release the sequences and names of a previously read alignment before reading the next one
+// into the same object; the arenas keep their blocks for the rows of the next alignment
+/////////////////////////////////////////////////////////////////////////////////////
+void Alignment::ReleaseSequences() {
+  for (int k = 0; k < N_in; ++k) {
+    delete[] sname[k];
+    delete[] seq[k];
+  }
+  N_in = 0;
+  name[0] = '\0';
+  longname[0] = '\0';
+  fam[0] = '\0';
+  readCommentLine = '0';
+  X_arena.Reset();
+  I_arena.Reset();
+
+  // per-sequence caches of Filter2() are recomputed for the new sequences
+  delete[] ksort;
+  delete[] first;
+  delete[] last;
+  delete[] nres;
+  ksort = first = last = nres = NULL;
+  DeleteColumnMajorResidues();
+}
+
+void Alignment::DeleteColumnMajorResidues() {
+  if (Xcol) {
+    free(Xcol);
+    Xcol = NULL;
+  }
+  Xcol_stride = 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Deep-copy constructor
 /////////////////////////////////////////////////////////////////////////////////////
@@ -83,9 +150,9 @@ Alignment& Alignment::operator=(Alignment& ali) {
   for (int k = 0; k < N_in; ++k) {
     delete[] sname[k];
     delete[] seq[k];
-    delete[] X[k];
-    delete[] I[k];
   }
+  X_arena.Clear();
+  I_arena.Clear();
 
   L = ali.L;
   N_in = ali.N_in;
@@ -141,7 +208,7 @@ Alignment& Alignment::operator=(Alignment& ali) {
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
   }
   for (int k = 0; k < N_in; ++k) {
-    I[k] = new short unsigned int[strlen(ali.seq[k]) + 2];
+    I[k] = initI(strlen(ali.seq[k]) + 2);
     if (!I[k])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
   }
@@ -156,6 +223,10 @@ Alignment& Alignment::operator=(Alignment& ali) {
     display[k] = ali.display[k];
     wg[k] = ali.wg[k];
   }
+  N_converted = ali.N_converted;
+  L_converted = ali.L_converted;
+  for (int k = 0; k < N_converted; ++k)
+    converted[k] = ali.converted[k];
 
   kss_dssp = ali.kss_dssp;
   ksa_dssp = ali.ksa_dssp;
@@ -177,7 +248,8 @@ Alignment& Alignment::operator=(Alignment& ali) {
 /////////////////////////////////////////////////////////////////////////////////////
 // Reads in an alignment from file into matrix seq[k][l] as ASCII
 /////////////////////////////////////////////////////////////////////////////////////
-void Alignment::Read(FILE* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline) {
+template <class Input>
+void Alignment::Read(Input* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline) {
   int l;                  // Postion in alignment incl. gaps (first=1)
   int h;                  // Position in input line (first=0)
   int k;                  // Index of sequence being read currently (first=0)
@@ -193,9 +265,10 @@ void Alignment::Read(FILE* inf, char infile[], const char mark, const int maxcol
 
   kss_dssp = ksa_dssp = kss_pred = kss_conf = kfirst = -1;
   n_display = 0;
-  N_in = 0;
+  ReleaseSequences();
   N_filtered = 0;
   N_ss = 0;
+  N_converted = 0;
   cur_seq[0] = ' ';  // overwrite '\0' character at beginning to be able to do strcpy(*,cur_seq)
   l = 1;
   k = -1;
@@ -234,7 +307,7 @@ void Alignment::Read(FILE* inf, char infile[], const char mark, const int maxcol
         if (!X[k])
           MemoryError("array for input sequences", __FILE__, __LINE__,
                       __func__);
-        I[k] = new short unsigned int[strlen(cur_seq) + 2];
+        I[k] = initI(strlen(cur_seq) + 2);
         if (!I[k])
           MemoryError("array for input sequences", __FILE__, __LINE__,
                       __func__);
@@ -494,7 +567,7 @@ void Alignment::Read(FILE* inf, char infile[], const char mark, const int maxcol
     X[k] = initX(strlen(cur_seq) + 2);
     if (!X[k])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
-    I[k] = new short unsigned int[strlen(cur_seq) + 2];
+    I[k] = initI(strlen(cur_seq) + 2);
     if (!I[k])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
     strcpy(seq[k], cur_seq);
@@ -541,6 +614,22 @@ void Alignment::Read(FILE* inf, char infile[], const char mark, const int maxcol
                            << kfirst << " (0 is first)\n";
 }
 
+// Append residue c of a sequence decoded by ReadCompressed() to seq[k] at position l and convert it
+// into X[k] and I[k] like Compress() with a3m match state assignment (i = last match state)
+inline void Alignment::AddDecodedResidue(int k, char c, int& l, int& i) {
+  const char a = aa2i(c);
+  if (a < 0)
+    return;  // white space and unknown characters are dropped from seq[k]
+  seq[k][l++] = c;
+  if (c >= 'a' && c <= 'z')
+    I[k][i]++;  //insert state = lower case character
+  else if (c != '.') {
+    ++i;
+    X[k][i] = a;
+    I[k][i] = 0;
+  }
+}
+
 void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
                                ffindex_index_t* ffindex_sequence_database_index,
                                char* ffindex_sequence_database_data,
@@ -558,9 +647,10 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
 
   kss_dssp = ksa_dssp = kss_pred = kss_conf = kfirst = -1;
   n_display = 0;
-  N_in = 0;
+  ReleaseSequences();
   N_filtered = 0;
   N_ss = 0;
+  N_converted = 0;
 
   // Commentary line?
   if ((*data) == '#' && !name[0]) {
@@ -640,7 +730,7 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
   kfirst = k;
 
   X[k] = initX(consensus_length + 2);
-  I[k] = new short unsigned int[consensus_length + 2];
+  I[k] = initI(consensus_length + 2);
 
   seq[k] = new char[consensus_length + 2];
   seq[k][0] = ' ';
@@ -652,6 +742,17 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
   }
   seq[k][copy_pos] = '\0';  //Ensure that cur_seq ends with a '\0' character
 
+  // The residues of the sequences are decoded directly into X[k] and I[k] as Compress() would
+  // convert them for a3m match state assignment, so Compress() can reuse them. This holds if all
+  // sequences have the match states of the consensus and no '.' characters
+  const int L_consensus = copy_pos - 1;
+  bool decoded = strchr(seq[k], '.') == NULL;
+  for (int i = 1; i <= L_consensus; ++i) {
+    X[k][i] = aa2i(seq[k][i]);
+    I[k][i] = 0;
+  }
+  converted[k] = 5;
+
   char* cur_name = strscn(cur_header + 1);
   sname[k] = new char[strlen(cur_name) + 1];
   strcpy(sname[k], cur_name);
@@ -706,17 +807,39 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
     readU16(&data, nr_blocks);
     index += 2;
 
-    size_t actual_pos = start_pos;
+    // Length of the a3m row: matches, inserts and deletions of all blocks,
+    // padded with deletions to the length of the consensus
+    size_t row_length = 0;
     size_t alignment_length = 0;
-    size_t alignment_index = 1;
+    for (unsigned short int block_index = 0; block_index < nr_blocks; block_index++) {
+      unsigned char nr_matches = (unsigned char) data[2 * block_index];
+      char nr_insertions_deletions = data[2 * block_index + 1];
+      row_length += nr_matches + abs(nr_insertions_deletions);
+      alignment_length += nr_matches + (nr_insertions_deletions < 0 ? -nr_insertions_deletions : 0);
+    }
+    if (alignment_length < consensus_length) {
+      row_length += consensus_length - alignment_length;
+    }
+
+    X[k] = initX(row_length + 2);
+    I[k] = initI(row_length + 2);
+    seq[k] = new char[row_length + 2];
+    seq[k][0] = ' ';
+    I[k][0] = 0;
+
+    // l: next position in seq[k], i: last match state in X[k]
+    int l = 1;
+    int i = 0;
+    size_t actual_pos = start_pos;
+    alignment_length = 0;
     for (unsigned short int block_index = 0; block_index < nr_blocks;
         block_index++) {
       unsigned char nr_matches = (unsigned char) (*data);
       data++;
       index++;
 
-      for (int i = 0; i < nr_matches; i++) {
-        cur_seq[alignment_index++] = sequence_data[actual_pos - 1];
+      for (int j = 0; j < nr_matches; j++) {
+        AddDecodedResidue(k, sequence_data[actual_pos - 1], l, i);
         actual_pos++;
         alignment_length++;
       }
@@ -726,24 +849,28 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
       index++;
 
       if (nr_insertions_deletions > 0) {
-        for (int i = 0; i < nr_insertions_deletions; i++) {
-          cur_seq[alignment_index++] = tolower(sequence_data[actual_pos - 1]);
+        for (int j = 0; j < nr_insertions_deletions; j++) {
+          AddDecodedResidue(k, tolower(sequence_data[actual_pos - 1]), l, i);
           actual_pos++;
         }
       } else {
-        for (int i = 0; i < -nr_insertions_deletions; i++) {
-          cur_seq[alignment_index++] = '-';
+        for (int j = 0; j < -nr_insertions_deletions; j++) {
+          AddDecodedResidue(k, '-', l, i);
           alignment_length++;
         }
       }
     }
 
     while (alignment_length < consensus_length) {
-      cur_seq[alignment_index++] = '-';
+      AddDecodedResidue(k, '-', l, i);
       alignment_length++;
     }
 
-    cur_seq[alignment_index] = '\0';
+    seq[k][l] = '\0';
+    if (i != L_consensus || strchr(seq[k], '.') != NULL) {
+      decoded = false;
+    }
+    converted[k] = 1;
 
     //process sequence with header
     if (mark == 0) {
@@ -757,19 +884,6 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
       keep[k] = 1;
     }
 
-    X[k] = initX(alignment_index + 1);
-    I[k] = new short unsigned int[alignment_index + 1];
-
-    seq[k] = new char[alignment_index + 1];
-    seq[k][0] = ' ';
-    size_t copy_pos = 1;
-    for (size_t string_pos = 1; string_pos < alignment_index; string_pos++) {
-      if (aa2i(cur_seq[string_pos]) >= 0) {
-        seq[k][copy_pos++] = cur_seq[string_pos];
-      }
-    }
-    seq[k][copy_pos] = '\0';  //Ensure that cur_seq ends with a '\0' character
-
     char* cur_name = strscn(header_data + 1);
     sname[k] = new char[strlen(cur_name) + 1];
     strcpy(sname[k], cur_name);
@@ -777,6 +891,11 @@ void Alignment::ReadCompressed(ffindex_entry_t* entry, char* data,
     k++;
   }
 
+  if (decoded) {
+    N_converted = k;
+    L_converted = L_consensus;
+  }
+
   N_in = k;
 
   // Warn if there are only special sequences but no master sequence (consensus seq given if keep[kfirst]==0)
@@ -828,6 +947,11 @@ void Alignment::Compress(const char infile[], const char cons, const int maxcol,
 
   int M = par_M;
 
+  // Sequences converted by the previous call (e.g. in the last hhblits iteration) are reused below
+  // for a3m match state assignment; all others are (re)converted from seq[k]
+  const int N_reuse = N_converted;
+  N_converted = 0;
+
   // for (k=0;k<N_in; ++k) printf("k=%i >%s\n%s\n",k,sname[k],seq[k]); // DEBUG
 
   // Initialize
@@ -909,6 +1033,8 @@ void Alignment::Compress(const char infile[], const char cons, const int maxcol,
 
       // Remove '.' characters from seq[k]
       for (k = 0; k < N_in; ++k) {
+        if (k < N_reuse && converted[k])
+          continue;  // already done in previous call
         char* ptrS = seq[k];       // pointer to source: character in seq[k]
         char* ptrD = seq[k];         // pointer to destination: seq[k]
         while (1)                   // omit '.' symbols
@@ -926,7 +1052,35 @@ void Alignment::Compress(const char infile[], const char cons, const int maxcol,
       for (k = 0; k < N_in; ++k) {
         i = 1;
         l = 1;  // start at i=1, not i=0!
-        if (keep[k])  //skip >ss_dssp, >ss_pred, >ss_conf, >aa_... sequences
+
+        // Kind of conversion for seq k: 1: amino acids  2: ss states  3: solvent accessibility  4: confidence values
+        // 5: consensus sequence  6: not converted
+        char kind;
+        if (keep[k])
+          kind = 1;
+        else if (k == kss_dssp || k == kss_pred)
+          kind = 2;
+        else if (k == ksa_dssp)
+          kind = 3;
+        else if (k == kss_conf)
+          kind = 4;
+        else if (k == kfirst)
+          kind = 5;
+        else
+          kind = 6;
+        const bool reuse = (k < N_reuse && converted[k] == kind);
+        converted[k] = kind;
+
+        if (reuse)  // seq[k] has been converted the same way before: X[k] and I[k] are still valid
+        {
+          if (kind == 6)
+            continue;
+          if (kind == 1)
+            while ((c = seq[k][l++]) >= 'a' && c <= 'z')
+              I[k][0]++;  // restore inserts before first match state
+          i = L_converted + 1;
+        }
+        else if (keep[k])  //skip >ss_dssp, >ss_pred, >ss_conf, >aa_... sequences
         {
           while ((c = seq[k][l++]))  // assign residue to c at same time
           {
@@ -1000,6 +1154,8 @@ void Alignment::Compress(const char infile[], const char cons, const int maxcol,
 
       HH_LOG(DEBUG) << "Alignment in " << infile << " contains " << L
                               << " match states\n";
+      N_converted = N_in;
+      L_converted = L;
       break;
 
       /////////////////////////////////////////////////////////////////////////////////////
@@ -1331,9 +1487,10 @@ void Alignment::GetSeqsFromHMM(HMM* q) {
 
   kss_dssp = ksa_dssp = kss_pred = kss_conf = kfirst = -1;
   n_display = 0;
-  N_in = 0;
+  ReleaseSequences();
   N_filtered = 0;
   N_ss = 0;
+  N_converted = 0;
   k = 0;
 
   for (qk = 0; qk < q->n_seqs; ++qk) {
@@ -1349,7 +1506,7 @@ void Alignment::GetSeqsFromHMM(HMM* q) {
     X[k] = initX(strlen(q->seq[qk]) + 1);
     if (!X[k])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
-    I[k] = new short unsigned int[strlen(q->seq[qk]) + 1];
+    I[k] = initI(strlen(q->seq[qk]) + 1);
     if (!I[k])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
 
@@ -1473,6 +1630,8 @@ int Alignment::Filter(int max_seqid, const float S[20][20], int coverage,
 void Alignment::Shrink() {
   char** new_X = new char*[maxseq + 2];
   short unsigned int** new_I = new short unsigned int*[maxseq + 2];;
+  Arena new_X_arena;
+  Arena new_I_arena;
   char** new_sname = new char*[maxseq + 2];
   char** new_seq = new char*[maxseq + 2];
 
@@ -1487,24 +1646,32 @@ void Alignment::Shrink() {
   int new_kfirst = -1;
 
   int new_N_in = N_in;
+  int new_N_converted = 0;
   int new_k = 0;
   for(int k = 0; k < N_in; k++) {
 	if(keep[k] == 0 && k != kss_dssp && k != ksa_dssp && k != kss_pred && k != kss_conf && k != kfirst) {
-	  free(X[k]);
-	  delete[] I[k];
 	  delete[] sname[k];
 	  delete[] seq[k];
 	  new_N_in--;
 	}
 	else {
-	  new_X[new_k] = X[k];
-	  new_I[new_k] = I[k];
+	  // Copy rows of remaining sequences into fresh arenas so that they are packed densely again
+	  // X rows keep the SIMD padding of initX(), Filter2 compares them in whole vectors up to the padding
+	  int len = imax(strlen(seq[k]), L) + 2;
+	  int seqSimdLength = (len / (VECSIZE_INT * 4) + 2) * (VECSIZE_INT * 4);
+	  new_X[new_k] = (char *) new_X_arena.Allocate(seqSimdLength);
+	  memcpy(new_X[new_k], X[k], L + 2);
+	  std::fill(new_X[new_k] + L + 2, new_X[new_k] + seqSimdLength, GAP);
+	  new_I[new_k] = (short unsigned int *) new_I_arena.Allocate(len * sizeof(short unsigned int));
+	  memcpy(new_I[new_k], I[k], (L + 2) * sizeof(short unsigned int));
 	  new_sname[new_k] = sname[k];
 	  new_seq[new_k] = seq[k];
 
 	  new_keep[new_k] = keep[k];
 	  new_display[new_k] = display[k];
 	  new_wg[new_k] = wg[k];
+	  if (k < N_converted)
+	    converted[new_N_converted++] = converted[k];  // new_k <= k, so compaction in place is safe
 
 	  if (k == kss_dssp) {
 		  new_kss_dssp = new_k;
@@ -1528,9 +1695,11 @@ void Alignment::Shrink() {
 
   delete[] X;
   X= new_X;
+  X_arena.Swap(new_X_arena);
 
   delete[] I;
   I = new_I;
+  I_arena.Swap(new_I_arena);
 
   delete[] sname;
   sname = new_sname;
@@ -1554,6 +1723,7 @@ void Alignment::Shrink() {
   kfirst = new_kfirst;
 
   N_in = new_N_in;
+  N_converted = new_N_converted;
 
   if(ksort != NULL) {
     delete[] ksort;
@@ -2046,8 +2216,6 @@ void Alignment::FrequenciesAndTransitions(HMM* q, char use_global_weights,
   int k;                // index of sequence
   int i;                // position in alignment
   int a;                // amino acid (0..19)
-  int ni[NAA + 3];        // number of times amino acid a occurs at position i
-  int naa;              // number of different amino acids
 
   //if (time) { ElapsedTimeSinceLastCall("begin freq and trans"); }
 
@@ -2076,42 +2244,60 @@ void Alignment::FrequenciesAndTransitions(HMM* q, char use_global_weights,
 
   if (N_filtered > 1) {
     for (k = 0; k < N_in; ++k)
-      wg[k] = 1e-6;  // initialized wg[k] with tiny pseudocount
-    // Calculate global weights
-    for (i = 1; i <= L; ++i)  // for all positions i in alignment
-        {
-      for (a = 0; a < 20; ++a)
-        ni[a] = 0;
-      for (k = 0; k < N_in; ++k)
+      X[k][0] = ENDGAP;  // make sure that sequences ENTER subalignment j for j=1
+    for (k = 0; k < N_in; ++k)
+      X[k][L + 1] = ENDGAP;  // does it have an influence?
+
+    // Column passes below read the column-major copy of X
+    BuildColumnMajorResidues();
+    const bool parallel = (long) N_in * L > NCELLS_PARALLEL;
+
+    // Count amino acids ni_col[i][a] and number of different amino acids naa_col[i] in each column i
+    int (*ni_col)[NAA + 3] = new int[L + 1][NAA + 3];
+    int* naa_col = new int[L + 1];
+#pragma omp parallel for schedule(static) if(parallel)
+    for (int i = 1; i <= L; ++i) {
+      int* ni_i = ni_col[i];
+      const char* Xi = Xcol + (size_t) i * Xcol_stride;
+      for (int a = 0; a < NAA + 3; ++a)
+        ni_i[a] = 0;
+      for (int k = 0; k < N_in; ++k)
         if (in[k])
-          ni[(int) X[k][i]]++;
-      naa = 0;
-      for (a = 0; a < 20; ++a)
-        if (ni[a])
-          naa++;
-      if (!naa)
-        naa = 1;  //naa=0 when column consists of only gaps and Xs (=ANY)
-      for (k = 0; k < N_in; ++k)
-        if (in[k] && X[k][i] < 20)
-          wg[k] += 1.0 / float(ni[(int) X[k][i]] * naa * (nres[k] + 30.0));
-      // wg[k] += 1.0/float(ni[ (int)X[k][i]]*(nres[k]+30.0));
-      // wg[k] += (naa-1.0)/float(ni[ (int)X[k][i]]*(nres[k]+30.0));
-      // ensure that each residue of a short sequence contributes as much as a residue of a long sequence:
-      // contribution is proportional to one over sequence length nres[k] plus 30.
+          ni_i[(int) Xi[k]]++;
+      int naa_i = 0;
+      for (int a = 0; a < 20; ++a)
+        if (ni_i[a])
+          naa_i++;
+      naa_col[i] = (naa_i ? naa_i : 1);  //naa=0 when column consists of only gaps and Xs (=ANY)
     }
+
+    // Calculate global weights
+#pragma omp parallel for schedule(static) if(parallel)
+    for (int k = 0; k < N_in; ++k) {
+      float wgk = 1e-6;  // initialized wg[k] with tiny pseudocount
+      if (in[k]) {
+        const char* Xk = X[k];
+        for (int i = 1; i <= L; ++i)  // for all positions i in alignment
+          if (Xk[i] < 20)
+            wgk += 1.0 / float(ni_col[i][(int) Xk[i]] * naa_col[i] * (nres[k] + 30.0));
+        // wg[k] += 1.0/float(ni[ (int)X[k][i]]*(nres[k]+30.0));
+        // wg[k] += (naa-1.0)/float(ni[ (int)X[k][i]]*(nres[k]+30.0));
+        // ensure that each residue of a short sequence contributes as much as a residue of a long sequence:
+        // contribution is proportional to one over sequence length nres[k] plus 30.
+      }
+      wg[k] = wgk;
+    }
+    delete[] ni_col;
+    delete[] naa_col;
     NormalizeTo1(wg, N_in);
     //if (time) { ElapsedTimeSinceLastCall("Calc global weights"); }
 
     // Do pos-specific sequence weighting and calculate amino acid frequencies and transitions
-    for (k = 0; k < N_in; ++k)
-      X[k][0] = ENDGAP;  // make sure that sequences ENTER subalignment j for j=1
-    for (k = 0; k < N_in; ++k)
-      X[k][L + 1] = ENDGAP;  // does it have an influence?
-
     // use subalignments of seqs with residue in i
     Amino_acid_frequencies_and_transitions_from_M_state(q, use_global_weights, in, pb);
     Transitions_from_I_state(q, in);  // use subalignments of seqs with insert in i
     Transitions_from_D_state(q, in);  // use subalignments of seqs with delete in i. Must be last of these three calls if par.wg==1!
+    DeleteColumnMajorResidues();
     //if (time) { ElapsedTimeSinceLastCall("Do pos-specific sequence weighting and calculate amino acid frequencies and transitions"); }
   } else  // N_filtered==1
   {
@@ -2419,6 +2605,10 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
   int ncol = 0;                // number of columns j that contribute to Neff[i]
   char change;  // has the set of sequences in subalignment changed? 0:no  1:yes
   float sum;
+  int* kenter = NULL;  // sequences entering the subalignment at step i-1 -> i
+  int* kleave = NULL;  // sequences leaving the subalignment at step i-1 -> i
+  int* kact = NULL;    // sequences in subalignment i (residue in column i)
+  const bool parallel = (long) N_in * L > NCELLS_PARALLEL;
 
   int* naa = new int[L + 1];   // number of different amino acids
 
@@ -2443,6 +2633,9 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
       w_contrib[j] = (float *) malloc_simd_int(NAA_VECSIZE * sizeof(float));
       memset(w_contrib[j], 0,NAA_VECSIZE * sizeof(int));
     }
+    kenter = new int[N_in + 1];
+    kleave = new int[N_in + 1];
+    kact = new int[N_in + 1];
   }
   q->Neff_HMM = 0.0f;
   Neff[0] = 0.0f;  // if the first column has no residues (i.e. change==0), Neff[i]=Neff[i-1]=Neff[0]
@@ -2451,28 +2644,40 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
   // Main loop through alignment columns
   for (i = 1; i <= L; ++i)  // Calculate wi[k] at position i as well as Neff[i]
       {
+    const char* Xi = Xcol + (size_t) i * Xcol_stride;        // column i of all sequences
+    const char* Xprev = Xcol + (size_t) (i - 1) * Xcol_stride;  // column i-1
+    const char* Xnext = Xcol + (size_t) (i + 1) * Xcol_stride;  // column i+1
 
     if (use_global_weights == 0) {
 
       change = 0;
-      // Check all sequences k and update n[j][a] and ri[j] if necessary
+      int nenter = 0;
+      int nleave = 0;
+      // Check all sequences k and collect those that enter or leave the subalignment
       for (k = 0; k < N_in; ++k) {
         if (!in[k])
           continue;
 
         // Update amino acid and GAP / ENDGAP counts for sequences with AA in i-1 and GAP/ENDGAP in i or vice versa
-        if (X[k][i - 1] >= ANY && X[k][i] < ANY) {  // ... if sequence k was NOT included in i-1 and has to be included for column i
-          change = 1;
-          nseqi++;
-          for (int j = 1; j <= L; ++j)
-            n[j][(int) X[k][j]]++;
-        } else if (X[k][i - 1] < ANY && X[k][i] >= ANY) {  // ... if sequence k WAS included in i-1 and has to be thrown out for column i
-          change = 1;
-          nseqi--;
-          for (int j = 1; j <= L; ++j)
-            n[j][(int) X[k][j]]--;
-        }
+        if (Xprev[k] >= ANY && Xi[k] < ANY)  // ... if sequence k was NOT included in i-1 and has to be included for column i
+          kenter[nenter++] = k;
+        else if (Xprev[k] < ANY && Xi[k] >= ANY)  // ... if sequence k WAS included in i-1 and has to be thrown out for column i
+          kleave[nleave++] = k;
       }  //end for (k)
+      if (nenter + nleave > 0) {
+        change = 1;
+        nseqi += nenter - nleave;
+        // Update n[j][a]; every column j is independent
+#pragma omp parallel for schedule(static) if(parallel && (long) (nenter + nleave) * L > NCELLS_PARALLEL)
+        for (int jj = 1; jj <= L; ++jj) {
+          int* nj = n[jj];
+          const char* Xj = Xcol + (size_t) jj * Xcol_stride;
+          for (int e = 0; e < nenter; ++e)
+            nj[(int) Xj[kenter[e]]]++;
+          for (int e = 0; e < nleave; ++e)
+            nj[(int) Xj[kleave[e]]]--;
+        }
+      }
       nseqs[i] = nseqi;
 
       // Only if subalignment changed we need to update weights wi[k] and Neff[i]
@@ -2484,8 +2689,6 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
 
         // Initialize weights and numbers of residues for subalignment i
         ncol = 0;
-        for (k = 0; k < N_in; ++k)
-          wi[k] = 1E-8;  // for pathological alignments all wi[k] can get 0;
 
         // Find min and max borders between which > fraction MAXENDGAPFRAC of sequences in subalignment contain an aa
         int jmin;
@@ -2498,11 +2701,17 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
         };
         ncol = jmax - jmin + 1;
 
+        // Collect sequences of subalignment i so that the loops below skip all others
+        int nact = 0;
+        for (k = 0; k < N_in; ++k)
+          if (in[k] && Xi[k] < ANY)
+            kact[nact++] = k;
+
         // Check whether number of columns in subalignment is sufficient
         if (ncol < NCOLMIN) {
           // Take global weights
           for (k = 0; k < N_in; ++k)
-            wi[k] = (in[k] && X[k][i] < ANY)? wg[k] : 0.0f;
+            wi[k] = (in[k] && Xi[k] < ANY)? wg[k] : 0.0f;
         } else {
           // Count number of different amino acids in column j
           for (j = jmin; j <= jmax; ++j)
@@ -2525,33 +2734,35 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
                 w_contrib[j][a] = 0.0f;  // set non-amino acid values to 0 to avoid checking in next loop for X[k][j]<ANY
             }
 
-            // Compute pos-specific weights wi[k]
-            for (k = 0; k < N_in; ++k) {
-              if (!in[k] || X[k][i] >= ANY)
-                continue;
-              for (j = jmin; j <= jmax; ++j)  // innermost, time-critical loop; O(L*N_in*L)
-                wi[k] += w_contrib[j][(int) X[k][j]];
+            // Compute pos-specific weights wi[k]; sequences are independent
+            for (k = 0; k < N_in; ++k)
+              wi[k] = 1E-8;  // for pathological alignments all wi[k] can get 0;
+#pragma omp parallel for schedule(static) if(parallel && (long) nact * ncol > NCELLS_PARALLEL)
+            for (int e = 0; e < nact; ++e) {
+              const char* Xk = X[kact[e]];
+              float wik = wi[kact[e]];
+              for (int jj = jmin; jj <= jmax; ++jj)  // innermost, time-critical loop; O(L*N_in*L)
+                wik += w_contrib[jj][(int) Xk[jj]];
+              wi[kact[e]] = wik;
             }
         }
 
         // Calculate Neff[i]
         Neff[i] = 0.0;
 
-        // Allocate and reset amino acid frequencies
-        for (j = jmin; j <= jmax; ++j)
-            memset(f[j], 0, ANY * sizeof(float));
-
-        // Update f[j][a]
-        for (k = 0; k < N_in; ++k) {
-          if (!in[k] || X[k][i] >= ANY)
-            continue;
-          for (j = jmin; j <= jmax; ++j)  // innermost loop; O(L*N_in*L)
-            f[j][(int) X[k][j]] += wi[k];
+        // Reset and update amino acid frequencies f[j][a]; columns are independent
+#pragma omp parallel for schedule(static) if(parallel && (long) nact * ncol > NCELLS_PARALLEL)
+        for (int jj = jmin; jj <= jmax; ++jj) {
+          float* fj = f[jj];
+          const char* Xj = Xcol + (size_t) jj * Xcol_stride;
+          memset(fj, 0, ANY * sizeof(float));
+          for (int e = 0; e < nact; ++e)  // innermost loop; O(L*N_in*L)
+            fj[(int) Xj[kact[e]]] += wi[kact[e]];
+          NormalizeTo1(fj, NAA);
         }
 
         // Add contributions to Neff[i]
         for (j = jmin; j <= jmax; ++j) {
-          NormalizeTo1(f[j], NAA);
           for (a = 0; a < 20; ++a)
             if (f[j][a] > 1E-10)
               Neff[i] -= f[j][a] * fast_log2(f[j][a]);
@@ -2575,7 +2786,7 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
       q->f[i][a] = 0;
     for (k = 0; k < N_in; ++k)
       if (in[k])
-        q->f[i][(int) X[k][i]] += wi[k];
+        q->f[i][(int) Xi[k]] += wi[k];
     NormalizeTo1(q->f[i], NAA, pb);
 
     // Calculate transition probabilities from M state
@@ -2585,13 +2796,13 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
       if (!in[k])
         continue;
       //if input alignment is local ignore transitions from and to end gaps
-      if (X[k][i] < ANY)            //current state is M
+      if (Xi[k] < ANY)            //current state is M
           {
         if (I[k][i])             //next state is I
           q->tr[i][M2I] += wi[k];
-        else if (X[k][i + 1] <= ANY)  //next state is M
+        else if (Xnext[k] <= ANY)  //next state is M
           q->tr[i][M2M] += wi[k];
-        else if (X[k][i + 1] == GAP)  //next state is D
+        else if (Xnext[k] == GAP)  //next state is D
           q->tr[i][M2D] += wi[k];
       }
     }  // end for(k)
@@ -2615,6 +2826,9 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
     for (j = 1; j <= L; ++j)
       free(w_contrib[j]);
     delete[] (w_contrib);
+    delete[] kenter;
+    delete[] kleave;
+    delete[] kact;
   }
   delete [] wi;
   // Delete f[j]
@@ -2645,15 +2859,17 @@ void Alignment::Amino_acid_frequencies_and_transitions_from_M_state(HMM* q, char
     q->Neff_HMM /= L;
     float Nlim = fmax(10.0, q->Neff_HMM + 1.0);    // limiting Neff
     float scale = flog2((Nlim - q->Neff_HMM) / (Nlim - 1.0));  // for calculating Neff for those seqs with inserts at specific pos
-    for (i = 1; i <= L; ++i) {
+#pragma omp parallel for schedule(static) if(parallel)
+    for (int ii = 1; ii <= L; ++ii) {
+      const char* Xi = Xcol + (size_t) ii * Xcol_stride;
       float w_M = -1.0 / N_filtered;
-      for (k = 0; k < N_in; ++k)
-        if (in[k] && X[k][i] <= ANY)
-          w_M += wg[k];
+      for (int kk = 0; kk < N_in; ++kk)
+        if (in[kk] && Xi[kk] <= ANY)
+          w_M += wg[kk];
       if (w_M < 0)
-        q->Neff_M[i] = 1.0;
+        q->Neff_M[ii] = 1.0;
       else
-        q->Neff_M[i] = Nlim - (Nlim - 1.0) * fpow2(scale * w_M);
+        q->Neff_M[ii] = Nlim - (Nlim - 1.0) * fpow2(scale * w_M);
 //        fprintf(stderr,"M  i=%3i  ncol=---  Neff_M=%5.2f  Nlim=%5.2f  w_M=%5.3f  Neff_M=%5.2f\n",i,q->Neff_HMM,Nlim,w_M,q->Neff_M[i]);
     }
   } else {
@@ -3317,15 +3533,17 @@ void Alignment::Transitions_from_D_state(HMM* q, char* in) {
       float w_D = -1.0 / N_filtered;
       ncol = 0;
       q->tr[i][D2M] = q->tr[i][D2D] = 0.0;
+      const char* Xi = Xcol + (size_t) i * Xcol_stride;
+      const char* Xnext = Xi + Xcol_stride;
       // Calculate amino acid frequencies fj[a] from weights wg[k]
       for (k = 0; k < N_in; ++k)  //for all sequences
-        if (in[k] && X[k][i] == GAP)            //current state is D
+        if (in[k] && Xi[k] == GAP)            //current state is D
             {
           ncol++;
           w_D += wg[k];
-          if (X[k][i + 1] == GAP)      //next state is D
+          if (Xnext[k] == GAP)      //next state is D
             q->tr[i][D2D] += wi[k];
-          else if (X[k][i + 1] <= ANY)  //next state is M
+          else if (Xnext[k] <= ANY)  //next state is M
             q->tr[i][D2M] += wi[k];
         }
       if (ncol > 0) {
@@ -3669,7 +3887,7 @@ void Alignment::MergeMasterSlave(Hit& hit, Alignment& Tali, char* ta3mfile,
     X[N_in] = initX(h);
     if (!X[N_in])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
-    I[N_in] = new short unsigned int[h];
+    I[N_in] = initI(h);
     if (!I[N_in])
       MemoryError("array for input sequences", __FILE__, __LINE__, __func__);
     sname[N_in] = new char[strlen(Tali.sname[k]) + 1];
@@ -3708,6 +3926,7 @@ void Alignment::AddSequence(char Xk[], int Ik[]) {
     InternalError("L is not set in AddSequence()", __FILE__, __LINE__,
                   __func__);
   X[N_in] = initX(L + 2);
+  I[N_in] = initI(L + 2);
   for (i = 0; i <= L + 1; ++i)
     X[N_in][i] = Xk[i];
   if (Ik == NULL)
@@ -3757,7 +3976,7 @@ void Alignment::AddSSPrediction(char seq_pred[], char seq_conf[]) {
     X[N_in] = initX(L + 2);
     for (i = 0; i < strlen(seq_pred); ++i)
       X[N_in][i] = ss2i(seq_pred[i]);
-    I[N_in] = new short unsigned int[L + 2];
+    I[N_in] = initI(L + 2);
     for (i = 0; i <= strlen(seq_pred); ++i)
       I[N_in][i] = 0;
     sname[N_in] = new char[50];
@@ -3767,6 +3986,8 @@ void Alignment::AddSSPrediction(char seq_pred[], char seq_conf[]) {
     n_display++;
   } else  // overwrite existing ss prediction
   {
+    if (kss_pred < N_converted)
+      converted[kss_pred] = 0;  // convert again in next Compress()
     strcpy(seq[kss_pred], seq_pred);
     for (i = 0; i < strlen(seq_pred); ++i)
       X[kss_pred][i] = ss2i(seq_pred[i]);
@@ -3782,7 +4003,7 @@ void Alignment::AddSSPrediction(char seq_pred[], char seq_conf[]) {
     X[N_in] = initX(L + 2);
     for (i = 0; i < strlen(seq_pred); ++i)
       X[N_in][i] = cf2i(seq_conf[i]);
-    I[N_in] = new short unsigned int[L + 2];
+    I[N_in] = initI(L + 2);
     for (i = 0; i <= strlen(seq_pred); ++i)
       I[N_in][i] = 0;
     sname[N_in] = new char[35];
@@ -3792,6 +4013,8 @@ void Alignment::AddSSPrediction(char seq_pred[], char seq_conf[]) {
     n_display++;
   } else  // overwrite existing ss prediction confidence
   {
+    if (kss_conf < N_converted)
+      converted[kss_conf] = 0;  // convert again in next Compress()
     strcpy(seq[kss_conf], seq_conf);
     for (i = 0; i < strlen(seq_pred); ++i)
       X[kss_conf][i] = cf2i(seq_conf[i]);
@@ -3913,3 +4136,7 @@ void Alignment::GetPositionSpecificWeights(float* w[],
   }
   return;
 }
+
+// Read() is compiled for input from files and from ffindex entries held in memory
+template void Alignment::Read<FILE>(FILE* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline);
+template void Alignment::Read<TextBuffer>(TextBuffer* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline);
@@ -20,6 +20,7 @@
 #include "util.h"
 #include "hhutil.h"
 #include "simd.h"
+#include "arena.h"
 
 #include "log.h"
 
@@ -57,8 +58,10 @@ public:
   ~Alignment();
   Alignment& operator=(Alignment&);
 
-  // Read alignment into X (uncompressed) in ASCII characters
-  void Read(FILE* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline=NULL);
+  // Read alignment into X (uncompressed) in ASCII characters from a FILE or TextBuffer
+  template <class Input>
+  void Read(Input* inf, char infile[], const char mark, const int maxcol, const int nseqdis, char* firstline=NULL);
+  // Read alignment from ca3m data; the residues are decoded directly into X and I for Compress()
   void ReadCompressed(ffindex_entry_t* entry, char* data,
       ffindex_index_t* ffindex_sequence_database_index, char* ffindex_sequence_database_data,
       ffindex_index_t* ffindex_header_database_index, char* ffindex_header_database_data,
@@ -131,9 +134,27 @@ private:
   int* first;             // first residue in sequence k
   int* last;              // last  residue in sequence k
   int* ksort;             // index for sorting sequences: X[ksort[k]]
+  char* converted;        // converted[k]>0 if X[k], I[k] still hold the a3m match states of seq[k] from the last Compress() (value = kind of sequence)
+  int N_converted;        // converted[k] is valid for k < N_converted; sequences appended later are always converted
+  int L_converted;        // number of match states at the last Compress()
+  char* Xcol;             // Xcol[i*Xcol_stride+k] = X[k][i]: column-major copy of X, only valid within FrequenciesAndTransitions()
+  int Xcol_stride;        // N_in rounded up to a multiple of ALIGN_INT
   int maxseq;
   int maxres;
+  Arena X_arena;          // memory of all residue rows X[k]
+  Arena I_arena;          // memory of all insert rows I[k]
   char * initX(int len);
+  short unsigned int * initI(int len);
+
+  // Append a residue decoded by ReadCompressed() to seq[k] and convert it into X[k], I[k]
+  void AddDecodedResidue(int k, char c, int& l, int& i);
+
+  // Free the sequences, names and per-sequence caches of the previous alignment (called by the readers)
+  void ReleaseSequences();
+
+  // Build and release the column-major residue copy Xcol for columns 0..L+1
+  void BuildColumnMajorResidues();
+  void DeleteColumnMajorResidues();
   
 };
 
@@ -0,0 +1,187 @@
+/*
+ * hhbin2txt.cpp
+ *
+ * Convert binary hit records (written with -obin, see hhhitbinary.h) to
+ * the hit list summary of HHR files or to BLAST tab (m8) format.
+ */
+
+#include "hhhitbinary.h"
+#include "ffindexdatabase.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+
+void usage() {
+  std::cout
+      << "USAGE: hhbin2txt [-m] -i [inputfile|stdin] -o [outputfile|stdout]" << std::endl
+      << "       hhbin2txt [-m] -d [ffindex_input_prefix] -o [ffindex_output_prefix]" << std::endl
+      << " -m  write BLAST tab (m8) format instead of the HHR hit list summary" << std::endl;
+}
+
+// Convert all binary hit records in data[0..size) and append them to out
+// Records that are not 8-byte aligned (e.g. ffindex entries) are copied before they are read
+bool convert(const char* data, size_t size, const bool m8, std::ostream& out) {
+  std::vector<uint64_t> aligned;
+  while (size >= sizeof(HitBinaryHeader)) {
+    if ((uintptr_t) data % sizeof(uint64_t)) {
+      aligned.resize(size / sizeof(uint64_t) + 1);
+      memcpy(&aligned[0], data, size);
+      data = (const char*) &aligned[0];
+    }
+
+    const HitBinaryHeader* header = ReadHitBinaryHeader(data, size);
+    if (header == NULL)
+      return false;
+
+    if (m8)
+      PrintHitBinaryM8(data, out);
+    else
+      PrintHitBinarySummary(data, out);
+
+    data += header->size;
+    size -= header->size;
+  }
+  return true;
+}
+
+int convert_file(const std::string& input, const std::string& output, const bool m8) {
+  std::istream* in;
+  if (input.compare("stdin") != 0) {
+    in = new std::ifstream(input.c_str(), std::ios::binary | std::ios::in);
+    if (!in->good()) {
+      std::cerr << "ERROR: Could not open input file " << input << "!" << std::endl;
+      return 1;
+    }
+  }
+  else {
+    in = &std::cin;
+  }
+
+  std::stringstream buffer;
+  buffer << in->rdbuf();
+  std::string content = buffer.str();
+  if (in != &std::cin)
+    delete in;
+
+  std::ostream* out;
+  if (output.compare("stdout") != 0) {
+    out = new std::ofstream(output.c_str(), std::ios::out);
+  }
+  else {
+    out = &std::cout;
+  }
+
+  bool ok = convert(content.data(), content.size(), m8, *out);
+  out->flush();
+  if (out != &std::cout)
+    delete out;
+
+  if (!ok) {
+    std::cerr << "ERROR: " << input << " does not contain valid binary hit records!" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int convert_ffindex(const std::string& input, const std::string& output, const bool m8) {
+  std::string dataFile = input + ".ffdata";
+  std::string indexFile = input + ".ffindex";
+
+  FFindexDatabase reader(dataFile.c_str(), indexFile.c_str(), false);
+  if (reader.db_index == NULL) {
+    std::cerr << "ERROR: Index of " << input << " could not be loaded!" << std::endl;
+    return 1;
+  }
+
+  std::string outDataFile = output + ".ffdata";
+  std::string outIndexFile = output + ".ffindex";
+  FILE* out_data_fh = fopen(outDataFile.c_str(), "w");
+  FILE* out_index_fh = fopen(outIndexFile.c_str(), "w");
+  if (out_data_fh == NULL || out_index_fh == NULL) {
+    std::cerr << "ERROR: Could not open output ffindex database " << output << "!" << std::endl;
+    return 1;
+  }
+
+  size_t offset = 0;
+  int status = 0;
+  for (size_t i = 0; i < reader.db_index->n_entries; i++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(reader.db_index, i);
+    char* entry_data = reader.getData(entry);
+
+    std::stringstream out;
+    // entries end with the \0 separator of ffindex
+    if (!convert(entry_data, entry->length - 1, m8, out)) {
+      std::cerr << "WARNING: Entry " << entry->name << " does not contain valid binary hit records!" << std::endl;
+      status = 1;
+      continue;
+    }
+
+    std::string text = out.str();
+    ffindex_insert_memory(out_data_fh, out_index_fh, &offset, const_cast<char*>(text.c_str()), text.size(), entry->name);
+  }
+
+  fclose(out_data_fh);
+  fclose(out_index_fh);
+  ffsort_index(outIndexFile.c_str());
+
+  return status;
+}
+
+int main(int argc, char **argv) {
+  bool iflag = false;
+  bool dflag = false;
+  bool oflag = false;
+  bool m8 = false;
+
+  std::string input;
+  std::string output;
+
+  int c;
+  while ((c = getopt(argc, argv, "i:d:o:mh")) != -1) {
+    switch (c) {
+      case 'i':
+        iflag = 1;
+        input = optarg;
+        break;
+      case 'd':
+        dflag = 1;
+        input = optarg;
+        break;
+      case 'o':
+        oflag = 1;
+        output = optarg;
+        break;
+      case 'm':
+        m8 = true;
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (iflag == dflag || !oflag) {
+    usage();
+    exit(0);
+  }
+
+  if (dflag)
+    return convert_ffindex(input, output, m8);
+  return convert_file(input, output, m8);
+}
@@ -40,14 +40,16 @@ HHblits::HHblits(Parameters& par, std::vector<HHblitsDatabase*>& databases) : pa
   viterbiMatrices = new ViterbiMatrix*[par.threads];
   posteriorMatrices = new PosteriorMatrix*[par.threads];
   for (int bin = 0; bin < par.threads; bin++) {
-    viterbiMatrices[bin] = new ViterbiMatrix();
-    posteriorMatrices[bin] = new PosteriorMatrix();
+    viterbiMatrices[bin] = new ViterbiMatrix(par.hugepages);
+    posteriorMatrices[bin] = new PosteriorMatrix(par.hugepages);
   }
+  viterbiRunner = new ViterbiRunner(viterbiMatrices, dbs, par.threads);
 }
 
 HHblits::~HHblits() {
   Reset();
 
+  delete viterbiRunner;
   for (int bin = 0; bin < par.threads; bin++) {
     delete viterbiMatrices[bin];
     delete posteriorMatrices[bin];
@@ -60,10 +62,7 @@ HHblits::~HHblits() {
 
 void HHblits::prepareDatabases(Parameters& par,
                                std::vector<HHblitsDatabase*>& databases) {
-  for (size_t i = 0; i < par.db_bases.size(); i++) {
-    HHblitsDatabase* db = new HHblitsDatabase(par.db_bases[i].c_str());
-    databases.push_back(db);
-  }
+  HHblitsDatabase::openDatabases(par.db_bases, true, databases);
 
   par.dbsize = 0;
   for (size_t i = 0; i < databases.size(); i++) {
@@ -72,6 +71,9 @@ void HHblits::prepareDatabases(Parameters& par,
 
   if (par.prefilter) {
     for (size_t i = 0; i < databases.size(); i++) {
+      if (par.hugepages) {
+        databases[i]->cs219_database->adviseHugePages();
+      }
       databases[i]->initPrefilter(par.cs_library);
     }
   }
@@ -235,6 +237,10 @@ void HHblits::help(Parameters& par, char all) {
   printf(" -blasttab <name> write result in tabular BLAST format (compatible to -m 8 or -outfmt 6 output)\n");
   printf("                  1     2      3           4      5         6        7      8    9      10   11   12\n");
   printf("                  query target #match/tLen alnLen #mismatch #gapOpen qstart qend tstart tend eval score\n");
+  if (all) {
+    printf(" -obin <file>   write hits of the hit list in binary format (convert with hhbin2txt)\n");
+    printf(" -obin_paths    add alignment paths to the binary hits (default=off)\n");
+  }
   printf(" -add_cons      generate consensus sequence as master sequence of query MSA (default=don't)\n");
   printf(" -hide_cons     don't show consensus sequence in alignments (default=show)     \n");
   printf(" -hide_pred     don't show predicted 2ndary structure in alignments (default=show)\n");
@@ -394,6 +400,7 @@ void HHblits::help(Parameters& par, char all) {
     printf(" -maxseq <int>  max number of input rows (def=%5i)\n", par.maxseq);
     printf(" -maxres <int>  max number of HMM columns (def=%5i)\n", par.maxres);
     printf(" -maxmem [1,inf[ limit memory for realignment (in GB) (def=%.1f)          \n", par.maxmem);
+    printf(" -hugepages     back DP matrices and cs219 data with transparent huge pages (def=off)\n");
   }
   printf("\n");
 
@@ -545,6 +552,17 @@ void HHblits::ProcessArguments(Parameters& par) {
             strcpy(par.m8file, argv[i]);
         }
     }
+    else if (!strcmp(argv[i], "-obin")) {
+      if (++i >= argc || argv[i][0] == '-') {
+        help(par);
+        HH_LOG(ERROR) << "No file following -obin" << std::endl;
+        exit(4);
+      } else {
+        strcpy(par.binfile, argv[i]);
+      }
+    }
+    else if (!strcmp(argv[i], "-obin_paths"))
+      par.binary_paths = true;
     else if (!strcmp(argv[i], "-atab")) {
       if (++i >= argc || argv[i][0] == '-') {
         help(par);
@@ -772,6 +790,8 @@ void HHblits::ProcessArguments(Parameters& par) {
       par.threads = atoi(argv[++i]);
     } else if (!strcmp(argv[i], "-maxmem") && (i < argc - 1)) {
       par.maxmem = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "-hugepages")) {
+      par.hugepages = true;
     }
     else if (!strcmp(argv[i], "-nocontxt"))
       par.nocontxt = 1;
@@ -814,7 +834,7 @@ void HHblits::ProcessArguments(Parameters& par) {
   }  // end of for-loop for command line input
 }
 
-void HHblits::mergeHitsToQuery(Hash<Hit>* previous_hits,
+void HHblits::mergeHitsToQuery(FlatHash<Hit>* previous_hits,
                                int& seqs_found, int& cluster_found, int min_col_realign) {
 
   // Remove sequences with seq. identity larger than seqid percent (remove the shorter of two)
@@ -834,9 +854,9 @@ void HHblits::mergeHitsToQuery(Hash<Hit>* previous_hits,
       continue;  // leave out too short alignments
 
     // Already in alignment
-    std::stringstream ss_tmp;
-    ss_tmp << hit_cur.file << "__" << hit_cur.irep;
-    if (previous_hits->Contains((char*) ss_tmp.str().c_str()))
+    char key[HITKEYLEN];
+    HitKey(key, hit_cur.file, hit_cur.irep);
+    if (previous_hits->Contains(key))
       continue;
 
     // Add number of sequences in this cluster to total found
@@ -884,11 +904,7 @@ void HHblits::add_hits_to_hitlist(std::vector<Hit>& hits, HitList& hitlist) {
     hitlist.Push(hits[i]);
   }
 
-  // Sort list according to sortscore
-  HH_LOG(DEBUG) << "Sorting hit list ...\n";
-  hitlist.SortList();
-
-  // Use NN prediction of lamda and mu
+  // Use NN prediction of lamda and mu; sorts the list according to the new sortscore
   hitlist.CalculatePvalues(q, par.loc, par.ssm, par.ssw);
 
   // Calculate E-values as combination of P-value for Viterbi HMM-HMM comparison and prefilter E-value: E = Ndb P (Epre/Ndb)^alpha
@@ -901,7 +917,7 @@ void HHblits::add_hits_to_hitlist(std::vector<Hit>& hits, HitList& hitlist) {
 // Perform Viterbi search on each hit object in global hash previous_hits, but keep old alignment
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void HHblits::RescoreWithViterbiKeepAlignment(HMMSimd& q_vec,
-                                              Hash<Hit>* previous_hits) {
+                                              FlatHash<Hit>* previous_hits) {
   // Initialize
   std::vector<HHEntry*> hits_to_rescore;
 
@@ -918,18 +934,17 @@ void HHblits::RescoreWithViterbiKeepAlignment(HMMSimd& q_vec,
   // Start Viterbi search through db HMMs listed in dbfiles
 //	DoViterbiSearch(hits_to_rescore, previous_hits, false);
 
-  ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-  std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
+  std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec,
                                                          hits_to_rescore,
                                                          par.qsc_db, pb, S, Sim,
                                                          R, par.ssm, S73, S33, S37);
 
   for (std::vector<Hit>::size_type i = 0; i != hits_to_add.size(); i++) {
-    std::stringstream ss_tmp;
-    ss_tmp << hits_to_add[i].file << "__" << hits_to_add[i].irep;
-    if (previous_hits->Contains((char*) ss_tmp.str().c_str())) {
-      Hit hit_cur = previous_hits->Remove((char*) ss_tmp.str().c_str());
-      previous_hits->Add((char*) ss_tmp.str().c_str(), hits_to_add[i]);
+    char key[HITKEYLEN];
+    HitKey(key, hits_to_add[i].file, hits_to_add[i].irep);
+    if (previous_hits->Contains(key)) {
+      Hit hit_cur = previous_hits->Show(key);
+      previous_hits->Add(key, hits_to_add[i]);
       // Overwrite *hit[bin] with alignment, etc. of hit_cur
       hit_cur.score = hits_to_add[i].score;
       hit_cur.score_aass = hits_to_add[i].score_aass;
@@ -947,18 +962,39 @@ void HHblits::RescoreWithViterbiKeepAlignment(HMMSimd& q_vec,
     }
   }
 
-  // Sort list according to sortscore
-  HH_LOG(DEBUG) << "Sorting hit list ..." << std::endl;
-
-  hitlist.SortList();
-
-  hitlist.CalculatePvalues(q, par.loc, par.ssm, par.ssw);  // Use NN prediction of lamda and mu
+  // Use NN prediction of lamda and mu; sorts the list according to the new sortscore
+  hitlist.CalculatePvalues(q, par.loc, par.ssm, par.ssw);
 
   if (par.prefilter)
     hitlist.CalculateHHblitsEvalues(q, par.dbsize, par.alphaa, par.alphab,
                                     par.alphac, par.prefilter_evalue_thresh);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Prefilter all databases with the query profile q_tmp; the shards of a database are
+// consecutive in dbs and are prefiltered together
+/////////////////////////////////////////////////////////////////////////////////////
+void HHblits::prefilterDatabases(FlatHash<Hit>* previous_hits, std::vector<HHEntry*>& new_entries,
+                                 std::vector<HHEntry*>& old_entries) {
+  for (size_t i = 0; i < dbs.size();) {
+    size_t end = i + 1;
+    while (end < dbs.size() && dbs[end]->shard_group == dbs[i]->shard_group) {
+      end++;
+    }
+    std::vector<HHblitsDatabase*> shards(dbs.begin() + i, dbs.begin() + end);
+    HHblitsDatabase::prefilter_db(shards, q_tmp, previous_hits, par.threads,
+                                  par.prefilter_gap_open, par.prefilter_gap_extend,
+                                  par.prefilter_score_offset,
+                                  par.prefilter_bit_factor,
+                                  par.prefilter_evalue_thresh,
+                                  par.prefilter_evalue_coarse_thresh,
+                                  par.preprefilter_smax_thresh,
+                                  par.min_prefilter_hits, par.maxnumdb, R,
+                                  new_entries, old_entries);
+    i = end;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Realign hits with MAC algorithm
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1010,6 +1046,7 @@ void HHblits::perform_realign(HMMSimd& q_vec, const char input_format,
   }
 
   int t_maxres = Lmax + 2;
+#pragma omp parallel for schedule(static, 1)
   for (int i = 0; i < par.threads; i++) {
     posteriorMatrices[i]->allocateMatrix(q->L, t_maxres);
   }
@@ -1061,7 +1098,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
   std::set<std::string> search_counter;
 
   Hit hit_cur;
-  Hash<Hit>* previous_hits = new Hash<Hit>(1631, hit_cur);
+  FlatHash<Hit>* previous_hits = new FlatHash<Hit>(1631, hit_cur);
 
   Qali = new Alignment(par.maxseq, par.maxres);
   Qali_allseqs = new Alignment(par.maxseq, par.maxres);
@@ -1073,8 +1110,10 @@ void HHblits::run(FILE* query_fh, char* query_path) {
   // Read query input file (HHM or alignment format) without adding pseudocounts
   Qali->N_in = 0;
   char input_format;
-  ReadQueryFile(par, query_fh, input_format, par.wg, q, Qali, query_path, pb, S,
+  int status = ReadQueryFile(par, query_fh, input_format, par.wg, q, Qali, query_path, pb, S,
                 Sim);
+  if (status)
+    exit(status);
 
   if (par.allseqs) {
     *Qali_allseqs = *Qali;  // make a *deep* copy of Qali!
@@ -1148,17 +1187,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
 
       q_tmp->CalculateAminoAcidBackground(pb);
 
-      for (size_t i = 0; i < dbs.size(); i++) {
-        dbs[i]->prefilter_db(q_tmp, previous_hits, par.threads,
-                             par.prefilter_gap_open, par.prefilter_gap_extend,
-                             par.prefilter_score_offset,
-                             par.prefilter_bit_factor,
-                             par.prefilter_evalue_thresh,
-                             par.prefilter_evalue_coarse_thresh,
-                             par.preprefilter_smax_thresh,
-                             par.min_prefilter_hits, par.maxnumdb, R,
-                             new_entries, old_entries);
-      }
+      prefilterDatabases(previous_hits, new_entries, old_entries);
 
       for (size_t i = 0; i < new_entries.size(); i++) {
         search_counter.insert(new_entries[i]->getName());
@@ -1178,6 +1207,8 @@ void HHblits::run(FILE* query_fh, char* query_path) {
           << std::endl;
     }
     max_template_length = std::min(max_template_length, par.maxres);
+    // each thread allocates and clears its own matrix, so that its pages are local to the thread
+#pragma omp parallel for schedule(static, 1)
     for (int i = 0; i < par.threads; i++) {
       viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
     }
@@ -1198,8 +1229,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
     }
     HH_LOG(INFO) << "Scoring " << new_entries.size() << " HMMs using HMM-HMM Viterbi alignment" << std::endl;
     // Main Viterbi HMM-HMM search
-    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-    std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
+    std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec,
                                                            new_entries,
                                                            par.qsc_db, pb, S,
                                                            Sim, R, par.ssm, S73, S33, S37);
@@ -1229,8 +1259,7 @@ void HHblits::run(FILE* query_fh, char* query_path) {
             << "Rescoring previously found HMMs with Viterbi algorithm"
             << std::endl;
 
-        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-        std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
+        std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec,
                                                                   old_entries,
                                                                   par.qsc_db, pb,
                                                                   S, Sim, R, par.ssm, S73, S33, S37);
@@ -1287,10 +1316,10 @@ void HHblits::run(FILE* query_fh, char* query_path) {
         if (hit_cur.Eval > par.e)
           continue;
 
-        std::stringstream ss_tmp;
-        ss_tmp << hit_cur.file << "__" << hit_cur.irep;
+        char key[HITKEYLEN];
+        HitKey(key, hit_cur.file, hit_cur.irep);
         // Already in alignment?
-        if (previous_hits->Contains((char*) ss_tmp.str().c_str()))
+        if (previous_hits->Contains(key))
           continue;
 
         // Add number of sequences in this cluster to total found
@@ -1362,14 +1391,14 @@ void HHblits::run(FILE* query_fh, char* query_path) {
     while (!hitlist.End()) {
       Hit hit_cur = hitlist.ReadNext();
 
-      std::stringstream ss_tmp;
-      ss_tmp << hit_cur.file << "__" << hit_cur.irep;
+      char key[HITKEYLEN];
+      HitKey(key, hit_cur.file, hit_cur.irep);
 
       if (!par.already_seen_filter || hit_cur.Eval > par.e
-          || previous_hits->Contains((char*) ss_tmp.str().c_str()))
+          || previous_hits->Contains(key))
         hit_cur.Delete();  // Delete hit object (deep delete with Hit::Delete())
       else {
-        previous_hits->Add((char*) ss_tmp.str().c_str(), hit_cur);
+        previous_hits->Add(key, hit_cur);
       }
 
       hitlist.Delete();  // Delete list record (flat delete)
@@ -1443,7 +1472,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
   std::set<std::string> search_counter;
 
   Hit hit_cur;
-  Hash<Hit>* previous_hits = new Hash<Hit>(1631, hit_cur);
+  FlatHash<Hit>* previous_hits = new FlatHash<Hit>(1631, hit_cur);
 
 
 
@@ -1531,17 +1560,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
 
       q_tmp->CalculateAminoAcidBackground(pb);
 
-      for (size_t i = 0; i < dbs.size(); i++) {
-        dbs[i]->prefilter_db(q_tmp, previous_hits, par.threads,
-                             par.prefilter_gap_open, par.prefilter_gap_extend,
-                             par.prefilter_score_offset,
-                             par.prefilter_bit_factor,
-                             par.prefilter_evalue_thresh,
-                             par.prefilter_evalue_coarse_thresh,
-                             par.preprefilter_smax_thresh,
-                             par.min_prefilter_hits, par.maxnumdb, R,
-                             new_entries, old_entries);
-      }
+      prefilterDatabases(previous_hits, new_entries, old_entries);
 
       for (size_t i = 0; i < new_entries.size(); i++) {
         search_counter.insert(new_entries[i]->getName());
@@ -1561,6 +1580,8 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
           << std::endl;
     }
     max_template_length = std::min(max_template_length, par.maxres);
+    // each thread allocates and clears its own matrix, so that its pages are local to the thread
+#pragma omp parallel for schedule(static, 1)
     for (int i = 0; i < par.threads; i++) {
       viterbiMatrices[i]->AllocateBacktraceMatrix(q->L, max_template_length);
     }
@@ -1585,8 +1606,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
                            << std::endl;
 
     // Main Viterbi HMM-HMM search
-    ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-    std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
+    std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec,
                                                            new_entries,
                                                            par.qsc_db, pb, S,
                                                            Sim, R, par.ssm, S73, S33, S37);
@@ -1616,8 +1636,7 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
             << "Rescoring previously found HMMs with Viterbi algorithm"
             << std::endl;
 
-        ViterbiRunner viterbirunner(viterbiMatrices, dbs, par.threads);
-        std::vector<Hit> hits_to_add = viterbirunner.alignment(par, &q_vec,
+        std::vector<Hit> hits_to_add = viterbiRunner->alignment(par, &q_vec,
                                                                   old_entries,
                                                                   par.qsc_db, pb,
                                                                   S, Sim, R, par.ssm, S73, S33, S37);
@@ -1674,10 +1693,10 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
         if (hit_cur.Eval > par.e)
           continue;
 
-        std::stringstream ss_tmp;
-        ss_tmp << hit_cur.file << "__" << hit_cur.irep;
+        char key[HITKEYLEN];
+        HitKey(key, hit_cur.file, hit_cur.irep);
         // Already in alignment?
-        if (previous_hits->Contains((char*) ss_tmp.str().c_str()))
+        if (previous_hits->Contains(key))
           continue;
 
         // Add number of sequences in this cluster to total found
@@ -1750,14 +1769,14 @@ void HHblits::run(ffindex_entry_t* entry, char* data,
     while (!hitlist.End()) {
       Hit hit_cur = hitlist.ReadNext();
 
-      std::stringstream ss_tmp;
-      ss_tmp << hit_cur.file << "__" << hit_cur.irep;
+      char key[HITKEYLEN];
+      HitKey(key, hit_cur.file, hit_cur.irep);
 
       if (!par.already_seen_filter || hit_cur.Eval > par.e
-          || previous_hits->Contains((char*) ss_tmp.str().c_str()))
+          || previous_hits->Contains(key))
         hit_cur.Delete();  // Delete hit object (deep delete with Hit::Delete())
       else {
-        previous_hits->Add((char*) ss_tmp.str().c_str(), hit_cur);
+        previous_hits->Add(key, hit_cur);
       }
 
       hitlist.Delete();  // Delete list record (flat delete)
@@ -1820,6 +1839,12 @@ void HHblits::writeM8(char* m8File) {
     }
 }
 
+void HHblits::writeBinaryFile(char* binFile) {
+  if (*binFile) {
+    hitlist.WriteBinaryFile(q, binFile, par.z, par.Z, par.p, par.E, par.binary_paths);
+  }
+}
+
 void HHblits::writePairwiseAlisFile(char* pairwiseAlisFile, char outformat) {
   if (*pairwiseAlisFile) {
     hitlist.PrintAlignments(q, pairwiseAlisFile, par.showconf, par.showcons,
@@ -1902,6 +1927,11 @@ void HHblits::writeM8(HHblits& hhblits, std::stringstream& out) {
   hhblits.hitlist.PrintM8File(hhblits.q, out, hhblits.par.nseqdis, hhblits.par.p, hhblits.par.b, hhblits.par.E);
 }
 
+void HHblits::writeBinaryFile(HHblits& hhblits, std::stringstream& out) {
+  hhblits.hitlist.WriteBinaryFile(hhblits.q, out, hhblits.par.z, hhblits.par.Z,
+                                  hhblits.par.p, hhblits.par.E, hhblits.par.binary_paths);
+}
+
 void HHblits::writePairwiseAlisFile(HHblits& hhblits, std::stringstream& out) {
   hhblits.hitlist.PrintAlignments(hhblits.q, out, hhblits.par.showconf,
                                   hhblits.par.showcons, hhblits.par.showdssp,
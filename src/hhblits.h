@@ -41,7 +41,7 @@ extern "C" {
 
 #include "hhdecl.h"
 #include "list.h"
-#include "hash.h"
+#include "flathash.h"
 #include "util.h"
 #include "hhutil.h"
 
@@ -86,6 +86,7 @@ public:
   void writeAlisFile(char* basename);
   void writeScoresFile(char* scoresFile);
   void writeM8(char* m8File);
+  void writeBinaryFile(char* binFile);
   void writePairwiseAlisFile(char* pairwieseAlisFile, char outformat);
   void writeAlitabFile(char* alitabFile);
   void writePsiFile(char* psiFile);
@@ -97,6 +98,7 @@ public:
   static void writeHHRFile(HHblits& hhblits, std::stringstream& out);
   static void writeScoresFile(HHblits& hhblits, std::stringstream& out);
   static void writeM8(HHblits& hhblits, std::stringstream& out);
+  static void writeBinaryFile(HHblits& hhblits, std::stringstream& out);
   static void writePairwiseAlisFile(HHblits& hhblits, std::stringstream& out);
   static void writeAlitabFile(HHblits& hhblits, std::stringstream& out);
   static void writePsiFile(HHblits& hhblits, std::stringstream& out);
@@ -148,19 +150,22 @@ protected:
 
 	ViterbiMatrix** viterbiMatrices;
 	PosteriorMatrix** posteriorMatrices;
+	// Viterbi search shared by all iterations, keeps its template HMMs between searches
+	ViterbiRunner* viterbiRunner;
 
 	HitList hitlist; // list of hits with one Hit object for each pairwise comparison done
 	std::map<int, Alignment*> alis;
 
+	void prefilterDatabases(FlatHash<Hit>* previous_hits, std::vector<HHEntry*>& new_entries, std::vector<HHEntry*>& old_entries);
 	void perform_realign(HMMSimd& q_vec, const char input_format, std::vector<HHEntry*>& hits_to_realign, int min_col_realign);
-	void mergeHitsToQuery(Hash<Hit>* previous_hits, int& seqs_found, int& cluster_found, int min_col_realign);
+	void mergeHitsToQuery(FlatHash<Hit>* previous_hits, int& seqs_found, int& cluster_found, int min_col_realign);
 	void add_hits_to_hitlist(std::vector<Hit>& hits, HitList& hitlist);
 
 
 private:
 	static void help(Parameters& par, char all = 0);
 	static void ProcessArguments(Parameters& par);
-	void RescoreWithViterbiKeepAlignment(HMMSimd& q_vec, Hash<Hit>* previous_hits);
+	void RescoreWithViterbiKeepAlignment(HMMSimd& q_vec, FlatHash<Hit>* previous_hits);
 };
 
 #endif /* HHBLITS_H_ */
@@ -65,6 +65,7 @@ int main(int argc, const char **argv) {
   app.writeAlisFile(par.alisbasename);
   app.writeScoresFile(par.scorefile);
   app.writeM8(par.m8file);
+  app.writeBinaryFile(par.binfile);
   app.writePairwiseAlisFile(par.pairwisealisfile, par.outformat);
   app.writeAlitabFile(par.alitabfile);
   app.writePsiFile(par.psifile);
@@ -224,6 +224,7 @@ int main(int argc, const char **argv) {
   makeOutputFFIndex(par.alnfile, &HHblits::writeA3MFile, outputDatabases);
   makeOutputFFIndex(par.matrices_output_file, &HHblits::writeMatricesFile, outputDatabases);
   makeOutputFFIndex(par.m8file, &HHblits::writeM8, outputDatabases);
+  makeOutputFFIndex(par.binfile, &HHblits::writeBinaryFile, outputDatabases);
 
   std::vector<HHblitsDatabase*> databases;
   HHblits::prepareDatabases(par, databases);
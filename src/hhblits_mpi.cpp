@@ -7,6 +7,7 @@
 
 #include "hhsearch.h"
 #include "hhalign.h"
+#include "ext/fmemopen.h"
 
 #include <mpi.h>
 
@@ -93,15 +94,13 @@ void merge_splits(const char *prefix) {
 }
 
 struct HHblits_MPQ_Wrapper {
-    char *data;
-    ffindex_index_t *index;
+    FFindexDatabase *reader;
     HHblits *hhblits;
     std::vector<OutputFFIndex> *outputDatabases;
 
-    HHblits_MPQ_Wrapper(char *data, ffindex_index_t *index, HHblits &hhblits,
+    HHblits_MPQ_Wrapper(FFindexDatabase &reader, HHblits &hhblits,
                         std::vector<OutputFFIndex> &outputDatabases) {
-        this->data = data;
-        this->index = index;
+        this->reader = &reader;
         this->hhblits = &hhblits;
         this->outputDatabases = &outputDatabases;
     }
@@ -109,14 +108,23 @@ struct HHblits_MPQ_Wrapper {
     void Payload(const size_t start, const size_t end) {
         // Foreach entry in the input file
         for (size_t entry_index = start; entry_index < end; entry_index++) {
-            ffindex_entry_t *entry = ffindex_get_entry_by_index(index, entry_index);
+            ffindex_entry_t *entry = ffindex_get_entry_by_index(reader->db_index, entry_index);
             if (entry == NULL) {
                 continue;
             }
 
+            // the query database may be block-compressed; getData inflates into a buffer that the
+            // database reads of the search reuse, so the query is copied first
+            char *data = reader->getData(entry);
+            if (data == NULL) {
+                HH_LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
+                continue;
+            }
+            std::string query(data, entry->length);
+
             hhblits->Reset();
 
-            FILE *inf = ffindex_fopen_by_entry(data, entry);
+            FILE *inf = fmemopen(&query[0], query.size(), "r");
             hhblits->run(inf, entry->name);
             fclose(inf);
 
@@ -182,6 +190,8 @@ int main(int argc, const char **argv) {
                               outputDatabases);
             makeOutputFFIndex(par.m8file, MPQ_rank, &HHblits::writeM8,
                               outputDatabases);
+            makeOutputFFIndex(par.binfile, MPQ_rank, &HHblits::writeBinaryFile,
+                              outputDatabases);
 
             std::vector<HHblitsDatabase*> databases;
 #ifdef HHSEARCH
@@ -194,7 +204,7 @@ int main(int argc, const char **argv) {
             HHblits app(par, databases);
 #endif
 
-            HHblits_MPQ_Wrapper wrapper(reader.db_data, reader.db_index, app, outputDatabases);
+            HHblits_MPQ_Wrapper wrapper(reader, app, outputDatabases);
             MPQ_Worker(payload, &wrapper);
 
             for (size_t i = 0; i < outputDatabases.size(); i++) {
@@ -214,6 +224,7 @@ int main(int argc, const char **argv) {
             merge_splits(par.alnfile);
             merge_splits(par.matrices_output_file);
             merge_splits(par.m8file);
+            merge_splits(par.binfile);
         }
     } else {
         if (mpq_status == MPQ_ERROR_NO_WORKERS) {
@@ -7,72 +7,34 @@
 
 #include "hhsearch.h"
 #include "hhalign.h"
+#include "ext/fmemopen.h"
 
 #ifdef OPENMP
 #include <omp.h>
 #endif
 
+// Output ffindex database of one output type.
+// Every thread writes its results into its own shard of the writer without locking and flushing;
+// the shards are merged into <base>.ffdata, <base>.ffindex at the end
 struct OutputFFIndex {
-    char base[NAMELEN];
-    FILE *data_fh;
-    FILE *index_fh;
-    size_t offset;
-    size_t number_entries;
+    FFindexShardedWriter* writer;
 
     void (*print)(HHblits &, std::stringstream &);
 
-    void close() {
-        char index_filename[NAMELEN];
-        snprintf(index_filename, FILENAME_MAX, "%s.ffindex", base);
-
-        fclose(index_fh);
-        fclose(data_fh);
-
-        ffsort_index(index_filename);
-    }
-
-    void saveOutput(HHblits &hhblits, char *name) {
+    void saveOutput(HHblits &hhblits, const int bin, char *name) {
         std::stringstream out;
         print(hhblits, out);
-
-        std::string tmp = out.str();
-        ffindex_insert_memory(data_fh, index_fh, &offset, const_cast<char *>(tmp.c_str()), tmp.size(), name);
-
-        fflush(data_fh);
-        fflush(index_fh);
-        number_entries++;
+        writer->insert(bin, out.str(), name);
     }
 };
 
 
-void makeOutputFFIndex(char *par, void (*print)(HHblits &, std::stringstream &), std::vector<OutputFFIndex> &outDatabases) {
+void makeOutputFFIndex(char *par, const int shards, void (*print)(HHblits &, std::stringstream &),
+                       std::vector<OutputFFIndex> &outDatabases) {
     if (*par) {
         OutputFFIndex db;
-
-        strcpy(db.base, par);
-        db.offset = 0;
+        db.writer = new FFindexShardedWriter(par, shards);
         db.print = print;
-        db.number_entries = 0;
-
-        char data_filename_out_rank[NAMELEN];
-        char index_filename_out_rank[NAMELEN];
-
-        snprintf(data_filename_out_rank, FILENAME_MAX, "%s.ffdata", par);
-        snprintf(index_filename_out_rank, FILENAME_MAX, "%s.ffindex", par);
-
-        db.data_fh = fopen(data_filename_out_rank, "w+");
-        db.index_fh = fopen(index_filename_out_rank, "w+");
-
-        if (db.data_fh == NULL) {
-            HH_LOG(ERROR) << "Could not open datafile " << data_filename_out_rank << "!" << std::endl;
-            return;
-        }
-
-        if (db.index_fh == NULL) {
-            HH_LOG(ERROR) << "Could not open indexfile " << index_filename_out_rank << "!" << std::endl;
-            return;
-        }
-
         outDatabases.push_back(db);
     }
 }
@@ -104,20 +66,22 @@ int main(int argc, const char **argv) {
     HHblits::prepareDatabases(par, databases);
 #endif
 
-    std::vector<OutputFFIndex> outputDatabases;
-    makeOutputFFIndex(par.outfile, &HHblits::writeHHRFile, outputDatabases);
-    makeOutputFFIndex(par.scorefile, &HHblits::writeScoresFile, outputDatabases);
-    makeOutputFFIndex(par.pairwisealisfile, &HHblits::writePairwiseAlisFile, outputDatabases);
-    makeOutputFFIndex(par.alitabfile, &HHblits::writeAlitabFile, outputDatabases);
-    makeOutputFFIndex(par.psifile, &HHblits::writePsiFile, outputDatabases);
-    makeOutputFFIndex(par.hhmfile, &HHblits::writeHMMFile, outputDatabases);
-    makeOutputFFIndex(par.alnfile, &HHblits::writeA3MFile, outputDatabases);
-    makeOutputFFIndex(par.matrices_output_file, &HHblits::writeMatricesFile, outputDatabases);
-    makeOutputFFIndex(par.m8file, &HHblits::writeM8, outputDatabases);
-
     // only parallelize over queries, not per query
     int threads = par.threads;
     par.threads = 1;
+    int shards = std::max(threads, 1);
+
+    std::vector<OutputFFIndex> outputDatabases;
+    makeOutputFFIndex(par.outfile, shards, &HHblits::writeHHRFile, outputDatabases);
+    makeOutputFFIndex(par.scorefile, shards, &HHblits::writeScoresFile, outputDatabases);
+    makeOutputFFIndex(par.pairwisealisfile, shards, &HHblits::writePairwiseAlisFile, outputDatabases);
+    makeOutputFFIndex(par.alitabfile, shards, &HHblits::writeAlitabFile, outputDatabases);
+    makeOutputFFIndex(par.psifile, shards, &HHblits::writePsiFile, outputDatabases);
+    makeOutputFFIndex(par.hhmfile, shards, &HHblits::writeHMMFile, outputDatabases);
+    makeOutputFFIndex(par.alnfile, shards, &HHblits::writeA3MFile, outputDatabases);
+    makeOutputFFIndex(par.matrices_output_file, shards, &HHblits::writeMatricesFile, outputDatabases);
+    makeOutputFFIndex(par.m8file, shards, &HHblits::writeM8, outputDatabases);
+    makeOutputFFIndex(par.binfile, shards, &HHblits::writeBinaryFile, outputDatabases);
 
 #pragma omp parallel num_threads(threads)
     {
@@ -143,7 +107,11 @@ int main(int argc, const char **argv) {
                 continue;
             }
 
-            FILE *inf = ffindex_fopen_by_entry(reader.db_data, entry);
+            // the query database may be block-compressed; getData inflates into a buffer that the
+            // database reads of the search reuse, so the query is copied first
+            char *data = reader.getData(entry);
+            std::string query = data != NULL ? std::string(data, entry->length) : std::string();
+            FILE *inf = data != NULL ? fmemopen(&query[0], query.size(), "r") : NULL;
             if (inf == NULL) {
                 HH_LOG(WARNING) << "Could not open input entry (" << entry->name << ")!" << std::endl;
                 continue;
@@ -151,12 +119,10 @@ int main(int argc, const char **argv) {
 
             HH_LOG(INFO) << "Thread " << bin << "\t" << entry->name << std::endl;
             app.run(inf, entry->name);
+            fclose(inf);
 
-#pragma omp critical
-            {
-                for (size_t i = 0; i < outputDatabases.size(); ++i) {
-                    outputDatabases[i].saveOutput(app, entry->name);
-                }
+            for (size_t i = 0; i < outputDatabases.size(); ++i) {
+                outputDatabases[i].saveOutput(app, bin, entry->name);
             }
 
             app.Reset();
@@ -164,7 +130,8 @@ int main(int argc, const char **argv) {
     }
 
     for (size_t i = 0; i < outputDatabases.size(); ++i) {
-        outputDatabases[i].close();
+        outputDatabases[i].writer->merge();
+        delete outputDatabases[i].writer;
     }
 
     for (size_t i = 0; i < databases.size(); ++i) {
@@ -13,6 +13,8 @@
 #include <errno.h>    // perror()
 #include <cassert>
 #include <stdexcept>
+#include <sstream>
+#include <string>
 
 #include "hhsuite_config.h"
 #include "cs.h"          // context-specific pseudocounts
@@ -31,6 +33,7 @@
 #include "hhalignment.h" // class Alignment
 #include "hhhalfalignment.h" // class HalfAlignment
 #include "hhfunc.h"      // some functions common to hh programs
+#include "ffindexdatabase.h" // class FFindexDatabase, FFindexShardedWriter, ForEachEntryParallel
 
 // Help functions
 void help(Parameters& par) {
@@ -40,8 +43,15 @@ void help(Parameters& par) {
   printf("%s", REFERENCE);
   printf("\n");
   printf("Usage: hhconsensus -i <file> [options]                           \n");
+  printf("       hhconsensus -i <ffindex> -s <ffindex> -ffindex [options]    \n");
   printf(
       " -i <file>     query alignment (A2M, A3M, or FASTA), or query HMM          \n");
+  printf(
+      " -ffindex      -i, -s and -o are ffindex database basenames: calculate the \n");
+  printf(
+      "               consensus of all entries of <i>.ff{data,index}              \n");
+  printf(
+      " -cpu <int>    number of threads with -ffindex (def=%i)                    \n", par.threads);
   printf("\n");
   printf(
       "Output options:                                                            \n");
@@ -97,7 +107,7 @@ void help(Parameters& par) {
 /////////////////////////////////////////////////////////////////////////////////////
 //// Processing input options from command line
 /////////////////////////////////////////////////////////////////////////////////////
-void ProcessArguments(Parameters& par) {
+void ProcessArguments(Parameters& par, bool& ffindex) {
   const int argc = par.argc;
   const char** argv = par.argv;
 
@@ -171,6 +181,10 @@ void ProcessArguments(Parameters& par) {
 		par.v = Log::from_int(v);
 		Log::reporting_level() = par.v;
     }
+    else if (!strcmp(argv[i], "-ffindex"))
+      ffindex = true;
+    else if (!strcmp(argv[i], "-cpu") && (i < argc - 1))
+      par.threads = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-seq") && (i < argc - 1))
       par.nseqdis = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-id") && (i < argc - 1))
@@ -269,6 +283,175 @@ void ProcessArguments(Parameters& par) {
   } // end of for-loop for command line input
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+//// Add pseudocounts to the query HMM and calculate its amino acid background
+//// Same code as in PrepareQueryHMM(par.infile,input_format,q,qali), except that we add SS prediction
+/////////////////////////////////////////////////////////////////////////////////////
+void PrepareConsensusHMM(Parameters& par, char input_format, HMM* q,
+    cs::Pseudocounts<cs::AA>* pc_hhm_context_engine, cs::Admix* pc_hhm_context_mode,
+    float* pb, const float R[20][20]) {
+  // Add Pseudocounts, if no HMMER input
+  if (input_format == 0) {
+    // Transform transition freqs to lin space if not already done
+    q->AddTransitionPseudocounts(par.gapd, par.gape, par.gapf, par.gapg,
+        par.gaph, par.gapi, par.gapb, par.gapb);
+
+    // Comput substitution matrix pseudocounts
+    if (par.nocontxt) {
+      // Generate an amino acid frequency matrix from f[i][a] with full pseudocount admixture (tau=1) -> g[i][a]
+      q->PreparePseudocounts(R);
+      // Add amino acid pseudocounts to query: p[i][a] = (1-tau)*f[i][a] + tau*g[i][a]
+      q->AddAminoAcidPseudocounts(par.pc_hhm_nocontext_mode,
+          par.pc_hhm_nocontext_a, par.pc_hhm_nocontext_b,
+          par.pc_hhm_nocontext_c);
+    }
+    else {
+      // Add full context specific pseudocounts to query
+      q->AddContextSpecificPseudocounts(pc_hhm_context_engine,
+          pc_hhm_context_mode);
+    }
+  }
+  else {
+    q->AddAminoAcidPseudocounts(0, par.pc_hhm_nocontext_a,
+        par.pc_hhm_nocontext_b, par.pc_hhm_nocontext_c);
+  }
+
+  q->CalculateAminoAcidBackground(pb);
+
+  if (par.columnscore == 5 && !q->divided_by_local_bg_freqs)
+    q->DivideBySqrtOfLocalBackgroundFreqs(
+        par.half_window_size_local_aa_bg_freqs, pb);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Build the output alignment with consensus sequence of q in the format par.outformat
+/////////////////////////////////////////////////////////////////////////////////////
+void BuildConsensusAlignment(Parameters& par, HMM* q, HalfAlignment& qa) {
+  int n = imin(q->n_display,
+      par.nseqdis + (q->nss_dssp >= 0) + (q->nss_pred >= 0)
+          + (q->nss_conf >= 0) + (q->ncons >= 0));
+  qa.Set(q->name, q->seq, q->sname, n, q->L, q->nss_dssp, q->nss_pred,
+      q->nss_conf, q->nsa_dssp, q->ncons);
+
+  if (par.outformat == 1)
+    qa.BuildFASTA();
+  else if (par.outformat == 2)
+    qa.BuildA2M();
+  else if (par.outformat == 3)
+    qa.BuildA3M();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Calculates the consensus sequences of the entries of an ffindex database, see ConsensusDatabase
+/////////////////////////////////////////////////////////////////////////////////////
+class ConsensusCalculator : public FFindexEntryProcessor {
+public:
+  ConsensusCalculator(Parameters& par, cs::Pseudocounts<cs::AA>* pc_hhm_context_engine,
+      cs::Admix* pc_hhm_context_mode, float* pb, const float R[20][20], const float S[20][20],
+      const float Sim[20][20], FFindexShardedWriter* seq_writer, FFindexShardedWriter* aln_writer,
+      const int threads)
+      : par(par), pc_hhm_context_engine(pc_hhm_context_engine), pc_hhm_context_mode(pc_hhm_context_mode),
+        pb(pb), R(R), S(S), Sim(Sim), seq_writer(seq_writer), aln_writer(aln_writer), work(threads, NULL),
+        hmm(threads, NULL) {
+  }
+
+  // every thread reuses one alignment (sized for par.maxseq) and one HMM for all its entries
+  void beginThread(const int thread) {
+    work[thread] = new Alignment(par.maxseq, par.maxres);
+    hmm[thread] = new HMM(MAXSEQDIS, par.maxres);
+  }
+
+  void endThread(const int thread) {
+    delete work[thread];
+    delete hmm[thread];
+  }
+
+  void process(const int thread, ffindex_entry_t* entry, char* data) {
+    HMM& q = *hmm[thread];
+    q.Reset();
+    RemoveExtension(q.file, entry->name);
+
+    TextBuffer buffer(data, entry->length);
+    char input_format = 0;
+    if (ReadQueryFile(par, &buffer, input_format, par.wg, &q, NULL, entry->name, pb, S, Sim, work[thread])) {
+      HH_LOG(WARNING) << "Skipping unreadable entry " << entry->name << "!" << std::endl;
+      return;
+    }
+    PrepareConsensusHMM(par, input_format, &q, pc_hhm_context_engine, pc_hhm_context_mode, pb, R);
+
+    std::stringstream out;
+    if (seq_writer) {
+      out << ">" << q.longname << "\n" << q.seq[q.nfirst] + 1 << "\n";
+      seq_writer->insert(thread, out.str(), entry->name);
+    }
+
+    if (aln_writer) {
+      HalfAlignment qa(MAXSEQDIS);
+      BuildConsensusAlignment(par, &q, qa);
+      out.str("");
+      qa.Print(out, q.longname);
+      aln_writer->insert(thread, out.str(), entry->name);
+    }
+  }
+
+private:
+  Parameters& par;
+  cs::Pseudocounts<cs::AA>* pc_hhm_context_engine;
+  cs::Admix* pc_hhm_context_mode;
+  float* pb;
+  const float (*R)[20];
+  const float (*S)[20];
+  const float (*Sim)[20];
+  FFindexShardedWriter* seq_writer;
+  FFindexShardedWriter* aln_writer;
+  std::vector<Alignment*> work;
+  std::vector<HMM*> hmm;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Calculate the consensus sequences of all entries of the ffindex database par.infile
+//// in parallel and write them to par.outfile and the alignments to par.alnfile
+/////////////////////////////////////////////////////////////////////////////////////
+void ConsensusDatabase(Parameters& par, cs::Pseudocounts<cs::AA>* pc_hhm_context_engine,
+    cs::Admix* pc_hhm_context_mode, float* pb, const float R[20][20],
+    const float S[20][20], const float Sim[20][20]) {
+  std::string data_filename = std::string(par.infile) + ".ffdata";
+  std::string index_filename = std::string(par.infile) + ".ffindex";
+  FFindexDatabase reader(data_filename.c_str(), index_filename.c_str(), false);
+  if (reader.db_index == NULL) {
+    HH_LOG(ERROR) << "Could not read index " << index_filename << "!" << std::endl;
+    exit(1);
+  }
+
+  int threads = 1;
+#ifdef OPENMP
+  threads = std::max(par.threads, 1);
+#endif
+  FFindexShardedWriter* seq_writer = NULL;
+  FFindexShardedWriter* aln_writer = NULL;
+  if (*par.outfile)
+    seq_writer = new FFindexShardedWriter(par.outfile, threads);
+  if (*par.alnfile)
+    aln_writer = new FFindexShardedWriter(par.alnfile, threads);
+
+  ConsensusCalculator calculator(par, pc_hhm_context_engine, pc_hhm_context_mode, pb, R, S, Sim,
+      seq_writer, aln_writer, threads);
+  ForEachEntryParallel(reader, threads, calculator);
+
+  if (seq_writer) {
+    seq_writer->merge();
+    HH_LOG(INFO) << "Wrote " << seq_writer->entries() << " consensus sequences of " << reader.db_index->n_entries
+        << " entries to " << par.outfile << std::endl;
+    delete seq_writer;
+  }
+  if (aln_writer) {
+    aln_writer->merge();
+    HH_LOG(INFO) << "Wrote " << aln_writer->entries() << " alignments of " << reader.db_index->n_entries
+        << " entries to " << par.alnfile << std::endl;
+    delete aln_writer;
+  }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 //// MAIN PROGRAM
 /////////////////////////////////////////////////////////////////////////////////////
@@ -290,7 +473,8 @@ int main(int argc, const char **argv) {
   par.pc_hhm_nocontext_a = 0.0;  // no amino acid pseudocounts
   par.gapb = 0.0; // no transition pseudocounts
 
-  ProcessArguments(par);
+  bool ffindex = false;
+  ProcessArguments(par, ffindex);
 
   Alignment* qali = new Alignment(par.maxseq, par.maxres);
   HMM* q = new HMM(MAXSEQDIS, par.maxres);        //Create a HMM with maximum of par.maxres match states
@@ -310,6 +494,17 @@ int main(int argc, const char **argv) {
     exit(4);
   }
 
+  if (ffindex) {
+    if (!*par.outfile && !*par.alnfile) {
+      help(par);
+      HH_LOG(ERROR) << "Output database (-s or -o) is missing" << std::endl;
+      exit(4);
+    }
+    if (*q->name) {
+      HH_LOG(WARNING) << "Ignoring -name with -ffindex, sequences are named after their alignment" << std::endl;
+    }
+  }
+
   // Get basename
   RemoveExtension(q->file, par.infile); //Get basename of infile (w/o extension):
 
@@ -343,42 +538,21 @@ int main(int argc, const char **argv) {
   // Set substitution matrix; adjust to query aa distribution if par.pcm==3
   SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
 
+  if (ffindex) {
+    ConsensusDatabase(par, pc_hhm_context_engine, pc_hhm_context_mode, pb, R, S, Sim);
+    delete qali;
+    delete q;
+    DeletePseudocountsEngine(context_lib, crf, pc_hhm_context_engine,
+        pc_hhm_context_mode, pc_prefilter_context_engine,
+        pc_prefilter_context_mode);
+    return 0;
+  }
+
   // Read input file (HMM, HHM, or alignment format), and add pseudocounts etc.
   char input_format = 0;
   ReadQueryFile(par, par.infile, input_format, par.wg, q, qali, pb, S, Sim);
 
-  // Same code as in PrepareQueryHMM(par.infile,input_format,q,qali), except that we add SS prediction
-  // Add Pseudocounts, if no HMMER input
-  if (input_format == 0) {
-    // Transform transition freqs to lin space if not already done
-    q->AddTransitionPseudocounts(par.gapd, par.gape, par.gapf, par.gapg,
-        par.gaph, par.gapi, par.gapb, par.gapb);
-
-    // Comput substitution matrix pseudocounts
-    if (par.nocontxt) {
-      // Generate an amino acid frequency matrix from f[i][a] with full pseudocount admixture (tau=1) -> g[i][a]
-      q->PreparePseudocounts(R);
-      // Add amino acid pseudocounts to query: p[i][a] = (1-tau)*f[i][a] + tau*g[i][a]
-      q->AddAminoAcidPseudocounts(par.pc_hhm_nocontext_mode,
-          par.pc_hhm_nocontext_a, par.pc_hhm_nocontext_b,
-          par.pc_hhm_nocontext_c);
-    }
-    else {
-      // Add full context specific pseudocounts to query
-      q->AddContextSpecificPseudocounts(pc_hhm_context_engine,
-          pc_hhm_context_mode);
-    }
-  }
-  else {
-    q->AddAminoAcidPseudocounts(0, par.pc_hhm_nocontext_a,
-        par.pc_hhm_nocontext_b, par.pc_hhm_nocontext_c);
-  }
-
-  q->CalculateAminoAcidBackground(pb);
-
-  if (par.columnscore == 5 && !q->divided_by_local_bg_freqs)
-    q->DivideBySqrtOfLocalBackgroundFreqs(
-        par.half_window_size_local_aa_bg_freqs, pb);
+  PrepareConsensusHMM(par, input_format, q, pc_hhm_context_engine, pc_hhm_context_mode, pb, R);
 
   // Write consensus sequence to sequence file
   // Consensus sequence is calculated in hhalignment.C, Alignment::FrequenciesAndTransitions()
@@ -403,18 +577,7 @@ int main(int argc, const char **argv) {
   // Print A3M/A2M/FASTA output alignment
   if (*par.alnfile) {
     HalfAlignment qa(MAXSEQDIS);
-    int n = imin(q->n_display,
-        par.nseqdis + (q->nss_dssp >= 0) + (q->nss_pred >= 0)
-            + (q->nss_conf >= 0) + (q->ncons >= 0));
-    qa.Set(q->name, q->seq, q->sname, n, q->L, q->nss_dssp, q->nss_pred,
-        q->nss_conf, q->nsa_dssp, q->ncons);
-
-    if (par.outformat == 1)
-      qa.BuildFASTA();
-    else if (par.outformat == 2)
-      qa.BuildA2M();
-    else if (par.outformat == 3)
-      qa.BuildA3M();
+    BuildConsensusAlignment(par, q, qa);
     if (qali->readCommentLine)
       qa.Print(par.alnfile, par.append, qali->longname); // print alignment to outfile
     else
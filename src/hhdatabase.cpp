@@ -8,10 +8,14 @@
 #include "hhdatabase.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -60,6 +64,15 @@ bool HHDatabase::checkDatabaseConflicts(const char* base) {
   return false;
 }
 
+// The prefilter and the ca3m reader keep pointers into the cs219, sequence and header data,
+// so these data files cannot be block-compressed
+static void checkNotBlockCompressed(FFindexDatabase* database) {
+  if (database->isBlockCompressed()) {
+    HH_LOG(ERROR) << database->data_filename << " is block-compressed! Only a3m, hhm and ca3m data files may be compressed." << std::endl;
+    exit(1);
+  }
+}
+
 HHblitsDatabase::HHblitsDatabase(const char* base, bool initCs219) {
   cs219_database = NULL;
 
@@ -72,6 +85,7 @@ HHblitsDatabase::HHblitsDatabase(const char* base, bool initCs219) {
 
 
   use_compressed = false;
+  shard_group = 0;
   basename = new char[strlen(base) + 1];
   strcpy(basename, base);
 
@@ -83,6 +97,7 @@ HHblitsDatabase::HHblitsDatabase(const char* base, bool initCs219) {
       buildDatabaseName(base, "cs219", ".ffindex", cs219_index_filename);
 
       cs219_database = new FFindexDatabase(cs219_data_filename, cs219_index_filename, use_compressed);
+      checkNotBlockCompressed(cs219_database);
   }
 
   if (!checkAndBuildCompressedDatabase(base)) {
@@ -124,6 +139,48 @@ HHblitsDatabase::HHblitsDatabase(const char* base, bool initCs219) {
   prefilter = NULL;
 }
 
+void HHblitsDatabase::openDatabases(const std::vector<std::string>& bases, const bool initCs219,
+                                    std::vector<HHblitsDatabase*>& databases) {
+  for (size_t i = 0; i < bases.size(); i++) {
+    std::string shards_filename = bases[i] + ".shards";
+    std::ifstream shards_file(shards_filename.c_str());
+    if (!shards_file.good()) {
+      HHblitsDatabase* db = new HHblitsDatabase(bases[i].c_str(), initCs219);
+      db->shard_group = i;
+      databases.push_back(db);
+      continue;
+    }
+
+    // shards are given relative to the directory of the shard list
+    std::string directory;
+    size_t slash = bases[i].rfind('/');
+    if (slash != std::string::npos) {
+      directory = bases[i].substr(0, slash + 1);
+    }
+
+    size_t n_shards = 0;
+    std::string shard;
+    while (std::getline(shards_file, shard)) {
+      if (shard.empty()) {
+        continue;
+      }
+      if (shard[0] != '/') {
+        shard = directory + shard;
+      }
+      HHblitsDatabase* db = new HHblitsDatabase(shard.c_str(), initCs219);
+      db->shard_group = i;
+      databases.push_back(db);
+      n_shards++;
+    }
+
+    if (n_shards == 0) {
+      HH_LOG(ERROR) << "Shard list " << shards_filename << " is empty!" << std::endl;
+      exit(1);
+    }
+    HH_LOG(INFO) << "Database " << bases[i] << " has " << n_shards << " shards" << std::endl;
+  }
+}
+
 HHblitsDatabase::~HHblitsDatabase() {
   delete[] basename;
   delete cs219_database;
@@ -163,7 +220,8 @@ void HHblitsDatabase::initSelected(std::vector<std::string>& selected_templates,
   getEntriesFromNames(new_entry_names, new_entries);
 }
 
-void HHblitsDatabase::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
+void HHblitsDatabase::prefilter_db(std::vector<HHblitsDatabase*>& shards,
+                                   HMM* q_tmp, FlatHash<Hit>* previous_hits,
                                    const int threads,
                                    const int prefilter_gap_open,
                                    const int prefilter_gap_extend,
@@ -177,60 +235,80 @@ void HHblitsDatabase::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
                                    std::vector<HHEntry*>& new_entries,
                                    std::vector<HHEntry*>& old_entries) {
 
-  std::vector<std::pair<int, std::string> > prefiltered_new_entry_names;
-  std::vector<std::pair<int, std::string> > prefiltered_old_entry_names;
+  std::vector<Prefilter*> prefilters;
+  for (size_t s = 0; s < shards.size(); s++) {
+    prefilters.push_back(shards[s]->prefilter);
+  }
+
+  std::vector<PrefilterHit> prefiltered_new_entries;
+  std::vector<PrefilterHit> prefiltered_old_entries;
 
-  prefilter->prefilter_db(q_tmp, previous_hits, threads, prefilter_gap_open,
+  Prefilter::prefilter_db(prefilters, q_tmp, previous_hits, threads, prefilter_gap_open,
                           prefilter_gap_extend, prefilter_score_offset,
                           prefilter_bit_factor, prefilter_evalue_thresh,
                           prefilter_evalue_coarse_thresh,
                           preprefilter_smax_thresh, min_prefilter_hits,
-                          maxnumbdb, R, prefiltered_new_entry_names,
-                          prefiltered_old_entry_names);
-
-  getEntriesFromNames(prefiltered_new_entry_names, new_entries);
-  getEntriesFromNames(prefiltered_old_entry_names, old_entries);
+                          maxnumbdb, R, prefiltered_new_entries,
+                          prefiltered_old_entries);
+
+  for (size_t i = 0; i < prefiltered_new_entries.size(); i++) {
+    const PrefilterHit& hit = prefiltered_new_entries[i];
+    HHEntry* entry = shards[hit.shard]->getEntryFromName(hit.length, hit.name);
+    if (entry != NULL) {
+      new_entries.push_back(entry);
+    }
+  }
+  for (size_t i = 0; i < prefiltered_old_entries.size(); i++) {
+    const PrefilterHit& hit = prefiltered_old_entries[i];
+    HHEntry* entry = shards[hit.shard]->getEntryFromName(hit.length, hit.name);
+    if (entry != NULL) {
+      old_entries.push_back(entry);
+    }
+  }
 }
 
 void HHblitsDatabase::getEntriesFromNames(std::vector<std::pair<int, std::string>>& hits, std::vector<HHEntry*>& entries) {
   for (size_t i = 0; i < hits.size(); i++) {
-    ffindex_entry_t* entry;
+    HHEntry* entry = getEntryFromName(hits[i].first, hits[i].second);
+    if (entry != NULL) {
+      entries.push_back(entry);
+    }
+  }
+}
 
-    if (hhm_database != NULL) {
-      entry = ffindex_get_entry_by_name(hhm_database->db_index, const_cast<char*>(hits[i].second.c_str()));
+HHEntry* HHblitsDatabase::getEntryFromName(const int length, const std::string& name) {
+  ffindex_entry_t* entry;
 
-      if (entry != NULL) {
-        HHEntry* hhentry = new HHDatabaseEntry(hits[i].first, this, hhm_database, entry);
-        entries.push_back(hhentry);
-        continue;
-      }
+  if (hhm_database != NULL) {
+    entry = ffindex_get_entry_by_name(hhm_database->db_index, const_cast<char*>(name.c_str()));
+
+    if (entry != NULL) {
+      return new HHDatabaseEntry(length, this, hhm_database, entry);
     }
+  }
 
-    if (use_compressed) {
-      entry = ffindex_get_entry_by_name(ca3m_database->db_index, const_cast<char *>(hits[i].second.c_str()));
-      if (entry == NULL) {
-        //TODO: error
-        HH_LOG(WARNING) << "Could not fetch entry from compressed a3m!" << std::endl;
-        HH_LOG(WARNING) << "\tentry: " << hits[i].second << std::endl;
-        HH_LOG(WARNING) << "\tdb: " << ca3m_database->data_filename << std::endl;
-        continue;
-      }
+  if (use_compressed) {
+    entry = ffindex_get_entry_by_name(ca3m_database->db_index, const_cast<char *>(name.c_str()));
+    if (entry == NULL) {
+      //TODO: error
+      HH_LOG(WARNING) << "Could not fetch entry from compressed a3m!" << std::endl;
+      HH_LOG(WARNING) << "\tentry: " << name << std::endl;
+      HH_LOG(WARNING) << "\tdb: " << ca3m_database->data_filename << std::endl;
+      return NULL;
+    }
 
-      HHEntry *hhentry = new HHDatabaseEntry(hits[i].first, this, ca3m_database, entry);
-      entries.push_back(hhentry);
-    } else {
-      entry = ffindex_get_entry_by_name(a3m_database->db_index, const_cast<char*>(hits[i].second.c_str()));
-      if (entry == NULL) {
-        //TODO: error
-        HH_LOG(WARNING) << "Could not fetch entry from a3m or hhm!" << std::endl;
-        HH_LOG(WARNING) << "\tentry: " << hits[i].second << std::endl;
-        HH_LOG(WARNING) << "\ta3m_db: " << a3m_database->data_filename << std::endl;
-        HH_LOG(WARNING) << "\thhm_db: " << hhm_database->data_filename << std::endl;
-        continue;
-      }
-      HHEntry* hhentry = new HHDatabaseEntry(hits[i].first, this, a3m_database, entry);
-      entries.push_back(hhentry);
+    return new HHDatabaseEntry(length, this, ca3m_database, entry);
+  } else {
+    entry = ffindex_get_entry_by_name(a3m_database->db_index, const_cast<char*>(name.c_str()));
+    if (entry == NULL) {
+      //TODO: error
+      HH_LOG(WARNING) << "Could not fetch entry from a3m or hhm!" << std::endl;
+      HH_LOG(WARNING) << "\tentry: " << name << std::endl;
+      HH_LOG(WARNING) << "\ta3m_db: " << a3m_database->data_filename << std::endl;
+      HH_LOG(WARNING) << "\thhm_db: " << hhm_database->data_filename << std::endl;
+      return NULL;
     }
+    return new HHDatabaseEntry(length, this, a3m_database, entry);
   }
 }
 
@@ -261,6 +339,8 @@ bool HHblitsDatabase::checkAndBuildCompressedDatabase(const char* base) {
     ca3m_database = new FFindexDatabase(ca3m_data_filename, ca3m_index_filename, true);
     sequence_database = new FFindexDatabase(sequence_data_filename, sequence_index_filename, true);
     header_database = new FFindexDatabase(header_data_filename, header_index_filename, true);
+    checkNotBlockCompressed(sequence_database);
+    checkNotBlockCompressed(header_database);
 
     char hhm_index_filename[NAMELEN];
     char hhm_data_filename[NAMELEN];
@@ -303,7 +383,7 @@ void HHDatabaseEntry::getTemplateHMM(Parameters& par, char use_global_weights,
   if (ffdatabase->isCompressed) {
     Alignment tali(par.maxseq, par.maxres);
 
-    char* data = ffindex_get_data_by_entry(ffdatabase->db_data, entry);
+    char* data = ffdatabase->getData(entry);
 
     if (data == NULL) {
       HH_LOG(ERROR) << "Could not fetch data for a3m " << entry->name << "!" << std::endl;
@@ -325,15 +405,20 @@ void HHDatabaseEntry::getTemplateHMM(Parameters& par, char use_global_weights,
 
     format = 0;
   } else {
-    FILE* dbf = ffindex_fopen_by_entry(ffdatabase->db_data, entry);
+    // Parse the entry directly from the memory mapped (or inflated) data
+    TextBuffer dbf(ffdatabase->getData(entry), entry->length);
     char* name = new char[strlen(entry->name) + 1];
     strcpy(name, entry->name);
-    HHEntry::getTemplateHMM(dbf, name, par, use_global_weights, qsc, format, pb, S, Sim, t);
-    fclose(dbf);
+    HHEntry::getTemplateHMM(&dbf, name, par, use_global_weights, qsc, format, pb, S, Sim, t);
     delete[] name;
   }
 }
 
+bool HHDatabaseEntry::getDataRange(const char*& data, size_t& length) {
+  ffdatabase->getStoredRange(entry, data, length);
+  return data != NULL;
+}
+
 void HHDatabaseEntry::getTemplateA3M(Parameters& par, float* pb,
                                      const float S[20][20],
                                      const float Sim[20][20], Alignment& tali) {
@@ -348,8 +433,7 @@ void HHDatabaseEntry::getTemplateA3M(Parameters& par, float* pb,
       exit(1);
     }
 
-    char* data = ffindex_get_data_by_entry(hhdatabase->ca3m_database->db_data,
-                                           entry);
+    char* data = hhdatabase->ca3m_database->getData(entry);
 
     if (data == NULL) {
       HH_LOG(ERROR) << "Could not fetch data for a3m " << entry->name << "!" << std::endl;
@@ -362,27 +446,28 @@ void HHDatabaseEntry::getTemplateA3M(Parameters& par, float* pb,
                         hhdatabase->header_database->db_data, par.mark,
                         par.maxcol);
   } else {
-    FILE* dbf = ffindex_fopen_by_name(hhdatabase->a3m_database->db_data,
-                                      hhdatabase->a3m_database->db_index,
-                                      entry->name);
+    ffindex_entry_t* entry = ffindex_get_entry_by_name(
+        hhdatabase->a3m_database->db_index, this->entry->name);
 
-    if (dbf == NULL) {
-      HH_LOG(ERROR) << "Opening A3M " << entry->name << " failed!" << std::endl;
+    if (entry == NULL) {
+      HH_LOG(ERROR) << "Opening A3M " << this->entry->name << " failed!" << std::endl;
       exit(4);
     }
 
+    // Parse the entry directly from the memory mapped (or inflated) data
+    TextBuffer dbf(hhdatabase->a3m_database->getData(entry), entry->length);
+
     char line[LINELEN];
-    if (!fgetline(line, LINELEN, dbf)) {
+    if (!fgetline(line, LINELEN, &dbf)) {
       //TODO: throw error
       HH_LOG(ERROR) << "In " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
       HH_LOG(ERROR) << "\tThis should not happen!" << std::endl;
     }
 
     while (strscn(line) == NULL)
-      fgetline(line, LINELEN, dbf);  // skip lines that contain only white space
+      fgetline(line, LINELEN, &dbf);  // skip lines that contain only white space
 
-    tali.Read(dbf, entry->name, par.mark, par.maxcol, par.nseqdis, line);
-    fclose(dbf);
+    tali.Read(&dbf, entry->name, par.mark, par.maxcol, par.nseqdis, line);
   }
 
   tali.Compress(entry->name, par.cons, par.maxcol, par.M_template, par.Mgaps);
@@ -393,7 +478,8 @@ void HHDatabaseEntry::getTemplateA3M(Parameters& par, float* pb,
   }
 }
 
-void HHEntry::getTemplateHMM(FILE* dbf, char* name, Parameters& par,
+template <class Input>
+void HHEntry::getTemplateHMM(Input* dbf, char* name, Parameters& par,
                              char use_global_weights, const float qsc,
                              int& format, float* pb, const float S[20][20],
                              const float Sim[20][20], HMM* t) {
@@ -567,3 +653,46 @@ int getMaxTemplateLength(std::vector<HHEntry*>& entries) {
   return max_template_length;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Templates are read in the order of their prefilter score and length, i.e. at
+// random offsets of the data files. Collect the pages of a batch of templates,
+// sort them by address and merge close ranges, so the kernel can read them ahead
+// with few large sequential requests while the previous batch is being aligned
+/////////////////////////////////////////////////////////////////////////////////////
+void prefetchTemplates(std::vector<HHEntry*>::const_iterator first, std::vector<HHEntry*>::const_iterator last) {
+  // Read gaps of up to this size between two templates instead of seeking over them
+  const uintptr_t max_gap = 128 * 1024;
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+
+  std::vector<std::pair<uintptr_t, uintptr_t> > ranges;
+  for (std::vector<HHEntry*>::const_iterator it = first; it != last; ++it) {
+    const char* data;
+    size_t length;
+    if ((*it)->getDataRange(data, length) && length > 0) {
+      uintptr_t start = (uintptr_t) data & ~(page_size - 1);
+      ranges.push_back(std::make_pair(start, (uintptr_t) data + length));
+    }
+  }
+  if (ranges.empty()) {
+    return;
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+
+  uintptr_t start = ranges[0].first;
+  uintptr_t end = ranges[0].second;
+  for (size_t i = 1; i <= ranges.size(); i++) {
+    if (i < ranges.size() && ranges[i].first <= end + max_gap) {
+      end = std::max(end, ranges[i].second);
+      continue;
+    }
+
+    // only a hint: failures are ignored
+    madvise((void*) start, end - start, MADV_WILLNEED);
+
+    if (i < ranges.size()) {
+      start = ranges[i].first;
+      end = ranges[i].second;
+    }
+  }
+}
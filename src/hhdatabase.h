@@ -17,7 +17,7 @@ class Prefilter;
 
 #include "ffindexdatabase.h"
 #include "hhutil.h"
-#include "hash.h"
+#include "flathash.h"
 #include "hhhit.h"
 #include "log.h"
 #include "hhalignment.h"
@@ -39,12 +39,20 @@ class HHblitsDatabase: HHDatabase {
     HHblitsDatabase(const char* base, bool initCs219 = true);
     ~HHblitsDatabase();
 
+    // Open the databases with the given base names. A base name may also name a sharded database,
+    // i.e. a file <base>.shards that lists the base names of its shards (see hhshard);
+    // the shards of one database get the same shard_group
+    static void openDatabases(const std::vector<std::string>& bases, const bool initCs219,
+        std::vector<HHblitsDatabase*>& databases);
+
     void initPrefilter(const std::string& cs_library);
     void initNoPrefilter(std::vector<HHEntry*>& new_prefilter_hits);
     void initSelected(std::vector<std::string>& selected_templates,
         std::vector<HHEntry*>& new_entries);
 
-    void prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits, const int threads,
+    // Prefilter the shards of one database (a single database that is not sharded) together
+    static void prefilter_db(std::vector<HHblitsDatabase*>& shards, HMM* q_tmp,
+        FlatHash<Hit>* previous_hits, const int threads,
         const int prefilter_gap_open, const int prefilter_gap_extend,
         const int prefilter_score_offset, const int prefilter_bit_factor,
         const double prefilter_evalue_thresh,
@@ -55,6 +63,9 @@ class HHblitsDatabase: HHDatabase {
 
     char* basename;
 
+    // Databases with the same shard_group are shards of one database
+    size_t shard_group;
+
     FFindexDatabase* cs219_database;
 
     FFindexDatabase* a3m_database;
@@ -70,6 +81,7 @@ class HHblitsDatabase: HHDatabase {
   private:
     void getEntriesFromNames(std::vector<std::pair<int, std::string> >& names,
         std::vector<HHEntry*>& entries);
+    HHEntry* getEntryFromName(const int length, const std::string& name);
     bool checkAndBuildCompressedDatabase(const char* base);
 
     Prefilter* prefilter;
@@ -89,8 +101,13 @@ class HHEntry {
 
     virtual char* getName() {return NULL;};
 
+    // Memory mapped data the template is read from; false if the template is not read from a mapped database
+    virtual bool getDataRange(const char*& data, size_t& length) {return false;};
+
   protected:
-    void getTemplateHMM(FILE* inf, char* name, Parameters& par, char use_global_weights,
+    // Read a template HMM or alignment from a FILE or TextBuffer
+    template <class Input>
+    void getTemplateHMM(Input* inf, char* name, Parameters& par, char use_global_weights,
         const float qsc, int& format, float* pb, const float S[20][20],
         const float Sim[20][20], HMM* t);
 };
@@ -107,6 +124,8 @@ class HHDatabaseEntry : public HHEntry {
 
     char* getName();
 
+    bool getDataRange(const char*& data, size_t& length);
+
   private:
     HHblitsDatabase* hhdatabase;
     FFindexDatabase* ffdatabase;
@@ -137,4 +156,7 @@ struct HHDatabaseEntryCompare {
 
 int getMaxTemplateLength(std::vector<HHEntry*>& entries);
 
+// Ask the kernel to read the data of the entries in [first, last) ahead, in the order of the data file
+void prefetchTemplates(std::vector<HHEntry*>::const_iterator first, std::vector<HHEntry*>::const_iterator last);
+
 #endif /* HHDATABASE_H_ */
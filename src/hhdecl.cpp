@@ -23,6 +23,7 @@ Parameters::Parameters(const int argc, const char** argv) : argc(argc), argv(arg
 	e = 1e-3f; // maximum E-value for inclusion in output alignment, output HMM, and PSI-BLAST checkpoint model
 	realign_max = 500;        // Maximum number of HMM hits to realign
 	maxmem = 3.0;            // 3GB
+	hugepages = false;
 	showcons = 1;              // show consensus sequence
 	showdssp = 1;              // show predicted secondary structure ss_dssp
 	showpred = 1;              // show predicted secondary structure ss_pred
@@ -143,6 +144,8 @@ Parameters::Parameters(const int argc, const char** argv) : argc(argc), argv(arg
 	strcpy(pairwisealisfile, "");
 	strcpy(scorefile, "");
     strcpy(m8file, "");
+    strcpy(binfile, "");
+    binary_paths = false;
 	strcpy(indexfile, "");
 	strcpy(alnfile, "");
 	strcpy(hhmfile, "");
@@ -32,6 +32,7 @@ const int NAMELEN=(PATH_MAX>512? PATH_MAX:512); //max length of file names etc.,
 const int NAA=20;       //number of amino acids (0-19)
 const int NTRANS=7;     //number of transitions recorded in HMM (M2M,M2I,M2D,I2M,I2I,D2M,D2D)
 const int NCOLMIN=10;   //min number of cols in subalignment for calculating pos-specific weights w[k][i]
+const int NCELLS_PARALLEL=65536; //min number of sequences*columns for which profile calculation loops are run multi-threaded
 const int ANY=20;       //number representing an X (any amino acid) internally
 const int GAP=21;       //number representing a gap internally
 const int FWD_BKW_PATHWITDH=40;       //cell off path width around viterbi alignment
@@ -158,6 +159,8 @@ public:
   char psifile[NAMELEN];  // name of output alignmen file in PSI-BLAST format (iterative search)
   char scorefile[NAMELEN];// table of scores etc for all HMMs in searched database
   char m8file[NAMELEN];   // blast tab format for all HMMs in searched database
+  char binfile[NAMELEN];  // binary hit records for hit list summary (see hhhitbinary.h)
+  bool binary_paths;      // store alignment paths in binary hit records
   char indexfile[NAMELEN];// optional file containing indeices of aligned residues in given alignment
   std::vector<std::string> tfiles;    // template filenames (in hhalign)
   char alitabfile[NAMELEN]; // where to write pairs of aligned residues (-atab option)
@@ -241,6 +244,7 @@ public:
   double mact;            // Probability threshold (negative offset) in MAC alignment determining greediness at ends of alignment
   int realign_max;        // Realign max ... hits
   float maxmem;           // maximum available memory in GB for realignment (approximately)
+  bool hugepages;         // back dynamic programming matrices and cs219 data with transparent huge pages
 
   int min_overlap;        // all cells of dyn. programming matrix with L_T-j+i or L_Q-i+j < min_overlap will be ignored
   char notags;            // neutralize His-tags, FLAG tags, C-myc tags?
@@ -22,6 +22,10 @@
 //     HHblits: Lightning-fast iterative protein sequence searching by HMM-HMM alignment.
 //     Nat. Methods, epub Dec 25, doi: 10.1038/NMETH.1818 (2011).
 
+#include <sstream>
+#include <string>
+#include <algorithm>
+
 #include "hhsuite_config.h"
 
 #include "util.h"        // imax, fmax, iround, iceil, ifloor, strint, strscn, strcut, substr, uprstr, uprchr, Basename etc.
@@ -30,6 +34,7 @@
 #include "hhmatrices.h"  // BLOSUM50, GONNET, HSDM
 #include "hhalignment.h" // class Alignment
 #include "hhfunc.h"      // some functions common to hh programs
+#include "ffindexdatabase.h" // class FFindexDatabase, FFindexShardedWriter, ForEachEntryParallel
 
 void help(Parameters& par) {
   printf("HHfilter %i.%i.%i\n", HHSUITE_VERSION_MAJOR, HHSUITE_VERSION_MINOR, HHSUITE_VERSION_PATCH);
@@ -39,9 +44,13 @@ void help(Parameters& par) {
   printf("%s", REFERENCE);
   printf("\n");
   printf("Usage: hhfilter -i infile -o outfile [options]\n");
+  printf("       hhfilter -i <ffindex> -o <ffindex> -ffindex [options]\n");
   printf(" -i <file>      read input file in A3M/A2M or FASTA format                 \n");
   printf(" -o <file>      write to output file in A3M format                         \n");
   printf(" -a <file>      append to output file in A3M format                        \n");
+  printf(" -ffindex       -i and -o are ffindex database basenames: filter all entries\n");
+  printf("                of <i>.ff{data,index} and write them to <o>.ff{data,index}  \n");
+  printf(" -cpu <int>     number of threads filtering alignments with -ffindex (def=%i)\n", par.threads);
   printf("\n");
   printf("Options:                                                                  \n");
   printf(" -v <int>       verbose mode: 0:no screen output  1:only warings  2: verbose\n");
@@ -66,7 +75,7 @@ void help(Parameters& par) {
 }
 
 //// Processing input options from command line
-void ProcessArguments(Parameters& par) {
+void ProcessArguments(Parameters& par, bool& ffindex) {
   const int argc = par.argc;
   const char** argv = par.argv;
 
@@ -102,6 +111,10 @@ void ProcessArguments(Parameters& par) {
 		par.v = Log::from_int(v);
 		Log::reporting_level() = par.v;
     }
+    else if (!strcmp(argv[i], "-ffindex"))
+      ffindex = true;
+    else if (!strcmp(argv[i], "-cpu") && (i < argc - 1))
+      par.threads = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-maxseq") && (i < argc - 1))
       par.maxseq = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-maxres") && (i < argc - 1)) {
@@ -141,6 +154,84 @@ void ProcessArguments(Parameters& par) {
   }
 }
 
+// Filter the alignment read into qali from file name
+void FilterAlignment(Parameters& par, Alignment& qali, const char* name,
+    float* pb, const float S[20][20], const float Sim[20][20]) {
+  // Convert ASCII to int (0-20),throw out all insert states, record their number in I[k][i]
+  // and store marked sequences in name[k] and seq[k]
+  qali.Compress(name, par.cons, par.maxcol, par.M, par.Mgaps);
+
+  // Remove sequences with seq. identity larger than seqid percent (remove the shorter of two)
+  qali.N_filtered = qali.Filter(par.max_seqid, S, par.coverage, par.qid, par.qsc, par.Ndiff);
+
+  // Atune alignment diversity q.Neff with qsc to value Neff_goal
+  if (par.Neff >= 1.0) {
+    qali.FilterNeff(par.wg, par.mark, par.cons, par.showcons, par.max_seqid, par.coverage, par.Neff, pb, S, Sim);
+  }
+}
+
+// Filters the alignments of an ffindex database, see FilterDatabase
+class AlignmentFilter : public FFindexEntryProcessor {
+public:
+  AlignmentFilter(Parameters& par, float* pb, const float S[20][20], const float Sim[20][20],
+      FFindexShardedWriter& writer, const int threads)
+      : par(par), pb(pb), S(S), Sim(Sim), writer(writer), qali(threads, NULL) {
+  }
+
+  // every thread reuses one alignment (sized for par.maxseq) for all its entries
+  void beginThread(const int thread) {
+    qali[thread] = new Alignment(par.maxseq, par.maxres);
+  }
+
+  void endThread(const int thread) {
+    delete qali[thread];
+  }
+
+  void process(const int thread, ffindex_entry_t* entry, char* data) {
+    TextBuffer buffer(data, entry->length);
+    qali[thread]->Read(&buffer, entry->name, par.mark, par.maxcol, par.nseqdis);
+
+    FilterAlignment(par, *qali[thread], entry->name, pb, S, Sim);
+
+    // Write filtered alignment WITH insert states (lower case)
+    std::stringstream out;
+    qali[thread]->WriteToFile(out);
+    writer.insert(thread, out.str(), entry->name);
+  }
+
+private:
+  Parameters& par;
+  float* pb;
+  const float (*S)[20];
+  const float (*Sim)[20];
+  FFindexShardedWriter& writer;
+  std::vector<Alignment*> qali;
+};
+
+// Filter all alignments of the ffindex database par.infile in parallel and write
+// them to the ffindex database par.outfile, one shard per thread
+void FilterDatabase(Parameters& par, float* pb, const float S[20][20], const float Sim[20][20]) {
+  std::string data_filename = std::string(par.infile) + ".ffdata";
+  std::string index_filename = std::string(par.infile) + ".ffindex";
+  FFindexDatabase reader(data_filename.c_str(), index_filename.c_str(), false);
+  if (reader.db_index == NULL) {
+    HH_LOG(ERROR) << "Could not read index " << index_filename << "!" << std::endl;
+    exit(1);
+  }
+
+  int threads = 1;
+#ifdef OPENMP
+  threads = std::max(par.threads, 1);
+#endif
+  FFindexShardedWriter writer(par.outfile, threads);
+  AlignmentFilter filter(par, pb, S, Sim, writer, threads);
+  ForEachEntryParallel(reader, threads, filter);
+
+  writer.merge();
+  HH_LOG(INFO) << "Wrote " << writer.entries() << " filtered alignments of " << reader.db_index->n_entries
+      << " entries to " << par.outfile << std::endl;
+}
+
 int main(int argc, const char **argv) {
   Parameters par(argc, argv);
 
@@ -152,7 +243,8 @@ int main(int argc, const char **argv) {
   // no filtering for maximum diversity
   par.Ndiff = 0;
 
-  ProcessArguments(par);
+  bool ffindex = false;
+  ProcessArguments(par, ffindex);
 
   // Check command line input and default values
   if (!*par.infile) {
@@ -166,9 +258,27 @@ int main(int argc, const char **argv) {
     exit(4);
   }
 
+  if (ffindex && par.append) {
+    HH_LOG(ERROR) << "Appending (-a) is not supported with -ffindex" << std::endl;
+    exit(4);
+  }
+
   HH_LOG(INFO) << "Input file = " << par.infile << "\n";
   HH_LOG(INFO) << "Output file = " << par.outfile << "\n";
 
+  // substitution matrix flavours
+  float __attribute__((aligned(16))) P[20][20];
+  float __attribute__((aligned(16))) R[20][20];
+  float __attribute__((aligned(16))) Sim[20][20];
+  float __attribute__((aligned(16))) S[20][20];
+  float __attribute__((aligned(16))) pb[21];
+  SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
+
+  if (ffindex) {
+    FilterDatabase(par, pb, S, Sim);
+    return 0;
+  }
+
   // Reads in an alignment from par.infile into matrix X[k][l] as ASCII
   FILE* inf = NULL;
   if (strcmp(par.infile, "stdin")) {
@@ -185,25 +295,7 @@ int main(int argc, const char **argv) {
   qali.Read(inf, par.infile, par.mark, par.maxcol, par.nseqdis);
   fclose(inf);
 
-  // Convert ASCII to int (0-20),throw out all insert states, record their number in I[k][i]
-  // and store marked sequences in name[k] and seq[k]
-  qali.Compress(par.infile, par.cons, par.maxcol, par.M, par.Mgaps);
-
-  // substitution matrix flavours
-  float __attribute__((aligned(16))) P[20][20];
-  float __attribute__((aligned(16))) R[20][20];
-  float __attribute__((aligned(16))) Sim[20][20];
-  float __attribute__((aligned(16))) S[20][20];
-  float __attribute__((aligned(16))) pb[21];
-  SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
-
-  // Remove sequences with seq. identity larger than seqid percent (remove the shorter of two)
-  qali.N_filtered = qali.Filter(par.max_seqid, S, par.coverage, par.qid, par.qsc,par.Ndiff);
-
-  // Atune alignment diversity q.Neff with qsc to value Neff_goal
-  if (par.Neff >= 1.0) {
-    qali.FilterNeff(par.wg, par.mark, par.cons, par.showcons, par.max_seqid, par.coverage, par.Neff, pb, S, Sim);
-  }
+  FilterAlignment(par, qali, par.infile, pb, S, Sim);
 
   // Write filtered alignment WITH insert states (lower case) to alignment file
   qali.WriteToFile(par.outfile, par.append);
@@ -7,18 +7,19 @@
 /////////////////////////////////////////////////////////////////////////////////////
 // Read input file (HMM, HHM, or alignment format)
 /////////////////////////////////////////////////////////////////////////////////////
-void ReadQueryFile(Parameters& par, FILE* inf, char& input_format,
+template <class Input>
+int ReadQueryFile(Parameters& par, Input* inf, char& input_format,
     char use_global_weights, HMM* q, Alignment* qali, char infile[], float* pb,
-    const float S[20][20], const float Sim[20][20]) {
+    const float S[20][20], const float Sim[20][20], Alignment* work) {
   char line[LINELEN];
 
   if (!fgetline(line, LINELEN, inf)) {
 	HH_LOG(ERROR) << "Error in " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
 	HH_LOG(ERROR) << "\t" << infile << " is empty!\n";
-    exit(4);
+    return 4;
   }
-  while (strscn(line) == NULL)
-    fgetline(line, LINELEN, inf); // skip lines that contain only white space
+  while (strscn(line) == NULL && fgetline(line, LINELEN, inf))
+    ; // skip lines that contain only white space
 
   // Is infile a HMMER file?
   if (!strncmp(line, "HMMER", 5)) {
@@ -38,14 +39,14 @@ void ReadQueryFile(Parameters& par, FILE* inf, char& input_format,
     input_format = 0;
 
     // HHM format
-    if (input_format == 0) {
+    if (qali != NULL) {
       HH_LOG(INFO) << "Extracting representative sequences from " << infile << " to merge later with matched database sequences\n";
-    }
 
-    Alignment ali_tmp(par.maxseq, par.maxres);
-    ali_tmp.GetSeqsFromHMM(q);
-    ali_tmp.Compress(infile, par.cons, par.maxcol, par.M, par.Mgaps);
-    *qali = ali_tmp;
+      Alignment ali_tmp(par.maxseq, par.maxres);
+      ali_tmp.GetSeqsFromHMM(q);
+      ali_tmp.Compress(infile, par.cons, par.maxcol, par.M, par.Mgaps);
+      *qali = ali_tmp;
+    }
   }
   // ... or is it an alignment file
   else if (line[0] == '#' || line[0] == '>') {
@@ -53,44 +54,56 @@ void ReadQueryFile(Parameters& par, FILE* inf, char& input_format,
     	HH_LOG(INFO) << infile << " is in A2M, A3M or FASTA format\n";
     }
 
-    Alignment ali_tmp(par.maxseq, par.maxres);
+    // batch tools pass a work alignment that is reused for all their entries
+    Alignment* ali_tmp = work ? work : new Alignment(par.maxseq, par.maxres);
 
     // Read alignment from infile into matrix X[k][l] as ASCII (and supply first line as extra argument)
-    ali_tmp.Read(inf, infile, par.mark, par.maxcol, par.nseqdis, line);
+    ali_tmp->Read(inf, infile, par.mark, par.maxcol, par.nseqdis, line);
 
     // Convert ASCII to int (0-20),throw out all insert states, record their number in I[k][i]
     // and store marked sequences in name[k] and seq[k]
-    ali_tmp.Compress(infile, par.cons, par.maxcol, par.M, par.Mgaps);
+    ali_tmp->Compress(infile, par.cons, par.maxcol, par.M, par.Mgaps);
 
-    ali_tmp.Shrink();
+    ali_tmp->Shrink();
 
     // Sort out the nseqdis most dissimilar sequences for display in the output alignments
-    ali_tmp.FilterForDisplay(par.max_seqid, par.mark, S, par.coverage, par.qid, par.qsc, par.nseqdis);
+    ali_tmp->FilterForDisplay(par.max_seqid, par.mark, S, par.coverage, par.qid, par.qsc, par.nseqdis);
 
     // Remove sequences with seq. identity larger than seqid percent (remove the shorter of two)
-    ali_tmp.N_filtered = ali_tmp.Filter(par.max_seqid, S, par.coverage, par.qid, par.qsc, par.Ndiff);
+    ali_tmp->N_filtered = ali_tmp->Filter(par.max_seqid, S, par.coverage, par.qid, par.qsc, par.Ndiff);
 
     if (par.Neff >= 0.999)
-    	ali_tmp.FilterNeff(use_global_weights, par.mark, par.cons, par.showcons, par.max_seqid, par.coverage, par.Neff, pb, S, Sim);
+    	ali_tmp->FilterNeff(use_global_weights, par.mark, par.cons, par.showcons, par.max_seqid, par.coverage, par.Neff, pb, S, Sim);
 
     // Calculate pos-specific weights, AA frequencies and transitions -> f[i][a], tr[i][a]
-    ali_tmp.FrequenciesAndTransitions(q, use_global_weights, par.mark, par.cons, par.showcons, pb, Sim);
+    ali_tmp->FrequenciesAndTransitions(q, use_global_weights, par.mark, par.cons, par.showcons, pb, Sim);
 
-    *qali = ali_tmp;
+    if (qali != NULL)
+      *qali = *ali_tmp;
+    if (ali_tmp != work)
+      delete ali_tmp;
     input_format = 0;
   }
   else {
 	HH_LOG(ERROR) << "Error in " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
 	HH_LOG(ERROR) << "\tunrecognized input file format in \'" << infile << "\'\n";
 	HH_LOG(ERROR) << "\tline = " << line << "\n";
-    exit(1);
+    return 1;
   }
 
   if (input_format == 0 && q->Neff_HMM > 11.0) {
 	  HH_LOG(WARNING) << "MSA " << q->name << " looks too diverse (Neff=" << q->Neff_HMM << ">11). Better check it with an alignment viewer for non-homologous segments. Also consider building the MSA with hhblits using the - option to limit MSA diversity.\n";
   }
+  return 0;
 }
 
+template int ReadQueryFile<FILE>(Parameters& par, FILE* inf, char& input_format,
+    char use_global_weights, HMM* q, Alignment* qali, char infile[], float* pb,
+    const float S[20][20], const float Sim[20][20], Alignment* work);
+template int ReadQueryFile<TextBuffer>(Parameters& par, TextBuffer* inf, char& input_format,
+    char use_global_weights, HMM* q, Alignment* qali, char infile[], float* pb,
+    const float S[20][20], const float Sim[20][20], Alignment* work);
+
 void ReadQueryFile(Parameters& par, char* infile, char& input_format,
     char use_global_weights, HMM* q, Alignment* qali, float* pb,
     const float S[20][20], const float Sim[20][20]) {
@@ -109,7 +122,9 @@ void ReadQueryFile(Parameters& par, char* infile, char& input_format,
     Pathname(path, infile);
   }
   
-  ReadQueryFile(par, inf, input_format, use_global_weights, q, qali, infile, pb, S, Sim);
+  int status = ReadQueryFile(par, inf, input_format, use_global_weights, q, qali, infile, pb, S, Sim);
+  if (status)
+    exit(status);
 
   fclose(inf);
 }
@@ -14,8 +14,12 @@
 #include "hhalignment.h"
 #include "hhhitlist.h"
 
-void ReadQueryFile(Parameters& par, FILE* inf, char& input_format, char use_global_weights, HMM* q, Alignment* qali, char infile[],
-		float* pb, const float S[20][20], const float Sim[20][20]);
+// Read a query HMM or alignment from a FILE or from a TextBuffer, e.g. an entry of an ffindex database
+// The query alignment is not kept if qali is NULL; an alignment file is read into work if given
+// Returns 0 on success, 4 for an empty input and 1 for an unrecognized format
+template <class Input>
+int ReadQueryFile(Parameters& par, Input* inf, char& input_format, char use_global_weights, HMM* q, Alignment* qali, char infile[],
+		float* pb, const float S[20][20], const float Sim[20][20], Alignment* work = NULL);
 
 void ReadQueryFile(Parameters& par, char* infile, char& input_format, char use_global_weights, HMM* q, Alignment* qali,
 		float* pb, const float S[20][20], const float Sim[20][20]);
@@ -201,6 +201,7 @@ void HalfAlignment::BuildFASTA() {
     AddInserts(i);
     FillUpGaps();
   }
+  AddChar('\0');
   ToFASTA();
 }
 
@@ -311,10 +312,7 @@ void HalfAlignment::AlignToTemplate(Hit& hit, const char outformat) {
 /////////////////////////////////////////////////////////////////////////////////////
 void HalfAlignment::Print(char* alnfile, const char append, char* commentname,
                           const char format[]) {
-  int k;      //counts sequences
-  int omitted = 0;  // counts number of sequences with no residues in match states
   FILE *outf;
-  char* tmp_name = new char[NAMELEN];
   if (strcmp(alnfile, "stdout")) {
     if (append)
       outf = fopen(alnfile, "a");
@@ -327,46 +325,48 @@ void HalfAlignment::Print(char* alnfile, const char append, char* commentname,
 
   HH_LOG(DEBUG) << "Writing alignment to " << alnfile << "\n";
 
+  std::stringstream out;
+  Print(out, commentname, format);
+  std::string output = out.str();
+  fwrite(output.c_str(), sizeof(char), output.size(), outf);
+  fclose(outf);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Write the a2m/a3m alignment into a stream, e.g. for an ffindex database entry
+/////////////////////////////////////////////////////////////////////////////////////
+void HalfAlignment::Print(std::stringstream& out, char* commentname,
+                          const char format[]) {
+  int k;      //counts sequences
+  char* tmp_name = new char[NAMELEN];
+
   if (!format || strcmp(format, "psi")) {
     if (commentname != NULL)
-      fprintf(outf, "#%s\n", commentname);
+      out << "#" << commentname << "\n";
 
     for (k = 0; k < n; k++)
       if (k == nss_pred || k == nss_conf || k == nss_dssp || k == nsa_dssp) {
-        fprintf(outf, ">%s\n", sname[k]);
-        fprintf(outf, "%s\n", s[k]);
+        out << ">" << sname[k] << "\n";
+        out << s[k] << "\n";
       }
     for (k = 0; k < n; k++) {
       if (!(k == nss_pred || k == nss_conf || k == nss_dssp || k == nsa_dssp)) {
-        // Print sequence only if it contains at least one residue in a match state
-        if (1)  //strpbrk(s[k],"ABCDEFGHIKLMNPQRSTUVWXYZ1234567890"))
-        {
-          fprintf(outf, ">%s\n", sname[k]);
-          fprintf(outf, "%s\n", s[k]);
-        } else {
-          omitted++;
-          HH_LOG(DEBUG)
-              << sname[k]
-              << " contains no residue in match state. Omitting sequence\n";
-        }
+        out << ">" << sname[k] << "\n";
+        out << s[k] << "\n";
       }
     }
-    if (omitted) {
-      HH_LOG(INFO) << "Omitted " << omitted << " sequences in "
-                             << alnfile
-                             << " which contained no residue in match state\n";
-    }
   } else {
+    char column[22];
     for (k = 0; k < n; k++) {
       strwrd(tmp_name, sname[k], NAMELEN);
-      fprintf(outf, "%-20.20s ", tmp_name);
+      snprintf(column, sizeof(column), "%-20.20s ", tmp_name);
+      out << column;
       char* ptr = s[k];
       for (; *ptr != '\0'; ptr++)
         if (*ptr == 45 || (*ptr >= 65 && *ptr <= 90))
-          fprintf(outf, "%c", *ptr);
-      fprintf(outf, "\n");
+          out << *ptr;
+      out << "\n";
     }
   }
-  fclose(outf);
   delete[] tmp_name;
 }
@@ -9,6 +9,7 @@
 #define HHHALFALIGNMENT_H
 
 #include <cstdlib>
+#include <sstream>
 
 class HalfAlignment
 {
@@ -27,6 +28,7 @@ public:
 
   // Write the a2m/a3m query alignment into alnfile 
   void Print(char* outfile, const char append, char* commentname = NULL, const char format[]=NULL);
+  void Print(std::stringstream& out, char* commentname = NULL, const char format[]=NULL);
 
   // Fill in insert states following match state i
   void AddInserts(int i);
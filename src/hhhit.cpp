@@ -316,3 +316,11 @@ void Hit::initHitFromHMM(HMM * q, HMM * t, const int par_nseqdis, const char ssm
             break;
     }
 }
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Write key "<file>__<irep>" of a hit into key[HITKEYLEN] (used for the hash of previous hits)
+/////////////////////////////////////////////////////////////////////////////////////
+const char* HitKey(char key[], const char* file, const int irep) {
+  snprintf(key, HITKEYLEN, "%s__%i", file, irep);
+  return key;
+}
@@ -194,4 +194,8 @@ double logPvalue(float x, float lamda, float mu);
 double logPvalue(float x, double a[]);
 int compareHitLengths(const void * a, const void * b);
 
+// Key of a hit in the hash of hits found in previous iterations: "<file>__<irep>"
+const int HITKEYLEN = NAMELEN + 16;
+const char* HitKey(char key[], const char* file, const int irep);
+
 #endif
@@ -0,0 +1,119 @@
+// hhhitbinary.cpp
+
+#include "hhhitbinary.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Check that offset points into the string section [begin, end) of record and that the string
+// is terminated inside it
+/////////////////////////////////////////////////////////////////////////////////////
+static bool IsValidString(const char* record, const uint32_t begin, const uint32_t end, const uint32_t offset) {
+  return offset < end - begin && memchr(record + begin + offset, '\0', end - begin - offset) != NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Check magic, section offsets, strings and paths of a binary hit record, so that the
+// printing functions stay within the record
+/////////////////////////////////////////////////////////////////////////////////////
+const HitBinaryHeader* ReadHitBinaryHeader(const char* data, const size_t size) {
+  if (size < sizeof(HitBinaryHeader) || memcmp(data, HITBINARY_MAGIC, sizeof(HITBINARY_MAGIC)))
+    return NULL;
+
+  const HitBinaryHeader* header = (const HitBinaryHeader*) data;
+  if (header->size > size
+      || header->strings < sizeof(HitBinaryHeader) + (size_t) header->n_hits * sizeof(HitBinaryHit)
+      || header->strings > header->size
+      || (header->paths && (header->paths < header->strings || header->paths > header->size)))
+    return NULL;
+
+  // the string section ends where the path section starts
+  const uint32_t strings_end = header->paths ? header->paths : header->size;
+  if (!IsValidString(data, header->strings, strings_end, header->q_name)
+      || !IsValidString(data, header->strings, strings_end, header->q_longname))
+    return NULL;
+
+  const HitBinaryHit* hits = (const HitBinaryHit*) (data + sizeof(HitBinaryHeader));
+  for (uint32_t n = 0; n < header->n_hits; n++) {
+    const HitBinaryHit& hit = hits[n];
+    if (!IsValidString(data, header->strings, strings_end, hit.file)
+        || !IsValidString(data, header->strings, strings_end, hit.longname))
+      return NULL;
+
+    if (hit.path_runs > 0 && (!header->paths
+        || (uint64_t) hit.path + (uint64_t) hit.path_runs * sizeof(HitBinaryPathRun) > header->size - header->paths))
+      return NULL;
+  }
+
+  return header;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Print hit list summary as in HitList::PrintHitList (without date and command line)
+/////////////////////////////////////////////////////////////////////////////////////
+void PrintHitBinarySummary(const char* record, std::ostream& out) {
+  const HitBinaryHeader* header = (const HitBinaryHeader*) record;
+  const HitBinaryHit* hits = (const HitBinaryHit*) (record + sizeof(HitBinaryHeader));
+  const char* strings = record + header->strings;
+
+  out << "Query         " << strings + header->q_longname << std::endl;
+  out << "Match_columns " << header->q_L << std::endl;
+  out << "No_of_seqs    " << header->q_N_filtered << " out of " << header->q_N_in
+      << std::endl;
+  out << "Neff          " << header->q_Neff_HMM << std::endl;
+  out << "Searched_HMMs " << header->N_searched << std::endl;
+  out << std::endl;
+
+  out
+      << " No Hit                             Prob E-value P-value  Score    SS Cols Query HMM  Template HMM"
+      << std::endl;
+
+  char line[1024];
+  for (uint32_t n = 0; n < header->n_hits; n++) {
+    const HitBinaryHit& hit = hits[n];
+
+    char Estr[10];
+    char Pstr[10];
+    char str[64];
+    snprintf(str, sizeof(str), "%3i %-30.30s    ", n + 1, strings + hit.longname);
+
+    if (hit.Eval >= 1E-99)
+      sprintf(Estr, "%7.2G", hit.Eval);
+    else
+      sprintf(Estr, "%7.0E", hit.Eval);
+    if (hit.Pval >= 1E-99)
+      sprintf(Pstr, "%7.2G", hit.Pval);
+    else
+      sprintf(Pstr, "%7.0E", hit.Pval);
+    snprintf(line, sizeof(line), "%-34.34s %5.1f %7s %7s ", str, hit.Probab, Estr, Pstr);
+    out << line;
+
+    // Needed for long sequences (more than 5 digits in length)
+    snprintf(str, sizeof(str), "%6.1f", hit.score);
+    snprintf(line, sizeof(line), "%-6.6s %5.1f %4i %4i-%-4i %4i-%-4i(%i)\n", str, hit.score_ss,
+        hit.matched_cols, hit.i1, hit.i2, hit.j1, hit.j2, hit.L);
+    out << line;
+  }
+
+  out << std::endl;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Print hits in BLAST tab format as in HitList::PrintM8File
+/////////////////////////////////////////////////////////////////////////////////////
+void PrintHitBinaryM8(const char* record, std::ostream& out) {
+  const HitBinaryHeader* header = (const HitBinaryHeader*) record;
+  const HitBinaryHit* hits = (const HitBinaryHit*) (record + sizeof(HitBinaryHeader));
+  const char* strings = record + header->strings;
+
+  char line[4096];
+  for (uint32_t n = 0; n < header->n_hits; n++) {
+    const HitBinaryHit& hit = hits[n];
+    snprintf(line, sizeof(line), "%s\t%s\t%1.3f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2E\t%.1f\n",
+        strings + header->q_name, strings + hit.file,
+        static_cast<float>(hit.identities) / static_cast<float>(hit.L), hit.L,
+        hit.mismatches, hit.gap_opens, hit.i1, hit.i2, hit.j1, hit.j2, hit.Eval, -hit.score_aass);
+    out << line;
+  }
+}
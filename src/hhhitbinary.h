@@ -0,0 +1,78 @@
+// hhhitbinary.h
+//
+// Binary hit format for large batch runs
+//
+// One binary hit record holds the hits of one query in a form that can be mapped into memory
+// and read in place (native byte order, all sections 8-byte aligned):
+//
+//   HitBinaryHeader                      magic, sizes and section offsets, query statistics
+//   HitBinaryHit[n_hits]                 fixed-size hit records, in the order of the hit list
+//   string section                       zero-terminated names, referenced by offsets
+//   path section (optional)              alignment paths as runs of equal pair states
+//
+// Records can be concatenated in one file or stored as entries of an ffindex database.
+// hhbin2txt converts them to the hit list summary of the HHR format or to BLAST tab (m8) format.
+
+#ifndef HHHITBINARY_H_
+#define HHHITBINARY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+
+const char HITBINARY_MAGIC[4] = {'H', 'H', 'B', 1};
+
+struct HitBinaryHeader {
+  char magic[4];          // HITBINARY_MAGIC
+  uint32_t size;          // size of the whole record in bytes
+  uint32_t n_hits;        // number of HitBinaryHit records following the header
+  uint32_t strings;       // offset of string section from start of record
+  uint32_t paths;         // offset of path section from start of record, 0 if no paths are stored
+  uint32_t q_name;        // offset of query name in string section
+  uint32_t q_longname;    // offset of full query name in string section
+  int32_t q_L;            // number of match states in query
+  int32_t q_N_filtered;   // number of sequences in query alignment after filtering
+  int32_t q_N_in;         // number of sequences in query alignment
+  int32_t N_searched;     // number of database HMMs searched
+  float q_Neff_HMM;       // diversity of query alignment
+};
+
+struct HitBinaryHit {
+  double Eval;            // E-value
+  double Pval;            // P-value
+  float Probab;           // probability in %
+  float score;            // score in bits
+  float score_ss;         // secondary structure score
+  float score_aass;       // negative log of P-value used for sorting (m8 score is -score_aass)
+  uint32_t file;          // offset of template file name in string section
+  uint32_t longname;      // offset of full template name in string section
+  uint32_t path;          // offset of path in path section
+  uint32_t path_runs;     // number of HitBinaryPathRun in path (0 if no path is stored)
+  int32_t irep;           // index of alternative alignment
+  int32_t L;              // number of match states in template
+  int32_t i1, i2;         // first and last aligned query match state
+  int32_t j1, j2;         // first and last aligned template match state
+  int32_t matched_cols;   // number of aligned match-match columns
+  int32_t identities;     // identical residues in aligned columns between the master sequences
+  int32_t mismatches;     // aligned columns with different residues
+  int32_t gap_opens;      // number of gaps opened in the alignment
+};
+
+// A run of 'length' steps in pair state 'state' (MM, GD, IM, DG, MI) that starts at query match state i
+// and template match state j. The runs are stored from the N- to the C-terminus of the alignment
+struct HitBinaryPathRun {
+  int32_t i;
+  int32_t j;
+  uint32_t state_length;  // (length << 4) | state
+};
+
+// Return the header of the binary record at data, or NULL if data does not start with a valid record
+const HitBinaryHeader* ReadHitBinaryHeader(const char* data, const size_t size);
+
+// Print the hits of a binary record in the format of the hit list summary of HHR files
+void PrintHitBinarySummary(const char* record, std::ostream& out);
+
+// Print the hits of a binary record in BLAST tab (m8) format
+void PrintHitBinaryM8(const char* record, std::ostream& out);
+
+#endif
@@ -24,18 +24,19 @@ inline float calc_hidden_output(const float* weights, const float* bias,
 ////////////////////////////////////////////////////////////////////////////////////
 //// Neural network regressions of lamda for EVD
 /////////////////////////////////////////////////////////////////////////////////////
+const int LAMDA_NN_INPUTS = 4;
+const int LAMDA_NN_HIDDEN = 4;
+const float LAMDA_NN_BIASES[] = { -0.73195, -1.43792, -1.18839, -3.01141 }; // bias for all hidden units
+const float LAMDA_NN_WEIGHTS[] = { // Weights for the neural networks (column = start unit, row = end unit)
+    -0.52356, -3.37650, 1.12984, -0.46796, -4.71361, 0.14166, 1.66807,
+        0.16383, -0.94895, -1.24358, -1.20293, 0.95434, -0.00318, 0.53022,
+        -0.04914, -0.77046, 2.45630, 3.02905, 2.53803, 2.64379 };
+
 inline float lamda_NN(float Lqnorm, float Ltnorm, float Nqnorm, float Ntnorm) {
-  const int inputs = 4;
-  const int hidden = 4;
-  const float biases[] = { -0.73195, -1.43792, -1.18839, -3.01141 }; // bias for all hidden units
-  const float weights[] = { // Weights for the neural networks (column = start unit, row = end unit)
-      -0.52356, -3.37650, 1.12984, -0.46796, -4.71361, 0.14166, 1.66807,
-          0.16383, -0.94895, -1.24358, -1.20293, 0.95434, -0.00318, 0.53022,
-          -0.04914, -0.77046, 2.45630, 3.02905, 2.53803, 2.64379 };
   float lamda = 0.0;
-  for (int h = 0; h < hidden; h++) {
-    lamda += calc_hidden_output(weights + inputs * h, biases + h, Lqnorm,
-        Ltnorm, Nqnorm, Ntnorm) * weights[hidden * inputs + h];
+  for (int h = 0; h < LAMDA_NN_HIDDEN; h++) {
+    lamda += calc_hidden_output(LAMDA_NN_WEIGHTS + LAMDA_NN_INPUTS * h, LAMDA_NN_BIASES + h, Lqnorm,
+        Ltnorm, Nqnorm, Ntnorm) * LAMDA_NN_WEIGHTS[LAMDA_NN_HIDDEN * LAMDA_NN_INPUTS + h];
   }
   return lamda;
 }
@@ -43,21 +44,22 @@ inline float lamda_NN(float Lqnorm, float Ltnorm, float Nqnorm, float Ntnorm) {
 ////////////////////////////////////////////////////////////////////////////////////
 //// Neural network regressions of mu for EVD
 /////////////////////////////////////////////////////////////////////////////////////
+const int MU_NN_INPUTS = 4;
+const int MU_NN_HIDDEN = 6;
+const float MU_NN_BIASES[] = { -4.25264, -3.63484, -5.86653, -4.78472, -2.76356,
+    -2.21580 };  // bias for all hidden units
+const float MU_NN_WEIGHTS[] = { // Weights for the neural networks (column = start unit, row = end unit)
+    1.96172, 1.07181, -7.41256, 0.26471, 0.84643, 1.46777, -1.04800, -0.51425,
+        1.42697, 1.99927, 0.64647, 0.27834, 1.34216, 1.64064, 0.35538,
+        -8.08311, 2.30046, 1.31700, -0.46435, -0.46803, 0.90090, -3.53067,
+        0.59212, 1.47503, -1.26036, 1.52812, 1.58413, -1.90409, 0.92803,
+        -0.66871 };
+
 inline float mu_NN(float Lqnorm, float Ltnorm, float Nqnorm, float Ntnorm) {
-  const int inputs = 4;
-  const int hidden = 6;
-  const float biases[] = { -4.25264, -3.63484, -5.86653, -4.78472, -2.76356,
-      -2.21580 };  // bias for all hidden units
-  const float weights[] = { // Weights for the neural networks (column = start unit, row = end unit)
-      1.96172, 1.07181, -7.41256, 0.26471, 0.84643, 1.46777, -1.04800, -0.51425,
-          1.42697, 1.99927, 0.64647, 0.27834, 1.34216, 1.64064, 0.35538,
-          -8.08311, 2.30046, 1.31700, -0.46435, -0.46803, 0.90090, -3.53067,
-          0.59212, 1.47503, -1.26036, 1.52812, 1.58413, -1.90409, 0.92803,
-          -0.66871 };
   float mu = 0.0;
-  for (int h = 0; h < hidden; h++) {
-    mu += calc_hidden_output(weights + inputs * h, biases + h, Lqnorm, Ltnorm,
-        Nqnorm, Ntnorm) * weights[hidden * inputs + h];
+  for (int h = 0; h < MU_NN_HIDDEN; h++) {
+    mu += calc_hidden_output(MU_NN_WEIGHTS + MU_NN_INPUTS * h, MU_NN_BIASES + h, Lqnorm, Ltnorm,
+        Nqnorm, Ntnorm) * MU_NN_WEIGHTS[MU_NN_HIDDEN * MU_NN_INPUTS + h];
   }
   return 20.0 * mu;
 }
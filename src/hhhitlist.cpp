@@ -247,6 +247,32 @@ void HitList::PrintScoreFile(HMM* q, char* outputfile) {
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Count identical and different residues in match-match columns between the master sequences
+// and the number of gaps opened in the alignment of a hit (for BLAST tab format)
+/////////////////////////////////////////////////////////////////////////////////////
+static void CountAlignedColumns(HMM* q, Hit& hit, int& matchCount, int& missMatchCount, int& gapOpenCount) {
+    bool isGapOpen = false;
+    for (int step = hit.nsteps; step >= 1; step--){
+        if (hit.states[step] == GD || hit.states[step] == DG) {
+            if(isGapOpen == false){
+            gapOpenCount++;
+            }
+            isGapOpen = true;
+        }else if (hit.states[step] == MM){
+            if(hit.seq[hit.nfirst][hit.j[step]] == q->seq[q->nfirst][hit.i[step]]){
+                matchCount++;
+            }else{
+                missMatchCount++;
+            }
+            isGapOpen = false;
+        }else{
+            isGapOpen = false;
+        }
+    }
+}
+
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Print score distribution into a blast tab file
 /////////////////////////////////////////////////////////////////////////////////////
@@ -295,24 +321,7 @@ void HitList::PrintM8File(HMM* q, std::stringstream& outbuffer, const int nhits,
         int gapOpenCount = 0;
         int missMatchCount = 0;
         int matchCount  = 0;
-        bool isGapOpen = false;
-        for (int step = hit.nsteps; step >= 1; step--){
-            if (hit.states[step] == GD || hit.states[step] == DG) {
-                if(isGapOpen == false){
-                gapOpenCount++;
-                }
-                isGapOpen = true;
-            }else if (hit.states[step] == MM){
-                if(hit.seq[hit.nfirst][hit.j[step]] == q->seq[q->nfirst][hit.i[step]]){
-                    matchCount++;
-                }else{
-                    missMatchCount++;
-                }
-                isGapOpen = false;
-            }else{
-                isGapOpen = false;
-            }
-        }
+        CountAlignedColumns(q, hit, matchCount, missMatchCount, gapOpenCount);
         sprintf(line, "%s\t%s\t%1.3f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2E\t%.1f\n",
                 q->name, hit.file, static_cast<float>(matchCount)/static_cast<float>(hit.L), hit.L, missMatchCount, gapOpenCount,
                 hit.i1, hit.i2, hit.j1, hit.j2, hit.Eval, -hit.score_aass);
@@ -322,6 +331,139 @@ void HitList::PrintM8File(HMM* q, std::stringstream& outbuffer, const int nhits,
 
 
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Write hits of hit list summary (same selection as PrintHitList) as binary hit record (see hhhitbinary.h)
+/////////////////////////////////////////////////////////////////////////////////////
+void HitList::WriteBinaryFile(HMM* q, char* outputfile, const int z, const int Z,
+    const float p, const double E, const bool paths) {
+  std::stringstream outbuffer(std::stringstream::in | std::stringstream::out | std::stringstream::binary);
+  WriteBinaryFile(q, outbuffer, z, Z, p, E, paths);
+
+  if (strcmp(outputfile, "stdout") == 0) {
+    std::cout << outbuffer.str();
+  }
+  else {
+    std::ofstream out(outputfile, std::ios::out | std::ios::binary);
+    if (!out.good()) {
+      HH_LOG(WARNING) << "In " << __FILE__ << ":" << __LINE__ << ": " << __func__ << ":" << std::endl;
+      HH_LOG(WARNING) << "\tCould not open \'" << outputfile << std::endl;
+      return;
+    }
+
+    out << outbuffer.str();
+
+    out.close();
+  }
+}
+
+// Append zero-terminated string to string section and return its offset
+static uint32_t AddBinaryString(std::string& strings, const char* str) {
+  uint32_t offset = strings.size();
+  strings.append(str ? str : "");
+  strings.push_back('\0');
+  return offset;
+}
+
+// Round up to a multiple of 8 bytes
+static size_t AlignBinarySize(size_t size) {
+  return (size + 7) & ~((size_t) 7);
+}
+
+void HitList::WriteBinaryFile(HMM* q, std::stringstream& out, const int z, const int Z,
+    const float p, const double E, const bool paths) {
+  std::vector<HitBinaryHit> hits;
+  std::vector<HitBinaryPathRun> runs;
+  std::string strings;
+
+  HitBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, HITBINARY_MAGIC, sizeof(HITBINARY_MAGIC));
+  header.q_name = AddBinaryString(strings, q->name);
+  header.q_longname = AddBinaryString(strings, q->longname);
+  header.q_L = q->L;
+  header.q_N_filtered = q->N_filtered;
+  header.q_N_in = q->N_in;
+  header.N_searched = N_searched;
+  header.q_Neff_HMM = q->Neff_HMM;
+
+  int nhits = 0;
+  Reset();
+  while (!End()) {
+    Hit& hit = *ReadNextAddress();
+    if (nhits >= Z)
+      break;       //max number of lines reached?
+    if (nhits >= z && hit.Probab < p)
+      break;
+    if (nhits >= z && hit.Eval > E)
+      continue;
+    nhits++;
+
+    HitBinaryHit record;
+    memset(&record, 0, sizeof(record));
+    record.Eval = hit.Eval;
+    record.Pval = hit.Pval;
+    record.Probab = hit.Probab;
+    record.score = hit.score;
+    record.score_ss = hit.score_ss;
+    record.score_aass = hit.score_aass;
+    record.file = AddBinaryString(strings, hit.file);
+    record.longname = AddBinaryString(strings, hit.longname);
+    record.irep = hit.irep;
+    record.L = hit.L;
+    record.i1 = hit.i1;
+    record.i2 = hit.i2;
+    record.j1 = hit.j1;
+    record.j2 = hit.j2;
+    record.matched_cols = hit.matched_cols;
+    int identities = 0, mismatches = 0, gap_opens = 0;
+    CountAlignedColumns(q, hit, identities, mismatches, gap_opens);
+    record.identities = identities;
+    record.mismatches = mismatches;
+    record.gap_opens = gap_opens;
+
+    // Pack alignment path into runs of equal states from N- to C-terminus
+    if (paths && hit.states) {
+      record.path = runs.size() * sizeof(HitBinaryPathRun);
+      for (int step = hit.nsteps; step >= 1; ) {
+        HitBinaryPathRun run;
+        run.i = hit.i[step];
+        run.j = hit.j[step];
+        int length = 0;
+        const char state = hit.states[step];
+        while (step >= 1 && hit.states[step] == state) {
+          length++;
+          step--;
+        }
+        run.state_length = ((uint32_t) length << 4) | (uint32_t) state;
+        runs.push_back(run);
+        record.path_runs++;
+      }
+    }
+    hits.push_back(record);
+  }
+
+  header.n_hits = hits.size();
+  header.strings = sizeof(HitBinaryHeader) + hits.size() * sizeof(HitBinaryHit);
+  size_t size = AlignBinarySize(header.strings + strings.size());
+  if (paths) {
+    header.paths = size;
+    size = AlignBinarySize(size + runs.size() * sizeof(HitBinaryPathRun));
+  }
+  header.size = size;
+
+  const char padding[8] = {0};
+  out.write((const char*) &header, sizeof(header));
+  if (!hits.empty())
+    out.write((const char*) &hits[0], hits.size() * sizeof(HitBinaryHit));
+  out.write(strings.data(), strings.size());
+  out.write(padding, AlignBinarySize(header.strings + strings.size()) - (header.strings + strings.size()));
+  if (paths) {
+    if (!runs.empty())
+      out.write((const char*) &runs[0], runs.size() * sizeof(HitBinaryPathRun));
+    out.write(padding, size - (header.paths + runs.size() * sizeof(HitBinaryPathRun)));
+  }
+}
+
 void HitList::PrintScoreFile(HMM* q, std::stringstream& outbuffer) {
   Hash<int> twice(10000); // make sure only one hit per HMM is listed
   twice.Null(-1);
@@ -462,7 +604,6 @@ void HitList::WriteToAlifile(HMM* q, std::stringstream& out,
 void HitList::CalculateHHblitsEvalues(HMM* q, const int dbsize,
     const float alphaa, const float alphab, const float alphac,
     const double prefilter_evalue_thresh) {
-  Hit hit;
   double alpha = 0;
   double log_Pcut = log(prefilter_evalue_thresh / dbsize);
   double log_dbsize = log((double) dbsize);
@@ -471,7 +612,7 @@ void HitList::CalculateHHblitsEvalues(HMM* q, const int dbsize,
 
   Reset();
   while (!End()) {
-    hit = ReadNext();
+    Hit& hit = *ReadNextAddress();  // update hit in place
 
     // if (nhits++<50)
     // 	printf("before correction  Eval: %7.4g    logEval: %7.4f\n",hit.Eval, hit.logEval);
@@ -484,10 +625,8 @@ void HitList::CalculateHHblitsEvalues(HMM* q, const int dbsize,
 
     // if (nhits++<50) //DEBUG?????
     //  	printf("                   Eval: %11.3E    logEval: %7.4f   logPval: %7.4f   alpha: %7.4f   Neff_T: %5.2f  Neff_Q: %5.2f\n",hit.Eval, hit.logEval, hit.logPval, alpha, hit.Neff_HMM, q->Neff_HMM);//DEBUG?????
-
-    Overwrite(hit);   // copy hit object into current position of hitlist
   }
-  ResortList(); // use InsertSort to resort list according to sum of minus-log-Pvalues
+  SortList(); // resort list according to sum of minus-log-Pvalues
 }
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -495,9 +634,7 @@ void HitList::CalculateHHblitsEvalues(HMM* q, const int dbsize,
 /////////////////////////////////////////////////////////////////////////////////////
 void HitList::CalculatePvalues(HMM* q, const char loc, const char ssm,
     const float ssw) {
-  Hit hit;
   float lamda = LAMDA_GLOB, mu = 3.0;   // init for global search
-  const float log1000 = log(1000.0);
 
   if (N_searched == 0)
     N_searched = 1;
@@ -506,25 +643,84 @@ void HitList::CalculatePvalues(HMM* q, const char loc, const char ssm,
       << "Calculate Pvalues as a function of query and template lengths and diversities..."
       << std::endl;
 
+  // Predict lamda and mu for all hits in one pass
+  std::vector<float> lamdas, mus;
+  if (loc) {
+    std::vector<int> t_L;
+    std::vector<float> t_Neff_HMM;
+    Reset();
+    while (!End()) {
+      Hit* hit = ReadNextAddress();
+      t_L.push_back(hit->L);
+      t_Neff_HMM.push_back(hit->Neff_HMM);
+    }
+    lamdas.resize(t_L.size());
+    mus.resize(t_L.size());
+    statistics.SetQuery(q->L, q->Neff_HMM);
+    if (!t_L.empty())
+      statistics.LamdaMu(t_L.size(), &t_L[0], &t_Neff_HMM[0], &lamdas[0], &mus[0]);
+  }
+
+  size_t k = 0;
   Reset();
   while (!End()) {
-    hit = ReadNext();
+    Hit& hit = *ReadNextAddress();  // update hit in place
 
     if (loc) {
-      lamda = lamda_NN(log(q->L) / log1000, log(hit.L) / log1000,
-          q->Neff_HMM / 10.0, hit.Neff_HMM / 10.0);
-      mu = mu_NN(log(q->L) / log1000, log(hit.L) / log1000, q->Neff_HMM / 10.0,
-          hit.Neff_HMM / 10.0);
+      lamda = lamdas[k];
+      mu = mus[k];
+      k++;
     }
     hit.logPval = logPvalue(hit.score, lamda, mu);
     hit.Pval = Pvalue(hit.score, lamda, mu);
     hit.CalcEvalScoreProbab(N_searched, lamda, loc, ssm, ssw); // calculate Evalue, score_aass, Proba from logPval and score_ss
-
-    Overwrite(hit);
   }
 
   SortList();
-  Reset();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Sort hits in ascending order of score_sort
+/////////////////////////////////////////////////////////////////////////////////////
+void HitList::SortList() {
+  if (n_deleted)
+    Compact();
+
+  // Sort (score_sort, position) pairs, so the comparisons do not have to look up the hits
+  // and hits with equal score_sort keep their current order
+  std::vector<std::pair<float, size_t> > keys(order.size());
+  for (size_t i = 0; i < order.size(); i++)
+    keys[i] = std::make_pair(StoredHit(order[i]).score_sort, i);
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<size_t> sorted(order.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    sorted[i] = order[keys[i].second];
+  order.swap(sorted);
+  current = -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+//// Remove deleted positions from the list order
+/////////////////////////////////////////////////////////////////////////////////////
+void HitList::Compact() {
+  size_t n = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    if (order[i] != DELETED) {
+      order[n++] = order[i];
+    }
+    else if ((long) i <= current) {
+      current--;
+    }
+  }
+  order.resize(n);
+  n_deleted = 0;
+  n_front_deleted = 0;
+
+  // All hits are deleted; start filling the storage again from the beginning
+  if (n == 0) {
+    n_hits = 0;
+  }
 }
 
 void HitList::PrintMatrices(HMM* q, const char* matricesOutputFileName,
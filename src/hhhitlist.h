@@ -11,10 +11,13 @@
 #include <ctype.h>    // islower, isdigit etc
 #include <sstream>
 #include <set>
+#include <vector>
+#include <algorithm>
 
 #include "hhhitlist-inl.h"
+#include "hhstatistics.h"
+#include "hhhitbinary.h"
 #include "hhhit.h"
-#include "list.h"
 #include "hash.h"
 #include "hhfullalignment.h"
 #include "log.h"
@@ -24,19 +27,131 @@
 
 /////////////////////////////////////////////////////////////////////////////////////
 // HitList is a list of hits of type Hit which can be operated upon by several anaylsis methods 
+//
+// The hits are stored contiguously in chunks of HIT_CHUNK hits. A stored hit is never moved, so the
+// addresses returned by Push() and ReadCurrentAddress() remain valid until the hit is deleted
+// and the list is emptied. The chunks are kept for reuse when the list is emptied.
+// The order of the list is kept as a vector of indices into the store, so sorting moves
+// indices instead of Hit objects. Delete() only marks the position as deleted;
+// deleted positions are removed at the next Reset() or sort.
+// Reading works with a current position as for List<Hit>: Reset(), End(), ReadNext(), Delete()
 /////////////////////////////////////////////////////////////////////////////////////
-class HitList : public List<Hit>
+class HitList
 {
 private:
   double score[MAXPROF];        // HHsearch score of each HMM for ML fit
   double weight[MAXPROF];       // weight of each HMM = 1/(size_fam[tfam]*size_sfam[hit.sfam]) for ML fit
 
+  static const size_t DELETED = (size_t) -1;
+  static const size_t HIT_CHUNK = 256;
+
+  std::vector<Hit*> chunks;     // storage for the hits, HIT_CHUNK hits per chunk
+  size_t n_hits;                // number of hits stored since the list was last empty
+  std::vector<size_t> order;    // order[i] = storage index of i'th list element, or DELETED
+  size_t n_deleted;             // number of DELETED entries in order
+  long n_front_deleted;         // all positions before n_front_deleted are DELETED
+  long current;                 // current position in order (-1: before first element)
+
+  // Position of the next element that has not been deleted (order.size() at end of list)
+  long NextPosition() {
+    while (n_front_deleted < (long) order.size() && order[n_front_deleted] == DELETED)
+      ++n_front_deleted;
+    long pos = std::max(current + 1, n_front_deleted);
+    while (pos < (long) order.size() && order[pos] == DELETED)
+      ++pos;
+    return pos;
+  }
+
+  // Hit with index i in the storage
+  Hit& StoredHit(size_t i) {
+    return chunks[i / HIT_CHUNK][i % HIT_CHUNK];
+  }
+
+  // Remove deleted positions from order; reuse the storage once all hits are deleted
+  void Compact();
+
+  HitStatistics statistics;     // lamda and mu of the EVDs for the current query
+
 public:
   int N_searched;               // number of sequences searched from HMM database
   Hash<float>* blast_logPvals;  // Hash containing names and log(P-values) read from BLAST file (needed for HHblits)
 
-  HitList() {blast_logPvals=NULL;}
-  ~HitList() {if (blast_logPvals) delete blast_logPvals;}
+  HitList() : n_hits(0), n_deleted(0), n_front_deleted(0), current(-1) {blast_logPvals=NULL;}
+  ~HitList() {
+    if (blast_logPvals) delete blast_logPvals;
+    for (size_t c = 0; c < chunks.size(); c++)
+      delete[] chunks[c];
+  }
+
+  // Number of hits in list
+  int Size() {
+    return order.size() - n_deleted;
+  }
+
+  // Reset current position to before the first hit
+  int Reset() {
+    if (n_deleted)
+      Compact();
+    current = -1;
+    return Size();
+  }
+
+  // True if ReadNext() has no hit left to read
+  char End() {
+    return NextPosition() >= (long) order.size();
+  }
+
+  // Append hit at end of list and return its address
+  Hit* Push(const Hit& hit) {
+    if (n_hits == chunks.size() * HIT_CHUNK)
+      chunks.push_back(new Hit[HIT_CHUNK]);
+    Hit* stored = &StoredHit(n_hits);
+    *stored = hit;
+    order.push_back(n_hits++);
+    return stored;
+  }
+
+  // Advance current position by 1 and return a copy of the hit there
+  Hit ReadNext() {
+    Hit* hit = ReadNextAddress();
+    return hit ? *hit : Hit();
+  }
+
+  // Advance current position by 1 and return the address of the hit there (NULL at end of list)
+  Hit* ReadNextAddress() {
+    current = NextPosition();
+    if (current >= (long) order.size())
+      return NULL;
+    return &StoredHit(order[current]);
+  }
+
+  // Return the address of the hit at the current position (NULL if there is none)
+  Hit* ReadCurrentAddress() {
+    if (current < 0 || current >= (long) order.size() || order[current] == DELETED)
+      return NULL;
+    return &StoredHit(order[current]);
+  }
+
+  // Remove the hit at the current position from the list and return it; the next ReadNext()
+  // returns the hit after it. As for List<Hit>, the hit before a deleted hit becomes the
+  // current one, and if there is none (e.g. after Reset()) the first hit is removed
+  Hit Delete() {
+    if (current >= (long) order.size())
+      return Hit();
+    while (current >= n_front_deleted && order[current] == DELETED)
+      --current;
+    if (current < n_front_deleted)
+      current = NextPosition();
+    if (current >= (long) order.size())
+      return Hit();
+    Hit hit = StoredHit(order[current]);
+    order[current] = DELETED;
+    n_deleted++;
+    return hit;
+  }
+
+  // Sort hits in ascending order of score_sort and reset current position
+  void SortList();
 
   // Print summary listing of hits
   void PrintHitList(HMM* q, std::stringstream& out, const unsigned int maxdbstrlen, const int z, const int Z, const float p, const double E, const int argc, const char** argv);
@@ -66,6 +181,10 @@ public:
   void PrintM8File(HMM* q, char* outputfile, const int nhits, const float p, const int b, const double E);
   void PrintM8File(HMM* q, std::stringstream& outputstream, const int nhits, const float p, const int b, const double E);
 
+  // Write hits of the hit list summary as binary hit record (see hhhitbinary.h), optionally with alignment paths
+  void WriteBinaryFile(HMM* q, char* outputfile, const int z, const int Z, const float p, const double E, const bool paths);
+  void WriteBinaryFile(HMM* q, std::stringstream& out, const int z, const int Z, const float p, const double E, const bool paths);
+
   void PrintMatrices(HMM* q, const char* matricesOutputFileName, const bool filter_matrices, const size_t max_number_matrices, const float S[20][20]);
   void PrintMatrices(HMM* q, std::stringstream& out, const bool filter_matrices, const size_t max_number_matrices, const float S[20][20]);
   
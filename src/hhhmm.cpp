@@ -25,14 +25,20 @@ HMM::HMM(int maxseqdis, int maxres) : maxseqdis(maxseqdis), maxres(maxres) {
 	g = new float*[maxres]; // f[i][a] = prob of finding amino acid a in column i WITH pseudocounts
 	p = new float*[maxres]; // p[i][a] = prob of finding amino acid a in column i WITH OPTIMUM pseudocounts
 	tr = new float*[maxres]; // log2 of transition probabilities M2M M2I M2D I2M I2I D2M D2D
-	for (int i = 0; i < maxres; i++)
-		f[i] = new float[NAA + 3];
-	for (int i = 0; i < maxres; i++)
-		g[i] = new float[NAA];
-	for (int i = 0; i < maxres; i++)
-		p[i] = (float*) mem_align(ALIGN_FLOAT, NAA * sizeof(float)); // align memory on 16B/32B boundaries for SSE2 / AVX
-	for (int i = 0; i < maxres; i++)
-		tr[i] = (float*) mem_align(ALIGN_FLOAT, NTRANS * sizeof(float));
+	// Rows of f, g, p and tr are carved out of one slab per array instead of being allocated one by one.
+	// Rows are padded to a multiple of VECSIZE_FLOAT, so every row stays aligned on 16B/32B boundaries for SSE2 / AVX
+	const size_t aa_stride = ((NAA + 3 + VECSIZE_FLOAT - 1) / VECSIZE_FLOAT) * VECSIZE_FLOAT;
+	const size_t tr_stride = ((NTRANS + VECSIZE_FLOAT - 1) / VECSIZE_FLOAT) * VECSIZE_FLOAT;
+	f_data = (float*) malloc_simd_float(maxres * aa_stride * sizeof(float));
+	g_data = (float*) malloc_simd_float(maxres * aa_stride * sizeof(float));
+	p_data = (float*) malloc_simd_float(maxres * aa_stride * sizeof(float));
+	tr_data = (float*) malloc_simd_float(maxres * tr_stride * sizeof(float));
+	for (int i = 0; i < maxres; i++) {
+		f[i] = f_data + i * aa_stride;
+		g[i] = g_data + i * aa_stride;
+		p[i] = p_data + i * aa_stride;
+		tr[i] = tr_data + i * tr_stride;
+	}
 
 	L = 0;
 	Neff_HMM = 0;
@@ -78,32 +84,50 @@ HMM::~HMM() {
 	delete[] ss_pred;
 	delete[] ss_conf;
 	delete[] l;
-	for (int i = 0; i < maxres; i++)
-		if (f[i])
-			delete[] f[i];
-		else
-			break;
-	for (int i = 0; i < maxres; i++)
-		if (g[i])
-			delete[] g[i];
-		else
-			break;
-	for (int i = 0; i < maxres; i++)
-		if (p[i])
-			free(p[i]);
-		else
-			break;
-	for (int i = 0; i < maxres; i++)
-		if (tr[i])
-			free(tr[i]);
-		else
-			break;
+	free(f_data);
+	free(g_data);
+	free(p_data);
+	free(tr_data);
 	delete[] f;
 	delete[] g;
 	delete[] p;
 	delete[] tr;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Reset to the state after construction
+// The readers fill in name, longname, fam and the consensus sequence only if they are not set yet
+/////////////////////////////////////////////////////////////////////////////////////
+void HMM::Reset() {
+	if (!dont_delete_seqs) // don't delete sname and seq if flat copy to hit object has been made
+	{
+		for (int k = 0; k < n_seqs; k++)
+			delete[] sname[k];
+		for (int k = 0; k < n_seqs; k++)
+			delete[] seq[k];
+	} else // Delete all not shown sequences (lost otherwise)
+	{
+		if (n_seqs > n_display) {
+			for (int k = n_display; k < n_seqs; k++)
+				delete[] sname[k];
+			for (int k = n_display; k < n_seqs; k++)
+				delete[] seq[k];
+		}
+	}
+
+	L = 0;
+	Neff_HMM = 0;
+	n_display = n_seqs = N_in = N_filtered = 0;
+	nss_dssp = nsa_dssp = nss_pred = nss_conf = nfirst = ncons = -1;
+	lamda = 0.0;
+	mu = 0.0;
+	name[0] = longname[0] = fam[0] = '\0';
+	trans_lin = 0; // transition probs in log space
+	dont_delete_seqs = false;
+	has_pseudocounts = false;
+	divided_by_local_bg_freqs = false;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Deep-copy constructor
 /////////////////////////////////////////////////////////////////////////////////////
@@ -196,7 +220,8 @@ HMM& HMM::operator=(HMM& q) {
 /////////////////////////////////////////////////////////////////////////////////////
 //// Read an HMM from an HHsearch .hhm file; return 0 at end of file
 /////////////////////////////////////////////////////////////////////////////////////
-int HMM::Read(FILE* dbf, const int maxcol, const int nseqdis, float* pb,
+template <class Input>
+int HMM::Read(Input* dbf, const int maxcol, const int nseqdis, float* pb,
 		char* path) {
 	char line[LINELEN] = "";    // input line
 	char str3[8] = "", str4[8] = ""; // first 3 and 4 letters of input line
@@ -689,7 +714,8 @@ int HMM::Read(FILE* dbf, const int maxcol, const int nseqdis, float* pb,
 /////////////////////////////////////////////////////////////////////////////////////
 //// Read an HMM from a HMMer .hmm file; return 0 at end of file
 /////////////////////////////////////////////////////////////////////////////////////
-int HMM::ReadHMMer(FILE* dbf, const char showcons, float* pb, char* filestr) {
+template <class Input>
+int HMM::ReadHMMer(Input* dbf, const char showcons, float* pb, char* filestr) {
 	char line[LINELEN] = "";    // input line
 	char desc[DESCLEN] = "";    // description of family
 	char str4[5] = "";          // first 4 letters of input line
@@ -1200,7 +1226,8 @@ int HMM::ReadHMMer(FILE* dbf, const char showcons, float* pb, char* filestr) {
 /////////////////////////////////////////////////////////////////////////////////////
 //// Read an HMM from a HMMER3 .hmm file; return 0 at end of file
 /////////////////////////////////////////////////////////////////////////////////////
-int HMM::ReadHMMer3(FILE* dbf, const char showcons, float* pb, char* filestr) {
+template <class Input>
+int HMM::ReadHMMer3(Input* dbf, const char showcons, float* pb, char* filestr) {
 	char line[LINELEN] = "";    // input line
 	char desc[DESCLEN] = "";    // description of family
 	char str4[5] = "";          // first 4 letters of input line
@@ -2416,3 +2443,11 @@ void HMM::AddSSPrediction(char seq_pred[], char seq_conf[]) {
 	}
 }
 
+
+// The readers are compiled for input from files and from ffindex entries held in memory
+template int HMM::Read<FILE>(FILE* dbf, const int maxcol, const int nseqdis, float* pb, char* path);
+template int HMM::Read<TextBuffer>(TextBuffer* dbf, const int maxcol, const int nseqdis, float* pb, char* path);
+template int HMM::ReadHMMer<FILE>(FILE* dbf, const char showcons, float* pb, char* filestr);
+template int HMM::ReadHMMer<TextBuffer>(TextBuffer* dbf, const char showcons, float* pb, char* filestr);
+template int HMM::ReadHMMer3<FILE>(FILE* dbf, const char showcons, float* pb, char* filestr);
+template int HMM::ReadHMMer3<TextBuffer>(TextBuffer* dbf, const char showcons, float* pb, char* filestr);
@@ -22,6 +22,9 @@ class HMM {
   ~HMM();
   HMM& operator=(HMM&);
 
+  // Drop the sequences and names of the current HMM, so that the object can be reused for the next one
+  void Reset();
+
   const int maxres;
   const int maxseqdis;
 
@@ -61,15 +64,19 @@ class HMM {
   const static int PRED_PRED = 4;
 
   // Read an HMM from a HHsearch .hhm file and return 0 at end of file
-  int Read(FILE* dbf, const int maxcol, const int nseqdis, float* pb,
+  // The Read functions take their input as FILE or TextBuffer
+  template <class Input>
+  int Read(Input* dbf, const int maxcol, const int nseqdis, float* pb,
            char* path = NULL);
 
   // Read an HMM from a HMMer .hmm file; return 0 at end of file
-  int ReadHMMer(FILE* dbf, const char showcons, float* pb,
+  template <class Input>
+  int ReadHMMer(Input* dbf, const char showcons, float* pb,
                 char* filestr = NULL);
 
   // Read an HMM from a HMMer3 .hmm file; return 0 at end of file
-  int ReadHMMer3(FILE* dbf, const char showcons, float* pb,
+  template <class Input>
+  int ReadHMMer3(Input* dbf, const char showcons, float* pb,
                  char* filestr = NULL);
 
   // Add transition pseudocounts to HMM
@@ -148,6 +155,10 @@ class HMM {
   float** f;  // f[i][a] = prob of finding amino acid a in column i WITHOUT pseudocounts
   float** g;  // g[i][a] = prob of finding amino acid a in column i WITH pseudocounts
   float** tr;  // tr[i][X2Y] = log2 of transition probabilities M2M M2I M2D I2M I2I D2M D2D
+  float* f_data;  // slab holding all rows f[i]
+  float* g_data;  // slab holding all rows g[i]
+  float* p_data;  // slab holding all rows p[i]
+  float* tr_data;  // slab holding all rows tr[i]
 
   char* ss_dssp;  // secondary structure determined by dssp 0:-  1:H  2:E  3:C  4:S  5:T  6:G  7:B
   char* sa_dssp;  // solvent accessibility state determined by dssp 0:-  1:A (absolutely buried) 2:B  3:C  4:D  5:E (exposed)
@@ -159,7 +170,8 @@ class HMM {
   bool has_pseudocounts;    // set to true if HMM contains pseudocounts
 
   // Utility for Read()
-  int Warning(FILE* dbf, char line[], char name[]) {
+  template <class Input>
+  int Warning(Input* dbf, char line[], char name[]) {
     HH_LOG(WARNING) << "Warning in " << __FILE__ << ":" << __LINE__
                               << ": " << __func__ << ":" << std::endl;
     HH_LOG(WARNING) << "\tcould not read line\n\'" << line
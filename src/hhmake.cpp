@@ -33,6 +33,9 @@
 #include <errno.h>    // perror(), strerror(errno)
 #include <ctype.h>    // islower, isdigit etc
 #include <cassert>
+#include <sstream>
+#include <string>
+#include <algorithm>
 
 #include "hhsuite_config.h"
 #include "cs.h"          // context-specific pseudocounts
@@ -50,6 +53,7 @@
 #include "hhhit.h"       // class Hit
 #include "hhalignment.h" // class Alignment
 #include "hhfunc.h"      // some functions common to hh programs
+#include "ffindexdatabase.h" // class FFindexDatabase, FFindexShardedWriter, ForEachEntryParallel
 
 // Help functions
 void help(Parameters& par, char all = 0) {
@@ -60,7 +64,11 @@ void help(Parameters& par, char all = 0) {
   printf("%s", COPYRIGHT);
   printf("\n");
   printf("Usage: hhmake -i <file> -o <file> [options]\n");
+  printf("       hhmake -i <ffindex> -o <ffindex> -ffindex [options]\n");
   printf(" -i <file>     query alignment (A2M, A3M, or FASTA), or query HMM         \n");
+  printf(" -ffindex      -i and -o are ffindex database basenames: build the HMMs of all \n");
+  printf("               entries of <i>.ff{data,index} and write them to <o>.ff{data,index}\n");
+  printf(" -cpu <int>    number of threads building HMMs with -ffindex (def=%i)     \n", par.threads);
   if (all) {
     printf("\n");
     printf("<file> may be 'stdin' or 'stdout' throughout.\n");
@@ -129,7 +137,7 @@ void help(Parameters& par, char all = 0) {
 /////////////////////////////////////////////////////////////////////////////////////
 //// Processing input options from command line
 /////////////////////////////////////////////////////////////////////////////////////
-void ProcessArguments(Parameters& par, std::string& name) {
+void ProcessArguments(Parameters& par, std::string& name, bool& ffindex) {
   const int argc = par.argc;
   const char** argv = par.argv;
 
@@ -165,6 +173,10 @@ void ProcessArguments(Parameters& par, std::string& name) {
       else
         strcpy(par.outfile, argv[i]);
     }
+    else if (!strcmp(argv[i], "-ffindex"))
+      ffindex = true;
+    else if (!strcmp(argv[i], "-cpu") && (i < argc - 1))
+      par.threads = atoi(argv[++i]);
     else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
       help(par, 1);
       exit(0);
@@ -288,6 +300,87 @@ void ProcessArguments(Parameters& par, std::string& name) {
   } // end of for-loop for command line input
 }
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Builds the HMMs of the entries of an ffindex database, see MakeHMMDatabase
+/////////////////////////////////////////////////////////////////////////////////////
+class HMMBuilder : public FFindexEntryProcessor {
+public:
+  HMMBuilder(Parameters& par, cs::Pseudocounts<cs::AA>* pc_hhm_context_engine,
+      cs::Admix* pc_hhm_context_mode, float* pb, const float R[20][20], const float S[20][20],
+      const float Sim[20][20], FFindexShardedWriter& writer, const int threads)
+      : par(par), pc_hhm_context_engine(pc_hhm_context_engine), pc_hhm_context_mode(pc_hhm_context_mode),
+        pb(pb), R(R), S(S), Sim(Sim), writer(writer), work(threads, NULL), hmm(threads, NULL) {
+  }
+
+  // every thread reuses one alignment (sized for par.maxseq) and one HMM for all its entries
+  void beginThread(const int thread) {
+    work[thread] = new Alignment(par.maxseq, par.maxres);
+    hmm[thread] = new HMM(par.nseqdis, par.maxres);
+  }
+
+  void endThread(const int thread) {
+    delete work[thread];
+    delete hmm[thread];
+  }
+
+  void process(const int thread, ffindex_entry_t* entry, char* data) {
+    HMM& q = *hmm[thread];
+    q.Reset();
+    RemoveExtension(q.file, entry->name);
+
+    TextBuffer buffer(data, entry->length);
+    char input_format = 0;
+    if (ReadQueryFile(par, &buffer, input_format, par.wg, &q, NULL, entry->name, pb, S, Sim, work[thread])) {
+      HH_LOG(WARNING) << "Skipping unreadable entry " << entry->name << "!" << std::endl;
+      return;
+    }
+    PrepareQueryHMM(par, input_format, &q, pc_hhm_context_engine, pc_hhm_context_mode, pb, R);
+
+    std::stringstream out;
+    q.WriteToFile(out, par.max_seqid, par.coverage, par.qid, par.Ndiff, par.qsc, par.argc, par.argv, pb);
+    writer.insert(thread, out.str(), entry->name);
+  }
+
+private:
+  Parameters& par;
+  cs::Pseudocounts<cs::AA>* pc_hhm_context_engine;
+  cs::Admix* pc_hhm_context_mode;
+  float* pb;
+  const float (*R)[20];
+  const float (*S)[20];
+  const float (*Sim)[20];
+  FFindexShardedWriter& writer;
+  std::vector<Alignment*> work;
+  std::vector<HMM*> hmm;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Build the HMMs of all entries of the ffindex database par.infile in parallel and
+// write them to the ffindex database par.outfile, one shard per thread
+/////////////////////////////////////////////////////////////////////////////////////
+void MakeHMMDatabase(Parameters& par, cs::Pseudocounts<cs::AA>* pc_hhm_context_engine,
+    cs::Admix* pc_hhm_context_mode, float* pb, const float R[20][20],
+    const float S[20][20], const float Sim[20][20]) {
+  std::string data_filename = std::string(par.infile) + ".ffdata";
+  std::string index_filename = std::string(par.infile) + ".ffindex";
+  FFindexDatabase reader(data_filename.c_str(), index_filename.c_str(), false);
+  if (reader.db_index == NULL) {
+    HH_LOG(ERROR) << "Could not read index " << index_filename << "!" << std::endl;
+    exit(1);
+  }
+
+  int threads = 1;
+#ifdef OPENMP
+  threads = std::max(par.threads, 1);
+#endif
+  FFindexShardedWriter writer(par.outfile, threads);
+  HMMBuilder builder(par, pc_hhm_context_engine, pc_hhm_context_mode, pb, R, S, Sim, writer, threads);
+  ForEachEntryParallel(reader, threads, builder);
+
+  writer.merge();
+  HH_LOG(INFO) << "Wrote " << writer.entries() << " HMMs of " << reader.db_index->n_entries
+      << " entries to " << par.outfile << std::endl;
+}
 
 int main(int argc, const char **argv) {
   Parameters par(argc, argv);
@@ -314,7 +407,8 @@ int main(int argc, const char **argv) {
   par.wg = 0;               // 0: use local sequence weights   1: use local ones
 
   std::string name;
-  ProcessArguments(par, name);
+  bool ffindex = false;
+  ProcessArguments(par, name, ffindex);
 
   // Check command line input and default values
   if (!*par.infile) {
@@ -327,6 +421,21 @@ int main(int argc, const char **argv) {
     par.nseqdis = MAXSEQDIS - 3;
   }
 
+  if (ffindex) {
+    if (!*par.outfile) {
+      help(par);
+      HH_LOG(ERROR) << "Output database is missing" << std::endl;
+      exit(4);
+    }
+    if (par.append) {
+      HH_LOG(ERROR) << "Appending (-a) is not supported with -ffindex" << std::endl;
+      exit(4);
+    }
+    if (!name.empty()) {
+      HH_LOG(WARNING) << "Ignoring -name with -ffindex, HMMs are named after their first sequence" << std::endl;
+    }
+  }
+
   // Outfile not given? Name it basename.hhm
   if (!*par.outfile) {
     RemoveExtension(par.outfile, par.infile);
@@ -360,6 +469,12 @@ int main(int argc, const char **argv) {
   // Set substitution matrix; adjust to query aa distribution if par.pcm==3
   SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
 
+  if (ffindex) {
+    MakeHMMDatabase(par, pc_hhm_context_engine, pc_hhm_context_mode, pb, R, S, Sim);
+    DeletePseudocountsEngine(context_lib, crf, pc_hhm_context_engine, pc_hhm_context_mode, pc_prefilter_context_engine, pc_prefilter_context_mode);
+    return 0;
+  }
+
   // Read input file (HMM, HHM, or alignment format), and add pseudocounts etc.
   char input_format = 0;
   Alignment Qali(par.maxseq, par.maxres);
@@ -63,6 +63,13 @@ void PosteriorDecoderRunner::executeComputation(HMM &q, std::vector<Hit *>  hits
         alignment.push_back(alignment_vec->second);
     }
 
+    // read the templates ahead in the order of the data files
+    std::vector<HHEntry*> entries;
+    for (size_t idx = 0; idx < alignment.size(); idx++) {
+        entries.push_back(alignment[idx][0]->entry);
+    }
+    prefetchTemplates(entries.begin(), entries.end());
+
     // Routine to start consumer threads
     std::vector<PosteriorDecoder *> *threads = initializeConsumerThreads(par.loc, target_max_length, q.L, par.ssw, S73, S33, S37);
     // create one hmm for each threads
@@ -7,8 +7,9 @@
 
 #include "hhposteriormatrix.h"
 
-PosteriorMatrix::PosteriorMatrix() {
+PosteriorMatrix::PosteriorMatrix(bool huge_pages) {
 		m_probabilities = NULL;
+		m_huge_pages = huge_pages;
 		m_q_max_length = 0;
 		m_t_max_length = 0;
 }
@@ -37,7 +38,7 @@ void PosteriorMatrix::allocateMatrix(int q_length_max, int t_length_max) {
     m_t_max_length = ICEIL(t_length_max,VECSIZE_FLOAT);
 
     // Allocate posterior prob matrix (matrix rows are padded to make them aligned to multiliples of ALIGN_FLOAT)
-    m_probabilities = malloc_matrix<float>(m_q_max_length+2, m_t_max_length+2);
+    m_probabilities = malloc_matrix<float>(m_q_max_length+2, m_t_max_length+2, m_huge_pages);
     if (!m_probabilities)
         MemoryError("m_probabilities", __FILE__, __LINE__, __func__);
 
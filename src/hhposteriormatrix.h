@@ -16,7 +16,7 @@ static const int IDX_CORR = VECSIZE_FLOAT - 1;
 
 class PosteriorMatrix {
 public:
-	PosteriorMatrix();
+	PosteriorMatrix(bool huge_pages = false);
 	virtual ~PosteriorMatrix();
 
 	void allocateMatrix(const int q_length_max, const int t_length_max);
@@ -50,6 +50,7 @@ private:
 	int m_q_max_length;
 	int m_t_max_length;
 	float ** m_probabilities;
+	bool m_huge_pages;
 
 };
 
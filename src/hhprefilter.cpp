@@ -9,6 +9,8 @@
 #include "ext/fmemopen.h"
 #include "cs219.lib.h"
 
+#include <algorithm>
+
 #define SWAP(tmp, arg1, arg2) tmp = arg1; arg1 = arg2; arg2 = tmp;
 
 Prefilter::Prefilter(const std::string& cs_library, FFindexDatabase* cs219_database) {
@@ -401,20 +403,14 @@ void Prefilter::stripe_query_profile(HMM* q_tmp,
 
 
 ////////////////////////////////////////////////////////////////////////
-// Main prefilter function
+// Prefilter one shard of a database: gapless scores of all sequences, then Smith-Waterman
+// scores of the sequences that can pass the 1st prefilter of the whole database
 ////////////////////////////////////////////////////////////////////////
-void Prefilter::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
-    const int threads, const int prefilter_gap_open,
-    const int prefilter_gap_extend, const int prefilter_score_offset,
-    const int prefilter_bit_factor, const double prefilter_evalue_thresh,
-    const double prefilter_evalue_coarse_thresh,
-    const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
-    const float R[20][20],
-    std::vector<std::pair<int, std::string> >& new_prefilter_hits,
-    std::vector<std::pair<int, std::string> >& old_prefilter_hits) {
-
-  Hash<char>* doubled = new Hash<char>;
-  doubled->New(16381, 0);
+void Prefilter::prefilter_shard(const size_t shard, HMM* q_tmp, const int threads,
+    const int prefilter_gap_open, const int prefilter_gap_extend,
+    const int prefilter_score_offset, const int prefilter_bit_factor,
+    const int preprefilter_smax_thresh, const int min_prefilter_hits,
+    std::vector<PrefilterCandidate>& candidates) {
 
   int element_count = (VECSIZE_INT * 4);
   //W = (LQ+15) / 16;   // band width = hochgerundetes LQ/16
@@ -425,21 +421,18 @@ void Prefilter::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
 
   simd_int ** workspace = new simd_int *[threads];
 
-  std::vector<std::pair<int, int> > first_prefilter;
-  std::vector<std::pair<double, int> > hits;
-
-  int count_dbs = 0;
   int gap_init = prefilter_gap_open + prefilter_gap_extend;
   int gap_extend = prefilter_gap_extend;
   int LQ = q_tmp->L;
   const float log_qlen = flog2(LQ);
-  const double factor = (double) num_dbs * LQ;
 
   for (int i = 0; i < threads; i++)
     workspace[i] = (simd_int*) malloc_simd_int(
         3 * (LQ + element_count) * sizeof(char));
 
-#pragma omp parallel for schedule(static)
+  std::vector<std::pair<int, int> > first_prefilter(num_dbs);
+
+#pragma omp parallel for schedule(static) num_threads(threads)
   // Loop over all database sequences
   for (size_t n = 0; n < num_dbs; n++) {
     int thread_id = 0;
@@ -453,109 +446,147 @@ void Prefilter::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
     score = score
         - (int) (prefilter_bit_factor * (log_qlen + flog2(length[n])));
 
-#pragma omp critical
-    first_prefilter.push_back(std::pair<int, int>(score, n));
+    first_prefilter[n] = std::pair<int, int>(score, n);
   }
-  //filter after calculation of ungapped sse score to include at least min_prefilter_hits
-  std::vector<std::pair<int, int> >::iterator it;
 
+  // The database keeps all sequences above preprefilter_smax_thresh and at least its
+  // min_prefilter_hits best ones; the best ones of the database are among the best ones of their shard
   sort(first_prefilter.begin(), first_prefilter.end());
   std::reverse(first_prefilter.begin(), first_prefilter.end());
 
-  std::vector<std::pair<int, int> >::iterator first_prefilter_begin_erase =
-      first_prefilter.end();
-  std::vector<std::pair<int, int> >::iterator first_prefilter_end_erase =
-      first_prefilter.end();
-  count_dbs = 0;
-  for (it = first_prefilter.begin(); it < first_prefilter.end(); it++) {
-    if (count_dbs >= min_prefilter_hits
-        && (*it).first <= preprefilter_smax_thresh) {
-      first_prefilter_begin_erase = it;
-      break;
-    }
-    else {
-      count_dbs++;
-    }
+  size_t count_dbs = 0;
+  while (count_dbs < first_prefilter.size()
+      && (count_dbs < (size_t) min_prefilter_hits
+          || first_prefilter[count_dbs].first > preprefilter_smax_thresh)) {
+    count_dbs++;
   }
 
-  first_prefilter.erase(first_prefilter_begin_erase,
-      first_prefilter_end_erase);
-
-  HH_LOG(INFO)
-      << "HMMs passed 1st prefilter (gapless profile-profile alignment)  : "
-      << count_dbs << std::endl;
+  const size_t first_candidate = candidates.size();
+  for (size_t i = 0; i < count_dbs; i++) {
+    const int n = first_prefilter[i].second;
+    candidates.push_back(PrefilterCandidate(shard, n, length[n], first_prefilter[i].first, std::string(dbnames[n])));
+  }
 
-#pragma omp parallel for schedule(static)
-  // Loop over all database sequences
-//  for (int n = 0; n < count_dbs; n++) {
-  for (size_t i = 0; i < first_prefilter.size(); i++) {
+#pragma omp parallel for schedule(static) num_threads(threads)
+  for (size_t i = first_candidate; i < candidates.size(); i++) {
     int thread_id = 0;
 #ifdef OPENMP
     thread_id = omp_get_thread_num();
 #endif
-
-    int n = first_prefilter[i].second;
+    const size_t n = candidates[i].index;
 
     // Perform search step
-    int score = swStripedByte(qc, LQ, first[n], length[n], gap_init,
+    candidates[i].sw_score = swStripedByte(qc, LQ, first[n], length[n], gap_init,
         gap_extend, workspace[thread_id], workspace[thread_id] + W,
         workspace[thread_id] + 2 * W, prefilter_score_offset);
+  }
 
-    double evalue = factor * length[n] * fpow2(-score / prefilter_bit_factor);
+  // Free memory
+  free(qc);
+  for (int i = 0; i < threads; i++)
+    free(workspace[i]);
+  delete[] workspace;
+}
+
+// Order of the 1st prefilter: best gapless score first, ties by decreasing position in the database
+static bool first_prefilter_order(const PrefilterCandidate* a, const PrefilterCandidate* b) {
+  if (a->ungapped_score != b->ungapped_score)
+    return a->ungapped_score > b->ungapped_score;
+  if (a->shard != b->shard)
+    return a->shard > b->shard;
+  return a->index > b->index;
+}
+
+// Order of the 2nd prefilter: best E-value first, ties by increasing position in the database
+static bool second_prefilter_order(const std::pair<double, const PrefilterCandidate*>& a,
+    const std::pair<double, const PrefilterCandidate*>& b) {
+  if (a.first != b.first)
+    return a.first < b.first;
+  if (a.second->shard != b.second->shard)
+    return a.second->shard < b.second->shard;
+  return a.second->index < b.second->index;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Merge the candidates of all shards of a database. Thresholds, E-values and the maximum number
+// of hits refer to the whole database of num_dbs sequences, so the hits are the same as those
+// of the unsharded database.
+////////////////////////////////////////////////////////////////////////
+void Prefilter::merge_candidates(const std::vector<PrefilterCandidate>& candidates,
+    const size_t num_dbs, const int query_length, FlatHash<Hit>* previous_hits,
+    const int prefilter_bit_factor, const double prefilter_evalue_thresh,
+    const double prefilter_evalue_coarse_thresh,
+    const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
+    std::vector<PrefilterHit>& new_prefilter_hits,
+    std::vector<PrefilterHit>& old_prefilter_hits) {
+
+  FlatHash<char> doubled(16381, 0);
+
+  std::vector<const PrefilterCandidate*> first_prefilter(candidates.size());
+  for (size_t i = 0; i < candidates.size(); i++) {
+    first_prefilter[i] = &candidates[i];
+  }
+
+  //filter after calculation of ungapped sse score to include at least min_prefilter_hits
+  sort(first_prefilter.begin(), first_prefilter.end(), first_prefilter_order);
+
+  int count_dbs = 0;
+  while ((size_t) count_dbs < first_prefilter.size()
+      && (count_dbs < min_prefilter_hits
+          || first_prefilter[count_dbs]->ungapped_score > preprefilter_smax_thresh)) {
+    count_dbs++;
+  }
+  first_prefilter.resize(count_dbs);
+
+  HH_LOG(INFO)
+      << "HMMs passed 1st prefilter (gapless profile-profile alignment)  : "
+      << count_dbs << std::endl;
+
+  const double factor = (double) num_dbs * query_length;
+  std::vector<std::pair<double, const PrefilterCandidate*> > hits;
+  for (size_t i = 0; i < first_prefilter.size(); i++) {
+    const PrefilterCandidate* candidate = first_prefilter[i];
+    double evalue = factor * candidate->length * fpow2(-candidate->sw_score / prefilter_bit_factor);
 
     if (evalue < prefilter_evalue_coarse_thresh) {
-#pragma omp critical
-      hits.push_back(std::pair<double, int>(evalue, n));
+      hits.push_back(std::pair<double, const PrefilterCandidate*>(evalue, candidate));
     }
   }
 
   //filter after calculation of evalues to include at least min_prefilter_hits
-  sort(hits.begin(), hits.end());
-
-  std::vector<std::pair<double, int> >::iterator second_prefilter_begin_erase =
-      hits.end();
-  std::vector<std::pair<double, int> >::iterator second_prefilter_end_erase =
-      hits.end();
-  std::vector<std::pair<double, int> >::iterator it2;
+  sort(hits.begin(), hits.end(), second_prefilter_order);
 
   count_dbs = 0;
-  for (it2 = hits.begin(); it2 < hits.end(); it2++) {
-    if (count_dbs >= min_prefilter_hits
-        && (*it2).first > prefilter_evalue_thresh) {
-      second_prefilter_begin_erase = it2;
-      break;
-    }
-    else {
-      count_dbs++;
-    }
+  while ((size_t) count_dbs < hits.size()
+      && (count_dbs < min_prefilter_hits || hits[count_dbs].first <= prefilter_evalue_thresh)) {
+    count_dbs++;
   }
-
-  hits.erase(second_prefilter_begin_erase, second_prefilter_end_erase);
+  hits.resize(count_dbs);
 
   count_dbs = 0;
 
-  for (it2 = hits.begin(); it2 < hits.end(); it2++) {
+  for (size_t i = 0; i < hits.size(); i++) {
     // Add hit to dbfiles
     count_dbs++;
+    const PrefilterCandidate* candidate = hits[i].second;
+
     char db_name[NAMELEN];
-    strcpy(db_name, dbnames[(*it2).second]);
+    strcpy(db_name, candidate->name.c_str());
 
     char name[NAMELEN];
     RemoveExtension(name, db_name);
 
-    if (!doubled->Contains(db_name)) {
-      doubled->Add(db_name);
+    if (!doubled.Contains(db_name)) {
+      doubled.Add(db_name);
 
-      std::pair<int, std::string> result;
-      result.first = length[(*it2).second];
-      result.second = std::string(db_name);
+      PrefilterHit result(candidate->shard, candidate->length, candidate->name);
 
       // check, if DB was searched in previous rounds
 
-      std::stringstream ss_tmp;
-      ss_tmp << name << "__" << 1;
+      char key[HITKEYLEN];
+      HitKey(key, name, 1);
 
-      if (previous_hits->Contains((char*) ss_tmp.str().c_str())) {
+      if (previous_hits->Contains(key)) {
         old_prefilter_hits.push_back(result);
       }
       else {
@@ -570,12 +601,50 @@ void Prefilter::prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
       break;
     }
   }
+}
 
-  // Free memory
-  free(qc);
-  for (int i = 0; i < threads; i++)
-    free(workspace[i]);
-  delete[] workspace;
-  if (doubled)
-    delete doubled;
+////////////////////////////////////////////////////////////////////////
+// Main prefilter function
+////////////////////////////////////////////////////////////////////////
+void Prefilter::prefilter_db(const std::vector<Prefilter*>& shards, HMM* q_tmp, FlatHash<Hit>* previous_hits,
+    const int threads, const int prefilter_gap_open,
+    const int prefilter_gap_extend, const int prefilter_score_offset,
+    const int prefilter_bit_factor, const double prefilter_evalue_thresh,
+    const double prefilter_evalue_coarse_thresh,
+    const int preprefilter_smax_thresh, const int min_prefilter_hits, const int maxnumdb,
+    const float R[20][20],
+    std::vector<PrefilterHit>& new_prefilter_hits,
+    std::vector<PrefilterHit>& old_prefilter_hits) {
+
+  size_t num_dbs = 0;
+  for (size_t s = 0; s < shards.size(); s++) {
+    num_dbs += shards[s]->num_dbs;
+  }
+
+  std::vector<std::vector<PrefilterCandidate> > shard_candidates(shards.size());
+  if (shards.size() > 1 && shards.size() >= (size_t) threads) {
+    // enough shards to keep every thread busy with whole shards
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t s = 0; s < shards.size(); s++) {
+      shards[s]->prefilter_shard(s, q_tmp, 1, prefilter_gap_open, prefilter_gap_extend,
+          prefilter_score_offset, prefilter_bit_factor, preprefilter_smax_thresh,
+          min_prefilter_hits, shard_candidates[s]);
+    }
+  }
+  else {
+    for (size_t s = 0; s < shards.size(); s++) {
+      shards[s]->prefilter_shard(s, q_tmp, threads, prefilter_gap_open, prefilter_gap_extend,
+          prefilter_score_offset, prefilter_bit_factor, preprefilter_smax_thresh,
+          min_prefilter_hits, shard_candidates[s]);
+    }
+  }
+
+  std::vector<PrefilterCandidate> candidates;
+  for (size_t s = 0; s < shards.size(); s++) {
+    candidates.insert(candidates.end(), shard_candidates[s].begin(), shard_candidates[s].end());
+  }
+
+  merge_candidates(candidates, num_dbs, q_tmp->L, previous_hits, prefilter_bit_factor,
+      prefilter_evalue_thresh, prefilter_evalue_coarse_thresh, preprefilter_smax_thresh,
+      min_prefilter_hits, maxnumdb, new_prefilter_hits, old_prefilter_hits);
 }
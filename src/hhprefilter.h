@@ -15,7 +15,7 @@
 #endif
 
 #include "hhhmm.h"
-#include "hash.h"
+#include "flathash.h"
 #include "hhhit.h"
 #include "simd.h"
 #include "ffindexdatabase.h"
@@ -69,6 +69,30 @@
 //   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
+// A database sequence that passed the prefilter: shard of the database it belongs to, its length and name
+struct PrefilterHit {
+	size_t shard;
+	int length;
+	std::string name;
+
+	PrefilterHit(size_t shard, int length, const std::string& name) : shard(shard), length(length), name(name) {}
+};
+
+// A sequence of one shard that can pass the 1st prefilter of the whole database, with its gapless and
+// Smith-Waterman scores. Candidates refer to their shard only by its number and carry everything the merge
+// needs, so the shards of a database can be prefiltered by separate workers or processes.
+struct PrefilterCandidate {
+	size_t shard;
+	size_t index; // position of the sequence in its shard
+	int length;
+	int ungapped_score;
+	int sw_score;
+	std::string name;
+
+	PrefilterCandidate(size_t shard, size_t index, int length, int ungapped_score, const std::string& name)
+		: shard(shard), index(index), length(length), ungapped_score(ungapped_score), sw_score(0), name(name) {}
+};
+
 class Prefilter {
 public:
 	Prefilter(const std::string& cs_library, FFindexDatabase* cs219_database);
@@ -77,12 +101,30 @@ public:
 	static void init_no_prefiltering(FFindexDatabase* cs219_database, std::vector<std::pair<int, std::string> >& prefiltered_entries);
 	static void init_selected(FFindexDatabase* cs219_database, std::vector<std::string> templates, std::vector<std::pair<int, std::string> >& prefiltered_entries);
 
-	void prefilter_db(HMM* q_tmp, Hash<Hit>* previous_hits,
+	// Prefilter the shards of a database as one database: the candidates of every shard are merged,
+	// and thresholds, E-values and the maximum number of hits refer to the whole database.
+	// A database that is not sharded is passed as a single shard.
+	static void prefilter_db(const std::vector<Prefilter*>& shards, HMM* q_tmp, FlatHash<Hit>* previous_hits,
 			const int threads, const int prefilter_gap_open, const int prefilter_gap_extend,
 			const int prefilter_score_offset, const int prefilter_bit_factor, const double prefilter_evalue_thresh,
 			const double prefilter_evalue_coarse_thresh, const int preprefilter_smax_thresh,
             const int min_prefilter_hits, const int maxnumdb, const float R[20][20],
-			std::vector<std::pair<int, std::string> >& new_prefilter_hits, std::vector<std::pair<int, std::string> >& old_prefilter_hits);
+			std::vector<PrefilterHit>& new_prefilter_hits, std::vector<PrefilterHit>& old_prefilter_hits);
+
+	// Append the candidates of this database, shard number shard of its database, to candidates
+	void prefilter_shard(const size_t shard, HMM* q_tmp, const int threads,
+			const int prefilter_gap_open, const int prefilter_gap_extend,
+			const int prefilter_score_offset, const int prefilter_bit_factor,
+			const int preprefilter_smax_thresh, const int min_prefilter_hits,
+			std::vector<PrefilterCandidate>& candidates);
+
+	// Select the prefilter hits of a database of num_dbs sequences from the candidates of all its shards
+	static void merge_candidates(const std::vector<PrefilterCandidate>& candidates,
+			const size_t num_dbs, const int query_length, FlatHash<Hit>* previous_hits,
+			const int prefilter_bit_factor, const double prefilter_evalue_thresh,
+			const double prefilter_evalue_coarse_thresh, const int preprefilter_smax_thresh,
+			const int min_prefilter_hits, const int maxnumdb,
+			std::vector<PrefilterHit>& new_prefilter_hits, std::vector<PrefilterHit>& old_prefilter_hits);
 
 private:
 	cs::ContextLibrary<cs::AA> *cs_lib;
@@ -5,10 +5,7 @@
 
 void HHsearch::prepareDatabases(Parameters& par,
                                 std::vector<HHblitsDatabase*>& databases) {
-    for (size_t i = 0; i < par.db_bases.size(); i++) {
-        HHblitsDatabase* db = new HHblitsDatabase(par.db_bases[i].c_str(), false);
-        databases.push_back(db);
-    }
+    HHblitsDatabase::openDatabases(par.db_bases, false, databases);
 
     par.dbsize = 0;
     for (size_t i = 0; i < databases.size(); i++) {
@@ -92,6 +89,8 @@ void HHsearch::help(Parameters& par, char all) {
   if (all) {
     printf(" -opsi <file>   write result MSA of significant matches in PSI-BLAST format\n");
     printf(" -ohhm <file>   write HHM file for result MSA of significant matches\n");
+    printf(" -obin <file>   write hits of the hit list in binary format (convert with hhbin2txt)\n");
+    printf(" -obin_paths    add alignment paths to the binary hits (default=off)\n");
   }
 
   printf(" -add_cons      generate consensus sequence as master sequence of query MSA (default=don't)\n");
@@ -206,6 +205,7 @@ void HHsearch::help(Parameters& par, char all) {
 	printf(" -maxseq <int>  max number of input rows (def=%5i)\n", par.maxseq);
     printf(" -maxres <int>  max number of HMM columns (def=%5i)\n", par.maxres);
     printf(" -maxmem [1,inf[ limit memory for realignment (in GB) (def=%.1f)          \n", par.maxmem);
+    printf(" -hugepages     back DP matrices with transparent huge pages (def=off)\n");
   }
   printf("\n");
 
@@ -323,6 +323,17 @@ void HHsearch::ProcessArguments(Parameters& par) {
                 strcpy(par.m8file, argv[i]);
             }
         }
+        else if (!strcmp(argv[i], "-obin")) {
+            if (++i >= argc || argv[i][0] == '-') {
+                help(par);
+                HH_LOG(ERROR) << "No file following -obin" << std::endl;
+                exit(4);
+            } else {
+                strcpy(par.binfile, argv[i]);
+            }
+        }
+        else if (!strcmp(argv[i], "-obin_paths"))
+            par.binary_paths = true;
         else if (!strcmp(argv[i], "-atab")) {
 			if (++i >= argc || argv[i][0] == '-') {
 				help(par);
@@ -502,7 +513,9 @@ void HHsearch::ProcessArguments(Parameters& par) {
 			par.threads = atoi(argv[++i]);
 		else if (!strcmp(argv[i], "-maxmem") && (i < argc - 1)) {
 			par.maxmem = atof(argv[++i]);
-		} else if (!strcmp(argv[i], "-corr") && (i < argc - 1))
+		} else if (!strcmp(argv[i], "-hugepages"))
+			par.hugepages = true;
+		else if (!strcmp(argv[i], "-corr") && (i < argc - 1))
 			par.corr = atof(argv[++i]);
 		else if (!strcmp(argv[i], "-ovlp") && (i < argc - 1))
 			par.min_overlap = atoi(argv[++i]);
@@ -0,0 +1,213 @@
+/*
+ * hhshard.cpp
+ *
+ * Split an HH-suite database (_cs219, _a3m and _hhm ffindex databases) into shards.
+ *
+ * The shards hold consecutive ranges of the sorted entry names, balanced by data size,
+ * and are listed in <output>.shards. hhblits and hhsearch accept <output> as database
+ * (-d <output>); the shards are then prefiltered together as one database, so the results
+ * are the same as those of the unsharded database.
+ */
+
+#include "ffindexdatabase.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <unistd.h>
+
+void usage() {
+  std::cout
+      << "USAGE: hhshard -d [database_base] -o [output_base] -n [shards]" << std::endl
+      << " Writes the shards <output_base>_<i>_{cs219,a3m,hhm}.{ffdata,ffindex}" << std::endl
+      << " and the shard list <output_base>.shards, which can be searched with -d <output_base>." << std::endl
+      << " Databases with compressed a3m (_ca3m) have to be sharded before compressing them." << std::endl;
+}
+
+bool file_exists(const std::string& name) {
+  return access(name.c_str(), F_OK) == 0;
+}
+
+bool compare_names(const std::string& name, const std::string& boundary) {
+  return strcmp(name.c_str(), boundary.c_str()) < 0;
+}
+
+// Copy the entries of one ffindex database into the shards with base names shard_bases
+int shard_database(const std::string& base, const std::string& type,
+    const std::vector<std::string>& boundaries, const std::vector<std::string>& shard_bases) {
+  std::string data_filename = base + "_" + type + ".ffdata";
+  std::string index_filename = base + "_" + type + ".ffindex";
+  FFindexDatabase database(data_filename.c_str(), index_filename.c_str(), false);
+  if (database.db_index == NULL) {
+    std::cerr << "ERROR: Index " << index_filename << " could not be loaded!" << std::endl;
+    return 1;
+  }
+
+  std::vector<FILE*> data_fh(shard_bases.size());
+  std::vector<FILE*> index_fh(shard_bases.size());
+  std::vector<size_t> offsets(shard_bases.size(), 0);
+  for (size_t s = 0; s < shard_bases.size(); s++) {
+    std::string shard_data = shard_bases[s] + "_" + type + ".ffdata";
+    std::string shard_index = shard_bases[s] + "_" + type + ".ffindex";
+    data_fh[s] = fopen(shard_data.c_str(), "w");
+    index_fh[s] = fopen(shard_index.c_str(), "w");
+    if (data_fh[s] == NULL || index_fh[s] == NULL) {
+      std::cerr << "ERROR: Could not open output database " << shard_bases[s] << "_" << type << "!" << std::endl;
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < database.db_index->n_entries; i++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(database.db_index, i);
+    const size_t s = std::upper_bound(boundaries.begin(), boundaries.end(), std::string(entry->name), compare_names)
+        - boundaries.begin();
+
+    // entries end with the \0 separator of ffindex, which ffindex_insert_memory adds again
+    ffindex_insert_memory(data_fh[s], index_fh[s], &offsets[s], database.getData(entry), entry->length - 1, entry->name);
+  }
+
+  for (size_t s = 0; s < shard_bases.size(); s++) {
+    fclose(data_fh[s]);
+    fclose(index_fh[s]);
+    std::string shard_index = shard_bases[s] + "_" + type + ".ffindex";
+    ffsort_index(shard_index.c_str());
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  std::string input;
+  std::string output;
+  size_t n_shards = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:o:n:h")) != -1) {
+    switch (c) {
+      case 'd':
+        input = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'n':
+        n_shards = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      case '?':
+        if (isprint(optopt))
+          fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+        else
+          fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+        return 1;
+      default:
+        abort();
+    }
+  }
+
+  if (input.empty() || output.empty() || n_shards == 0) {
+    usage();
+    exit(0);
+  }
+
+  if (file_exists(input + "_ca3m.ffindex")) {
+    std::cerr << "ERROR: " << input << " has compressed a3m (_ca3m). Shard the database before compressing it!" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> types;
+  types.push_back("cs219");
+  if (file_exists(input + "_a3m.ffindex")) {
+    types.push_back("a3m");
+  }
+  if (file_exists(input + "_hhm.ffindex")) {
+    types.push_back("hhm");
+  }
+
+  // The entries of the cs219 database and their size in all databases define the shard boundaries
+  std::string cs219_data = input + "_cs219.ffdata";
+  std::string cs219_index = input + "_cs219.ffindex";
+  if (!file_exists(cs219_data) || !file_exists(cs219_index)) {
+    std::cerr << "ERROR: " << input << " has no cs219 database!" << std::endl;
+    return 1;
+  }
+  FFindexDatabase cs219(cs219_data.c_str(), cs219_index.c_str(), false);
+  if (cs219.db_index == NULL || cs219.db_index->n_entries == 0) {
+    std::cerr << "ERROR: Index " << cs219_index << " could not be loaded or is empty!" << std::endl;
+    return 1;
+  }
+  n_shards = std::min(n_shards, cs219.db_index->n_entries);
+
+  std::vector<FFindexDatabase*> others;
+  for (size_t t = 1; t < types.size(); t++) {
+    std::string data_filename = input + "_" + types[t] + ".ffdata";
+    std::string index_filename = input + "_" + types[t] + ".ffindex";
+    others.push_back(new FFindexDatabase(data_filename.c_str(), index_filename.c_str(), false));
+  }
+
+  std::vector<size_t> weights(cs219.db_index->n_entries);
+  size_t total_weight = 0;
+  for (size_t i = 0; i < cs219.db_index->n_entries; i++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(cs219.db_index, i);
+    weights[i] = entry->length;
+    for (size_t t = 0; t < others.size(); t++) {
+      ffindex_entry_t* other = ffindex_get_entry_by_name(others[t]->db_index, entry->name);
+      if (other != NULL) {
+        weights[i] += other->length;
+      }
+    }
+    total_weight += weights[i];
+  }
+  for (size_t t = 0; t < others.size(); t++) {
+    delete others[t];
+  }
+
+  // Shard s > 0 starts with the first entry at which the summed weight reaches s / n_shards of the total weight
+  std::vector<std::string> boundaries;
+  size_t weight = 0;
+  for (size_t i = 0; i < cs219.db_index->n_entries && boundaries.size() + 1 < n_shards; i++) {
+    if (i > 0 && weight * n_shards >= (boundaries.size() + 1) * total_weight) {
+      boundaries.push_back(ffindex_get_entry_by_index(cs219.db_index, i)->name);
+    }
+    weight += weights[i];
+  }
+
+  std::string output_name = output.substr(output.rfind('/') == std::string::npos ? 0 : output.rfind('/') + 1);
+  std::vector<std::string> shard_bases;
+  std::vector<std::string> shard_names;
+  for (size_t s = 0; s <= boundaries.size(); s++) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%zu", s);
+    shard_bases.push_back(output + suffix);
+    shard_names.push_back(output_name + suffix);
+  }
+
+  for (size_t t = 0; t < types.size(); t++) {
+    if (shard_database(input, types[t], boundaries, shard_bases) != 0) {
+      return 1;
+    }
+  }
+
+  std::string shards_filename = output + ".shards";
+  std::ofstream shards_file(shards_filename.c_str());
+  for (size_t s = 0; s < shard_names.size(); s++) {
+    shards_file << shard_names[s] << std::endl;
+  }
+  shards_file.close();
+  if (!shards_file) {
+    std::cerr << "ERROR: Could not write shard list " << shards_filename << "!" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << shard_bases.size() << " shards of " << input << " listed in " << shards_filename << std::endl;
+  return 0;
+}
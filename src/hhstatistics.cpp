@@ -0,0 +1,118 @@
+// hhstatistics.cpp
+
+#include "hhstatistics.h"
+
+#include <string.h>
+
+HitStatistics::HitStatistics() : q_L(-1), q_Neff_HMM(-1) {
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Set query and precompute the query terms of the hidden units
+/////////////////////////////////////////////////////////////////////////////////////
+void HitStatistics::SetQuery(const int q_L, const float q_Neff_HMM) {
+  if (q_L == this->q_L && q_Neff_HMM == this->q_Neff_HMM)
+    return;
+
+  this->q_L = q_L;
+  this->q_Neff_HMM = q_Neff_HMM;
+  remembered.clear();
+
+  const float log1000 = log(1000.0);
+  const float Lqnorm = log(q_L) / log1000;
+  const float Nqnorm = q_Neff_HMM / 10.0;
+  for (int h = 0; h < LAMDA_NN_HIDDEN; h++) {
+    lamda_q[h][0] = Lqnorm * LAMDA_NN_WEIGHTS[LAMDA_NN_INPUTS * h];
+    lamda_q[h][1] = Nqnorm * LAMDA_NN_WEIGHTS[LAMDA_NN_INPUTS * h + 2];
+  }
+  for (int h = 0; h < MU_NN_HIDDEN; h++) {
+    mu_q[h][0] = Lqnorm * MU_NN_WEIGHTS[MU_NN_INPUTS * h];
+    mu_q[h][1] = Nqnorm * MU_NN_WEIGHTS[MU_NN_INPUTS * h + 2];
+  }
+}
+
+uint64_t HitStatistics::Key(const int t_L, const float t_Neff_HMM) {
+  uint32_t neff_bits;
+  memcpy(&neff_bits, &t_Neff_HMM, sizeof(neff_bits));
+  return ((uint64_t) (uint32_t) t_L << 32) | neff_bits;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Look up remembered parameters and evaluate the networks for all other templates in one pass
+/////////////////////////////////////////////////////////////////////////////////////
+void HitStatistics::LamdaMu(const size_t n, const int* t_L, const float* t_Neff_HMM,
+    float* lamda, float* mu) {
+  const float log1000 = log(1000.0);
+
+  if (remembered.size() > MAX_REMEMBERED)
+    remembered.clear();
+
+  Ltnorm.clear();
+  Ntnorm.clear();
+  index_new.clear();
+  for (size_t k = 0; k < n; k++) {
+    std::unordered_map<uint64_t, std::pair<float, float> >::const_iterator it =
+        remembered.find(Key(t_L[k], t_Neff_HMM[k]));
+    if (it != remembered.end()) {
+      lamda[k] = it->second.first;
+      mu[k] = it->second.second;
+    }
+    else {
+      Ltnorm.push_back(log(t_L[k]) / log1000);
+      Ntnorm.push_back(t_Neff_HMM[k] / 10.0);
+      index_new.push_back(k);
+    }
+  }
+
+  if (index_new.empty())
+    return;
+
+  EvaluateNN();
+
+  for (size_t i = 0; i < index_new.size(); i++) {
+    const size_t k = index_new[i];
+    lamda[k] = lamda_new[i];
+    mu[k] = mu_new[i];
+    remembered[Key(t_L[k], t_Neff_HMM[k])] = std::make_pair(lamda_new[i], mu_new[i]);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Evaluate lamda_NN and mu_NN for the templates in Ltnorm, Ntnorm.
+// The sums are accumulated in the same order as in calc_hidden_output,
+// so the results are identical to those of lamda_NN and mu_NN as long as
+// neither contracts multiply-adds (this file is built with -ffp-contract=off)
+/////////////////////////////////////////////////////////////////////////////////////
+void HitStatistics::EvaluateNN() {
+  const size_t n = Ltnorm.size();
+  const float* Lt = &Ltnorm[0];
+  const float* Nt = &Ntnorm[0];
+  lamda_new.assign(n, 0.0f);
+  mu_new.assign(n, 0.0f);
+  float* l = &lamda_new[0];
+  float* m = &mu_new[0];
+
+  for (int h = 0; h < LAMDA_NN_HIDDEN; h++) {
+    const float* w = LAMDA_NN_WEIGHTS + LAMDA_NN_INPUTS * h;
+    const float w_out = LAMDA_NN_WEIGHTS[LAMDA_NN_HIDDEN * LAMDA_NN_INPUTS + h];
+    const float bias = LAMDA_NN_BIASES[h];
+    for (size_t k = 0; k < n; k++) {
+      float res = lamda_q[h][0] + Lt[k] * w[1] + lamda_q[h][1] + Nt[k] * w[3] + bias;
+      res = 1.0 / (1.0 + exp(-(res))); // logistic function
+      l[k] += res * w_out;
+    }
+  }
+
+  for (int h = 0; h < MU_NN_HIDDEN; h++) {
+    const float* w = MU_NN_WEIGHTS + MU_NN_INPUTS * h;
+    const float w_out = MU_NN_WEIGHTS[MU_NN_HIDDEN * MU_NN_INPUTS + h];
+    const float bias = MU_NN_BIASES[h];
+    for (size_t k = 0; k < n; k++) {
+      float res = mu_q[h][0] + Lt[k] * w[1] + mu_q[h][1] + Nt[k] * w[3] + bias;
+      res = 1.0 / (1.0 + exp(-(res))); // logistic function
+      m[k] += res * w_out;
+    }
+  }
+  for (size_t k = 0; k < n; k++)
+    m[k] = 20.0 * m[k];
+}
@@ -0,0 +1,60 @@
+// hhstatistics.h
+
+#ifndef HHSTATISTICS_H_
+#define HHSTATISTICS_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include "hhhitlist-inl.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Score statistics of hits against one query
+//
+// The EVD parameters lamda and mu are predicted by the neural networks lamda_NN and mu_NN
+// from the query and template lengths and diversities. The query inputs are multiplied
+// into the first layer only once per query, and lamda and mu are remembered for each
+// template length and Neff, so hits of the same template that are scored several times
+// in one search iteration (early stopping, P-values, rescoring) evaluate the networks once.
+// The networks are evaluated for arrays of templates with the hidden units in the outer loop,
+// so that the inner loops run over contiguous arrays. The results are the same as those of
+// lamda_NN and mu_NN compiled without fused multiply-adds; hhstatistics.cpp is always built
+// that way (-ffp-contract=off), so lamda and mu do not depend on the instruction set.
+/////////////////////////////////////////////////////////////////////////////////////
+class HitStatistics
+{
+public:
+  HitStatistics();
+
+  // Set query length and diversity; forgets the remembered parameters if the query has changed
+  void SetQuery(const int q_L, const float q_Neff_HMM);
+
+  // Calculate lamda[k] and mu[k] for n templates with lengths t_L[k] and diversities t_Neff_HMM[k]
+  void LamdaMu(const size_t n, const int* t_L, const float* t_Neff_HMM, float* lamda, float* mu);
+
+private:
+  static const size_t MAX_REMEMBERED = 1 << 20; // forget all parameters when more are remembered
+
+  int q_L;
+  float q_Neff_HMM;
+  float lamda_q[LAMDA_NN_HIDDEN][2];  // query length and Neff terms of the hidden units of lamda_NN
+  float mu_q[MU_NN_HIDDEN][2];        // query length and Neff terms of the hidden units of mu_NN
+
+  std::unordered_map<uint64_t, std::pair<float, float> > remembered; // (lamda, mu) for template (L, Neff)
+
+  // Template inputs, results and positions in the output arrays of the templates not remembered yet
+  std::vector<float> Ltnorm;
+  std::vector<float> Ntnorm;
+  std::vector<float> lamda_new;
+  std::vector<float> mu_new;
+  std::vector<size_t> index_new;
+
+  static uint64_t Key(const int t_L, const float t_Neff_HMM);
+
+  // Evaluate lamda_NN and mu_NN for all templates in Ltnorm and Ntnorm
+  void EvaluateNN();
+};
+
+#endif
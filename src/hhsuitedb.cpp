@@ -0,0 +1,413 @@
+/*
+ * hhsuitedb.cpp
+ *
+ * Build the _hhm and _cs219 (and optionally _ca3m) databases of an HH-suite database
+ * from its A3M ffindex database in one pass over the alignments.
+ *
+ * The alignments are processed in parallel; hhm profiles are built as with hhmake and
+ * column state sequences as with cstranslate, both in-process. Every thread writes its
+ * own shard of each output database, the shards are merged into sorted indices at the end.
+ *
+ * With -a the alignments of another A3M database are added to an existing database: only
+ * the new entries are built, their data is appended to the data files and the sorted index
+ * of the new entries is merged into the existing indices. The old entries of an appended
+ * alignment are dropped from every database, also where no new entry replaces them.
+ * Appending to a database with a _ca3m database is refused: a compressed alignment refers to
+ * its sequences by their position in the sorted _sequence index, which the new sequences shift.
+ */
+
+#include "hhsuite_config.h"
+#include "cs.h"
+#include "context_library.h"
+#include "library_pseudocounts-inl.h"
+#include "crf_pseudocounts-inl.h"
+#include "cstranslate_app.h"
+#include "util.h"
+#include "hhdecl.h"
+#include "hhutil.h"
+#include "hhmatrices.h"
+#include "hhhmm.h"
+#include "hhalignment.h"
+#include "hhfunc.h"
+#include "ffindexdatabase.h"
+#include "a3m_compress.h"
+#include "blockcompresseddata.h"
+
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void help(Parameters& par) {
+  printf("HHsuitedb %i.%i.%i\n", HHSUITE_VERSION_MAJOR, HHSUITE_VERSION_MINOR, HHSUITE_VERSION_PATCH);
+  printf("Build the hhm and cs219 databases of an HH-suite database from its a3m database.\n");
+  printf("%s", COPYRIGHT);
+  printf("\n");
+  printf("Usage: hhsuitedb -d <db> [options]\n");
+  printf(" -d <db>        database basename; reads <db>_a3m.ff{data,index} and writes\n");
+  printf("                <db>_hhm.ff{data,index} and <db>_cs219.ff{data,index}\n");
+  printf(" -a <new>       append the alignments of <new>_a3m.ff{data,index} to the existing\n");
+  printf("                database <db>: only their entries are built and added to the a3m,\n");
+  printf("                hhm and cs219 databases, entries with the same name are replaced;\n");
+  printf("                not possible if <db>_ca3m exists: remove it, append, then rebuild it\n");
+  printf("                with -ca3m (without -a)\n");
+  printf("\n");
+  printf("Options:\n");
+  printf(" -hhm_nseq <int> write hhm profiles only for alignments with more than this many\n");
+  printf("                sequences, hhblits builds the others from the a3m (def=%i)\n", 50);
+  printf(" -ca3m          also write <db>_ca3m, compressed with the sequences of <db>_sequence\n");
+  printf("                (not with -a: the compressed alignments refer to the positions of their\n");
+  printf("                sequences in <db>_sequence, which change when sequences are added)\n");
+  printf(" -bin           also write binary index sidecars <index>.bin of the written databases;\n");
+  printf("                with -a, existing sidecars are always updated\n");
+  printf(" -nocontxt      use substitution-matrix instead of context-specific pseudocounts for hhm\n");
+  printf(" -contxt <file> context file for the hhm pseudocounts (default=internal)\n");
+  printf(" -cs_alphabet <file> abstract state alphabet of the cs219 sequences (default=internal)\n");
+  printf(" -cs_contxt <file>   context data for the cs219 pseudocounts (default=internal)\n");
+  printf(" -cpu <int>     number of threads (def=%i)\n", par.threads);
+  printf(" -v <int>       verbose mode: 0:no screen output  1:only warnings  2: verbose (def=1)\n");
+  printf("\n");
+  printf("The hhm profiles are built with the default options of hhmake, the cs219 sequences\n");
+  printf("with those of cstranslate in hhsuitedb.py (-x 0.3 -c 4).\n");
+  printf("\n");
+  printf("Example: hhsuitedb -d pfam -cpu 16\n");
+  printf("         hhsuitedb -d pfam -a pfam_update -cpu 16\n");
+  printf("\n");
+}
+
+struct HHsuitedbOptions {
+  std::string db;
+  std::string append;  // basename of the database to append, empty if the database is built
+  std::string cs_alphabet;
+  std::string cs_contxt;
+  int hhm_nseq;
+  bool ca3m;
+  bool binary_index;
+};
+
+void ProcessArguments(Parameters& par, HHsuitedbOptions& opts) {
+  const int argc = par.argc;
+  const char** argv = par.argv;
+
+  for (int i = 1; i <= argc - 1; i++) {
+    if (!strcmp(argv[i], "-d")) {
+      if (++i >= argc || argv[i][0] == '-') {
+        help(par);
+        HH_LOG(ERROR) << "No database basename following -d" << std::endl;
+        exit(4);
+      }
+      else
+        opts.db = argv[i];
+    }
+    else if (!strcmp(argv[i], "-a")) {
+      if (++i >= argc || argv[i][0] == '-') {
+        help(par);
+        HH_LOG(ERROR) << "No database basename following -a" << std::endl;
+        exit(4);
+      }
+      else
+        opts.append = argv[i];
+    }
+    else if (!strcmp(argv[i], "-hhm_nseq") && (i < argc - 1))
+      opts.hhm_nseq = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-ca3m"))
+      opts.ca3m = true;
+    else if (!strcmp(argv[i], "-bin"))
+      opts.binary_index = true;
+    else if (!strcmp(argv[i], "-nocontxt"))
+      par.nocontxt = 1;
+    else if (!strcmp(argv[i], "-contxt") && (i < argc - 1))
+      par.clusterfile = argv[++i];
+    else if (!strcmp(argv[i], "-cs_alphabet") && (i < argc - 1))
+      opts.cs_alphabet = argv[++i];
+    else if (!strcmp(argv[i], "-cs_contxt") && (i < argc - 1))
+      opts.cs_contxt = argv[++i];
+    else if (!strcmp(argv[i], "-cpu") && (i < argc - 1))
+      par.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-v") && (i < argc - 1) && argv[i + 1][0] != '-') {
+      int v = atoi(argv[++i]);
+      par.v = Log::from_int(v);
+      Log::reporting_level() = par.v;
+    }
+    else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+      help(par);
+      exit(0);
+    }
+    else {
+      HH_LOG(WARNING) << "Ignoring unknown option " << argv[i] << std::endl;
+    }
+  }
+}
+
+// Number of sequences of an a3m alignment, without secondary structure and consensus sequences
+int CountSequences(const char* data, size_t length) {
+  int nseqs = 0;
+  const char* end = data + length;
+  for (const char* line = data; line < end; ) {
+    const char* eol = (const char*) memchr(line, '\n', end - line);
+    if (eol == NULL)
+      eol = end;
+
+    if (*line == '>' && strncmp(line, ">ss_", 4) && strncmp(line, ">sa_", 4)) {
+      const char* name_end = line + 1;
+      while (name_end < eol && !isspace(*name_end))
+        name_end++;
+      if (name_end - line <= 11 || strncmp(name_end - 10, "_consensus", 10))
+        nseqs++;
+    }
+    line = eol + 1;
+  }
+  return nseqs;
+}
+
+// Build the hhm profile of an alignment as hhmake does, false if the alignment could not be read
+bool BuildHMM(Parameters& par, char* name, const char* data, size_t length,
+    cs::Pseudocounts<cs::AA>* pc_hhm_context_engine, cs::Admix* pc_hhm_context_mode,
+    float* pb, const float R[20][20], const float S[20][20], const float Sim[20][20],
+    std::stringstream& out) {
+  HMM q(par.nseqdis, par.maxres);
+  RemoveExtension(q.file, name);
+
+  TextBuffer buffer(data, length);
+  char input_format = 0;
+  if (ReadQueryFile(par, &buffer, input_format, par.wg, &q, NULL, name, pb, S, Sim))
+    return false;
+  PrepareQueryHMM(par, input_format, &q, pc_hhm_context_engine, pc_hhm_context_mode, pb, R);
+  q.WriteToFile(out, par.max_seqid, par.coverage, par.qid, par.Ndiff, par.qsc, par.argc, par.argv, pb);
+  return true;
+}
+
+// Builds the hhm, cs219 and ca3m entries of the alignments of an a3m database
+class DatabaseEntryBuilder : public FFindexEntryProcessor {
+public:
+  DatabaseEntryBuilder(Parameters& par, const HHsuitedbOptions& opts,
+      cs::Pseudocounts<cs::AA>* pc_hhm_context_engine, cs::Admix* pc_hhm_context_mode,
+      float* pb, const float R[20][20], const float S[20][20], const float Sim[20][20],
+      cs::CSTranslateApp<cs::AA>& cs_translate, FFindexDatabase* sequences,
+      compressed_a3m::SequenceNameIndex* sequence_names, FFindexShardedWriter& hhm_db,
+      FFindexShardedWriter& cs219_db, FFindexShardedWriter* ca3m_db, const int threads)
+      : par(par), opts(opts), pc_hhm_context_engine(pc_hhm_context_engine),
+        pc_hhm_context_mode(pc_hhm_context_mode), pb(pb), R(R), S(S), Sim(Sim),
+        cs_translate(cs_translate), sequences(sequences), sequence_names(sequence_names),
+        hhm_db(hhm_db), cs219_db(cs219_db), ca3m_db(ca3m_db), profiles(threads) {
+  }
+
+  void process(const int thread, ffindex_entry_t* entry, char* data) {
+    // every thread reuses its count profile for all its alignments
+    cs::CountProfile<cs::AA>& profile = profiles[thread];
+    try {
+      std::string header;
+      std::string out_string;
+      cs_translate.ReadProfile(data, entry->length, header, profile);
+      cs_translate.TranslateToSequence(profile, out_string);
+      cs219_db.insert(thread, out_string, entry->name);
+    } catch (const Exception& e) {
+      HH_LOG(WARNING) << "Could not translate a3m " << entry->name << ": " << e.what() << std::endl;
+    }
+
+    std::stringstream out;
+    if (CountSequences(data, entry->length) > opts.hhm_nseq) {
+      if (BuildHMM(par, entry->name, data, entry->length, pc_hhm_context_engine, pc_hhm_context_mode,
+          pb, R, S, Sim, out))
+        hhm_db.insert(thread, out.str(), entry->name);
+      else
+        HH_LOG(WARNING) << "Could not build the hhm of a3m " << entry->name << "!" << std::endl;
+    }
+
+    if (ca3m_db) {
+      out.str("");
+      if (compressed_a3m::compress_a3m(data, entry->length, sequences->db_index, sequences->db_data,
+          &out, sequence_names)) {
+        ca3m_db->insert(thread, out.str(), entry->name);
+      }
+      else {
+        HH_LOG(WARNING) << "Could not compress a3m " << entry->name << "!" << std::endl;
+      }
+    }
+  }
+
+private:
+  Parameters& par;
+  const HHsuitedbOptions& opts;
+  cs::Pseudocounts<cs::AA>* pc_hhm_context_engine;
+  cs::Admix* pc_hhm_context_mode;
+  float* pb;
+  const float (*R)[20];
+  const float (*S)[20];
+  const float (*Sim)[20];
+  cs::CSTranslateApp<cs::AA>& cs_translate;
+  FFindexDatabase* sequences;
+  compressed_a3m::SequenceNameIndex* sequence_names;
+  FFindexShardedWriter& hhm_db;
+  FFindexShardedWriter& cs219_db;
+  FFindexShardedWriter* ca3m_db;
+  std::vector<cs::CountProfile<cs::AA> > profiles;
+};
+
+int main(int argc, const char **argv) {
+  Parameters par(argc, argv);
+  Log::reporting_level() = par.v = WARNING;
+
+  // default parameters of hhmake
+  par.showcons = 1;
+  par.nseqdis = 10;
+  par.mark = 0;
+  par.max_seqid = 90;
+  par.qid = 0;
+  par.qsc = -20.0f;
+  par.coverage = 0;
+  par.Ndiff = 100;
+  par.M = 1;
+  par.Mgaps = 50;
+  par.matrix = 0;
+  par.pc_hhm_context_engine.admix = (Pseudocounts::Admix) 0;
+  par.gapb = 0.0;
+  par.wg = 0;
+
+  HHsuitedbOptions opts;
+  opts.cs_alphabet = "internal";
+  opts.cs_contxt = "internal";
+  opts.hhm_nseq = 50;
+  opts.ca3m = false;
+  opts.binary_index = false;
+  ProcessArguments(par, opts);
+
+  if (opts.db.empty()) {
+    help(par);
+    HH_LOG(ERROR) << "Database basename is missing" << std::endl;
+    exit(4);
+  }
+  if (opts.append == opts.db) {
+    HH_LOG(ERROR) << "Cannot append database " << opts.db << " to itself" << std::endl;
+    exit(4);
+  }
+
+  // the alignments to build the entries of, the new ones when appending
+  const bool append = !opts.append.empty();
+  const std::string a3m_base = (append ? opts.append : opts.db) + "_a3m";
+  std::string a3m_data_filename = a3m_base + ".ffdata";
+  std::string a3m_index_filename = a3m_base + ".ffindex";
+  FFindexDatabase a3m(a3m_data_filename.c_str(), a3m_index_filename.c_str(), false);
+  if (a3m.db_index == NULL) {
+    HH_LOG(ERROR) << "Could not read index " << a3m_index_filename << "!" << std::endl;
+    exit(1);
+  }
+
+  // the compressed a3m entries store the indices of their sequences in the sorted _sequence index,
+  // adding sequences for the new alignments shifts them, so _ca3m has to be rebuilt as a whole
+  if (append && opts.ca3m) {
+    HH_LOG(ERROR) << "Cannot append with -ca3m, append without it and rebuild " << opts.db
+        << "_ca3m with 'hhsuitedb -d " << opts.db << " -ca3m' afterwards" << std::endl;
+    exit(4);
+  }
+  if (append && access((opts.db + "_ca3m.ffindex").c_str(), F_OK) == 0) {
+    HH_LOG(ERROR) << "Database " << opts.db << " has a compressed a3m database " << opts.db << "_ca3m, "
+        << "which cannot be appended to; remove it, append, and rebuild it with 'hhsuitedb -d " << opts.db
+        << " -ca3m'" << std::endl;
+    exit(4);
+  }
+
+  FFindexDatabase* sequences = NULL;
+  compressed_a3m::SequenceNameIndex sequence_names;
+  if (opts.ca3m) {
+    std::string sequence_data_filename = opts.db + "_sequence.ffdata";
+    std::string sequence_index_filename = opts.db + "_sequence.ffindex";
+    sequences = new FFindexDatabase(sequence_data_filename.c_str(), sequence_index_filename.c_str(), false);
+    if (sequences->db_index == NULL) {
+      HH_LOG(ERROR) << "Could not read index " << sequence_index_filename << "!" << std::endl;
+      exit(1);
+    }
+    compressed_a3m::build_name_index(sequences->db_index, sequence_names);
+  }
+
+  // hhm profiles as with hhmake
+  cs::ContextLibrary<cs::AA>* context_lib = NULL;
+  cs::Crf<cs::AA>* crf = NULL;
+  cs::Pseudocounts<cs::AA>* pc_hhm_context_engine = NULL;
+  cs::Admix* pc_hhm_context_mode = NULL;
+  cs::Pseudocounts<cs::AA>* pc_prefilter_context_engine = NULL;
+  cs::Admix* pc_prefilter_context_mode = NULL;
+  if (!par.nocontxt) {
+    InitializePseudocountsEngine(par, context_lib, crf, pc_hhm_context_engine, pc_hhm_context_mode,
+        pc_prefilter_context_engine, pc_prefilter_context_mode);
+  }
+
+  float __attribute__((aligned(16))) P[20][20];
+  float __attribute__((aligned(16))) R[20][20];
+  float __attribute__((aligned(16))) Sim[20][20];
+  float __attribute__((aligned(16))) S[20][20];
+  float __attribute__((aligned(16))) pb[21];
+  SetSubstitutionMatrix(par.matrix, pb, P, R, S, Sim);
+
+  // cs219 state sequences as with cstranslate -x 0.3 -c 4 -I a3m
+  cs::CSTranslateAppOptions cs_opts;
+  cs_opts.alphabetfile = opts.cs_alphabet;
+  cs_opts.modelfile = opts.cs_contxt;
+  cs_opts.informat = "a3m";
+  cs_opts.outformat = "seq";
+  cs_opts.pc_admix = 0.3;
+  cs_opts.pc_ali = 4.0;
+  cs_opts.ffindex = true;
+  cs_opts.verbose = false;
+  cs::CSTranslateApp<cs::AA> cs_translate;
+  try {
+    cs_translate.Init(cs_opts, stderr);
+  } catch (const Exception& e) {
+    HH_LOG(ERROR) << "Could not set up the cs219 translation: " << e.what() << std::endl;
+    exit(1);
+  }
+
+  int shards = 1;
+#ifdef OPENMP
+  shards = std::max(par.threads, 1);
+#endif
+
+  FFindexShardedWriter hhm_db(opts.db + "_hhm", shards, append);
+  FFindexShardedWriter cs219_db(opts.db + "_cs219", shards, append);
+  FFindexShardedWriter* ca3m_db = opts.ca3m ? new FFindexShardedWriter(opts.db + "_ca3m", shards) : NULL;
+
+  const size_t n_entries = a3m.db_index->n_entries;
+  DatabaseEntryBuilder builder(par, opts, pc_hhm_context_engine, pc_hhm_context_mode, pb, R, S, Sim,
+      cs_translate, sequences, &sequence_names, hhm_db, cs219_db, ca3m_db, shards);
+  ForEachEntryParallel(a3m, shards, builder);
+
+  // hhblits expects an hhm database with at least one entry
+  for (size_t i = 0; hhm_db.entries() == 0 && i < n_entries && !append; i++) {
+    ffindex_entry_t* entry = ffindex_get_entry_by_index(a3m.db_index, i);
+    char* data = a3m.getData(entry);
+    std::stringstream out;
+    if (data != NULL && BuildHMM(par, entry->name, data, entry->length, pc_hhm_context_engine,
+        pc_hhm_context_mode, pb, R, S, Sim, out))
+      hhm_db.insert(0, out.str(), entry->name);
+  }
+
+  // the old entries of the appended alignments are dropped from all databases built from them, also
+  // those that are not replaced by a new entry (e.g. an hhm of an alignment with few sequences)
+  std::set<std::string> replaced;
+  if (append) {
+    for (size_t i = 0; i < n_entries; i++)
+      replaced.insert(ffindex_get_entry_by_index(a3m.db_index, i)->name);
+  }
+
+  hhm_db.merge(opts.binary_index, replaced);
+  cs219_db.merge(opts.binary_index, replaced);
+  if (ca3m_db)
+    ca3m_db->merge(opts.binary_index);
+
+  // the alignments themselves are added last, once all entries built from them are in place
+  if (append)
+    AppendFFindexDatabase(opts.db + "_a3m", a3m_base, opts.binary_index);
+
+  HH_LOG(INFO) << "Wrote " << hhm_db.entries() << " hhm and " << cs219_db.entries() << " cs219 entries"
+      << (ca3m_db ? " and the compressed a3m" : "") << " of " << n_entries << " alignments" << std::endl;
+
+  delete ca3m_db;
+  delete sequences;
+  DeletePseudocountsEngine(context_lib, crf, pc_hhm_context_engine, pc_hhm_context_mode,
+      pc_prefilter_context_engine, pc_prefilter_context_mode);
+}
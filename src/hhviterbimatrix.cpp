@@ -10,9 +10,10 @@
 #define HHVITERBIMATRIX_c
 #include "hhviterbimatrix.h"
 
-ViterbiMatrix::ViterbiMatrix(){
+ViterbiMatrix::ViterbiMatrix(bool huge_pages){
     this->bCO_MI_DG_IM_GD_MM_vec=NULL;
     this->cellOff = false;
+    this->huge_pages = huge_pages;
     this->max_query_length = 0;
     this->max_template_length = 0;
 }
@@ -41,7 +42,7 @@ void ViterbiMatrix::AllocateBacktraceMatrix(int Nq, int Nt)
     max_template_length = tmp_template_length;
 
     // Allocate posterior prob matrix (matrix rows are padded to make them aligned to multiples of ALIGN_FLOAT)
-    bCO_MI_DG_IM_GD_MM_vec = malloc_matrix<unsigned char>(max_query_length + 2, max_template_length + (2 * VECSIZE_FLOAT));
+    bCO_MI_DG_IM_GD_MM_vec = malloc_matrix<unsigned char>(max_query_length + 2, max_template_length + (2 * VECSIZE_FLOAT), huge_pages);
     if (!bCO_MI_DG_IM_GD_MM_vec)
         MemoryError("m_probabilities", __FILE__, __LINE__, __func__);
 }
@@ -30,7 +30,7 @@ class ViterbiMatrix {
 public:  
 
     // Constructor (only set pointers to NULL)
-    ViterbiMatrix();
+    ViterbiMatrix(bool huge_pages = false);
     ~ViterbiMatrix();
     const static char STOP=0;
     const static char MM=2;
@@ -77,6 +77,8 @@ private:
     unsigned char ** bCO_MI_DG_IM_GD_MM_vec;
     // flag to indecated if cellOff is activ or not
     bool cellOff;
+    // back the matrix with transparent huge pages
+    bool huge_pages;
 
     int max_query_length;
     int max_template_length;
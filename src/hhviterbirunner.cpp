@@ -81,16 +81,10 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
 
     HMM * q = q_simd->GetHMM(0);
     // Initialize memory
-    std::vector<HMM*> t_hmm;
-    for(size_t i = 0; i < VECSIZE_FLOAT * thread_count; i++) {
-      HMM* t = new HMM(MAXSEQDIS, par.maxres);
-      t_hmm.push_back(t);
-    }
+    allocate_templates(par.maxres);
 
-    HMMSimd** t_hmm_simd = new HMMSimd*[thread_count];
     std::vector<ViterbiConsumerThread *> threads;
     for (int thread_id = 0; thread_id < thread_count; thread_id++) {
-        t_hmm_simd[thread_id] = new HMMSimd(par.maxres);
         ViterbiConsumerThread * thread = new ViterbiConsumerThread(thread_id, par, q_simd, t_hmm_simd[thread_id],viterbiMatrix[thread_id], ssm_mode, S73, S33, S37);
         threads.push_back(thread);
     }
@@ -119,6 +113,16 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
                  dbfiles_to_align.begin() + (seqJunkStart + seqJunkSize),
                  HHDatabaseEntryCompare());
 
+            // read the templates of the first block ahead, and those of the next block while this one is aligned
+            if (seqJunkStart == 0) {
+                prefetchTemplates(dbfiles_to_align.begin(), dbfiles_to_align.begin() + seqJunkSize);
+            }
+            if (seqJunkStart + seqJunkSize < allElementToAlignCount) {
+                unsigned int nextJunkEnd = imin(allElementToAlignCount, seqJunkStart + seqJunkSize + seqBlockSize);
+                prefetchTemplates(dbfiles_to_align.begin() + seqJunkStart + seqJunkSize,
+                                  dbfiles_to_align.begin() + nextJunkEnd);
+            }
+
             // read in data for thread
 #pragma omp parallel for schedule(dynamic, 1)
             for (unsigned int idb = seqJunkStart; idb < (seqJunkStart + seqJunkSize); idb +=VECSIZE_FLOAT) {
@@ -194,55 +198,92 @@ std::vector<Hit> ViterbiRunner::alignment(Parameters& par, HMMSimd * q_simd,
 
     }  // Alignment loop
 
-    // clean memory
+    // clean memory; the template HMMs are kept for the next call
     for (int thread_id = 0; thread_id < thread_count; thread_id++) {
-        delete t_hmm_simd[thread_id];
         delete threads[thread_id];
     }
     threads.clear();
-    delete[] t_hmm_simd;
 
-    for(size_t i = 0; i <VECSIZE_FLOAT * thread_count; i++) {
+    return ret_hits;
+}
+
+ViterbiRunner::~ViterbiRunner() {
+    delete_templates();
+}
+
+void ViterbiRunner::allocate_templates(int maxres) {
+    if (t_hmm_simd != NULL && t_maxres == maxres) {
+        return;
+    }
+    delete_templates();
+
+    for(size_t i = 0; i < VECSIZE_FLOAT * thread_count; i++) {
+      HMM* t = new HMM(MAXSEQDIS, maxres);
+      t_hmm.push_back(t);
+    }
+
+    t_hmm_simd = new HMMSimd*[thread_count];
+    for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+        t_hmm_simd[thread_id] = new HMMSimd(maxres);
+    }
+    t_maxres = maxres;
+}
+
+void ViterbiRunner::delete_templates() {
+    if (t_hmm_simd != NULL) {
+        for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+            delete t_hmm_simd[thread_id];
+        }
+        delete[] t_hmm_simd;
+        t_hmm_simd = NULL;
+    }
+
+    for(size_t i = 0; i < t_hmm.size(); i++) {
       delete t_hmm[i];
     }
     t_hmm.clear();
-
-    return ret_hits;
+    t_maxres = 0;
 }
 
 
 float ViterbiRunner::calculateEarlyStop(Parameters& par, HMM * q, std::vector<Hit> &all_hits,
                                         unsigned int startPos){
     float early_stop_result = 0.0;
-    for (unsigned int hit = startPos; hit < all_hits.size(); hit++) {
-        Hit current_hit = all_hits[hit];
-        float q_len = log(q->L) / LOG1000;
-        float hit_len = log(current_hit.L) / LOG1000;
-        float q_neff = q->Neff_HMM / 10.0;
+    if (startPos >= all_hits.size()) {
+        return early_stop_result;
+    }
+
+    // lamda and mu of all new hits in one pass
+    const size_t n = all_hits.size() - startPos;
+    std::vector<int> t_L(n);
+    std::vector<float> t_Neff_HMM(n);
+    for (size_t k = 0; k < n; k++) {
+        t_L[k] = all_hits[startPos + k].L;
+        t_Neff_HMM[k] = all_hits[startPos + k].Neff_HMM;
+    }
+    std::vector<float> lamda(n), mu(n);
+    statistics.SetQuery(q->L, q->Neff_HMM);
+    statistics.LamdaMu(n, &t_L[0], &t_Neff_HMM[0], &lamda[0], &mu[0]);
+
+    // query terms of the E-values
+    const float q_neff = q->Neff_HMM / 10.0;
+    const float log_Pcut = log(par.prefilter_evalue_thresh / par.dbsize);
+    const float log_dbsize = log(par.dbsize);
+
+    for (size_t k = 0; k < n; k++) {
+        const Hit& current_hit = all_hits[startPos + k];
         float hit_neff = current_hit.Neff_HMM / 10.0;
-        float lamda = lamda_NN( q_len, hit_len, q_neff, hit_neff );
-        float mu    =    mu_NN( q_len, hit_len, q_neff, hit_neff );
-        current_hit.logPval = logPvalue(current_hit.score, lamda, mu);
+        double logPval = logPvalue(current_hit.score, lamda[k], mu[k]);
         float alpha = 0;
-        float log_Pcut = log(par.prefilter_evalue_thresh / par.dbsize);
-        float log_dbsize = log(par.dbsize);
 
         if (par.prefilter)
             alpha = par.alphaa + par.alphab * (hit_neff - 1) * (1 - par.alphac * (q_neff - 1));
 
-        current_hit.Eval = exp(current_hit.logPval + log_dbsize + (alpha * log_Pcut));
-        current_hit.logEval = current_hit.logPval + log_dbsize + (alpha * log_Pcut);
+        double Eval = exp(logPval + log_dbsize + (alpha * log_Pcut));
 
         // Rolling average: replace oldest data point at par.filter_counter by newest one
-        float eval_normalized = 1.0/(1.0+current_hit.Eval);
+        float eval_normalized = 1.0/(1.0+Eval);
         early_stop_result += eval_normalized;
-
-//        printf("%s Score %4.2f E-val: %4.2f eval_normalized: %4.2f  1/(1+Eval): %4.2f\n", current_hit.name, current_hit.score, current_hit.Eval, eval_normalized, early_stop_result);
-//        printf("QLen: %4.2f q_neff: %4.2f  lambda: %4.2f mu: %4.2f\n",q_len, q_neff, lamda, mu);
-//        printf("log_Pcut: %4.2f log_dbsize: %4.2f alpha: %4.2f   \n",log_Pcut, log_dbsize, alpha);
-
-
-
     }
     return early_stop_result;
 }
@@ -5,6 +5,7 @@
 #include "hhviterbimatrix.h"
 #include "hhviterbi.h"
 #include "hhfunc.h"
+#include "hhstatistics.h"
 #include <vector>
 #include <map>
 
@@ -50,7 +51,8 @@ public:
 class ViterbiRunner {
 public:
 	ViterbiRunner(ViterbiMatrix ** viterbiMatrix, std::vector<HHblitsDatabase*> &databases, int threads)
-			: viterbiMatrix(viterbiMatrix), databases(databases), thread_count(threads) { }
+			: viterbiMatrix(viterbiMatrix), databases(databases), thread_count(threads), t_maxres(0), t_hmm_simd(NULL) { }
+	~ViterbiRunner();
 
 	std::vector<Hit> alignment(Parameters& par, HMMSimd * q_simd, std::vector<HHEntry*> dbfiles, const float qsc, float* pb,
 			const float S[20][20], const float Sim[20][20], const float R[20][20],
@@ -62,6 +64,22 @@ private:
 	std::vector<HHblitsDatabase* > databases;
 	int thread_count;
 
+	// lamda and mu of the EVDs for early stopping
+	HitStatistics statistics;
+
+	// Template HMMs are kept between calls to alignment(), so that
+	// successive iterations do not reallocate VECSIZE_FLOAT * thread_count HMMs each time
+	int t_maxres;
+	std::vector<HMM*> t_hmm;
+	HMMSimd** t_hmm_simd;
+
+	void allocate_templates(int maxres);
+	void delete_templates();
+
+	// The runner owns its template pool and must not be copied
+	ViterbiRunner(const ViterbiRunner&);
+	ViterbiRunner& operator=(const ViterbiRunner&);
+
 	void merge_thread_results(std::vector<Hit> &all_hits,
 			std::vector<HHEntry*> &dbfiles_to_align,
 			std::map<std::string ,std::vector<Viterbi::BacktraceResult > >  &excludeAlignments,
@@ -9,6 +9,7 @@
 #ifndef SIMD_H
 #define SIMD_H
 #include <stdlib.h>
+#include <float.h>
 
 #include "log.h"
 
@@ -523,4 +524,85 @@ inline simd_int * malloc_simd_int(const size_t size)
 	return (simd_int *) mem_align(ALIGN_INT,size);
 }
 #endif
+/////////////////////////////////////////////////////////////////////////////////////
+// SIMD 2^x for four floats
+// Calculate float of 2pow(x) for four floats in parallel with SSE2
+// ATTENTION: need to compile with g++ -fno-strict-aliasing when using -O2 or -O3!!!
+// Relative deviation < 4.6E-6  (< 2.3E-7 with 5'th order polynomial)
+//
+// Internal representation of float number according to IEEE 754 (__m128 --> 4x):
+//   1bit sign, 8 bits exponent, 23 bits mantissa: seee eeee emmm mmmm mmmm mmmm mmmm mmmm
+//                                    0x4b400000 = 0100 1011 0100 0000 0000 0000 0000 0000
+//   In summary: x = (-1)^s * 1.mmmmmmmmmmmmmmmmmmmmmm * 2^(eeeeeee-127)
+/////////////////////////////////////////////////////////////////////////////////////
+inline simd_float simdf32_fpow2(simd_float X) {
+
+    simd_int* xPtr = (simd_int*) &X;    // store address of float as pointer to int
+
+    const simd_float CONST32_05f       = simdf32_set(0.5f); // Initialize a vector (4x32) with 0.5f
+    // (3 << 22) --> Initialize a large integer vector (shift left)
+    const simd_int CONST32_3i          = simdi32_set(3);
+    const simd_int CONST32_3shift22    = simdi32_slli(CONST32_3i, 22);
+    const simd_float CONST32_1f        = simdf32_set(1.0f);
+    const simd_float CONST32_FLTMAXEXP = simdf32_set(FLT_MAX_EXP);
+    const simd_float CONST32_FLTMAX    = simdf32_set(FLT_MAX);
+    const simd_float CONST32_FLTMINEXP = simdf32_set(FLT_MIN_EXP);
+    // fifth order
+    const simd_float CONST32_A = simdf32_set(0.00187682f);
+    const simd_float CONST32_B = simdf32_set(0.00898898f);
+    const simd_float CONST32_C = simdf32_set(0.0558282f);
+    const simd_float CONST32_D = simdf32_set(0.240153f);
+    const simd_float CONST32_E = simdf32_set(0.693153f);
+
+    simd_float tx;
+    simd_int lx;
+    simd_float dx;
+    simd_float result    = simdf32_set(0.0f);
+    simd_float maskedMax = simdf32_set(0.0f);
+    simd_float maskedMin = simdf32_set(0.0f);
+
+    // Check wheter one of the values is bigger or smaller than FLT_MIN_EXP or FLT_MAX_EXP
+    // The correct FLT_MAX_EXP value is written to the right place
+    maskedMax = simdf32_gt(X, CONST32_FLTMAXEXP);
+    maskedMin = simdf32_gt(X, CONST32_FLTMINEXP);
+    maskedMin = simdf32_xor(maskedMin, maskedMax);
+    // If a value is bigger than FLT_MAX_EXP --> replace the later result with FLTMAX
+    maskedMax = simdf32_and(CONST32_FLTMAX, simdf32_gt(X, CONST32_FLTMAXEXP));
+
+    tx = simdf32_add((simd_float ) CONST32_3shift22, simdf32_sub(X, CONST32_05f)); // temporary value for truncation: x-0.5 is added to a large integer (3<<22),
+                                                                             // 3<<22 = (1.1bin)*2^23 = (1.1bin)*2^(150-127),
+                                                                             // which, in internal bits, is written 0x4b400000 (since 10010110bin = 150)
+
+    lx = simdf32_f2i(tx);                                       // integer value of x
+
+    dx = simdf32_sub(X, simdi32_i2f(lx));                       // float remainder of x
+
+    //   x = 1.0f + dx*(0.693153f             // polynomial apporoximation of 2^x for x in the range [0, 1]
+    //            + dx*(0.240153f             // Gives relative deviation < 2.3E-7
+    //            + dx*(0.0558282f            // Speed: 2.3E-8s
+    //            + dx*(0.00898898f
+    //            + dx* 0.00187682f ))));
+    X = simdf32_mul(dx, CONST32_A);
+    X = simdf32_add(CONST32_B, X);  // add constant B
+    X = simdf32_mul(dx, X);
+    X = simdf32_add(CONST32_C, X);  // add constant C
+    X = simdf32_mul(dx, X);
+    X = simdf32_add(CONST32_D, X);  // add constant D
+    X = simdf32_mul(dx, X);
+    X = simdf32_add(CONST32_E, X);  // add constant E
+    X = simdf32_mul(dx, X);
+    X = simdf32_add(X, CONST32_1f); // add 1.0f
+
+    simd_int lxExp = simdi32_slli(lx, 23); // add integer power of 2 to exponent
+
+    *xPtr = simdi32_add(*xPtr, lxExp); // add integer power of 2 to exponent
+
+    // Add all Values that are greater than min and less than max
+    result = simdf32_and(maskedMin, X);
+    // Add MAX_FLT values where entry values were > FLT_MAX_EXP
+    result = simdf32_or(result, maskedMax);
+
+    return result;
+}
+
 #endif //SIMD_H
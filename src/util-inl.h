@@ -397,6 +397,38 @@ inline char* fgetline(char str[], const int maxlen, FILE* file) {
   return (str);
 }
 
+// Text held in memory (e.g. an ffindex entry) that can be read line by line like a FILE*,
+// without the stdio locking and buffering of fmemopen
+struct TextBuffer {
+  TextBuffer(const char* data, size_t size) : start(data), pos(data), end(data + size) {}
+  const char* start;  // first byte of the text
+  const char* pos;    // current read position
+  const char* end;    // one past the last byte of the text
+};
+
+// Same as fgetline(str,maxlen,FILE*) for a TextBuffer; memchr finds the end of the line
+inline char* fgetline(char str[], const int maxlen, TextBuffer* file) {
+  if (file->pos >= file->end)
+    return NULL;
+  const char* nl = (const char*) memchr(file->pos, '\n', file->end - file->pos);
+  size_t len = (nl ? nl + 1 : file->end) - file->pos;
+  if (len > (size_t) maxlen - 1)
+    len = maxlen - 1;
+  memcpy(str, file->pos, len);
+  str[len] = '\0';
+  file->pos += len;
+  if (chomp(str) + 1 >= maxlen) {  // if line is cut after maxlen characters...
+    nl = (const char*) memchr(file->pos, '\n', file->end - file->pos);
+    file->pos = nl ? nl + 1 : file->end;  // ... skip rest of line
+  }
+  return (str);
+}
+
+// Same as rewind(FILE*) for a TextBuffer
+inline void rewind(TextBuffer* file) {
+  file->pos = file->start;
+}
+
 // Returns pointer to first non-white-space character in str OR to NULL if none found
 inline char* strscn(char* str) {
   if (!str)
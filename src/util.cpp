@@ -2,6 +2,9 @@
 
 #include "util.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 /////////////////////////////////////////////////////////////////////////////////////
 // String functions
 /////////////////////////////////////////////////////////////////////////////////////
@@ -331,3 +334,18 @@ void readU32(char** ptr, uint32_t &result) {
 
   result = array[0] | (array[1] << 8) | (array[2] << 16) | (array[3] << 24);
 }
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Memory functions
+/////////////////////////////////////////////////////////////////////////////////////
+
+void advise_huge_pages(void* ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+  // madvise needs page aligned addresses: only advise the whole pages inside the block
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t) ptr + page_size - 1) & ~(page_size - 1);
+  uintptr_t end = ((uintptr_t) ptr + size) & ~(page_size - 1);
+  if (end > start)
+    madvise((void*) start, end - start, MADV_HUGEPAGE);
+#endif
+}
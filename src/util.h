@@ -31,6 +31,10 @@ void split(const std::string& s, char c, std::vector<std::string>& v);
 
 char *substr(char* substr, char* str, int a, int b);
 
+// Ask the kernel to back the pages inside [ptr, ptr+size) with transparent huge pages.
+// Must be called before the memory is first touched; does nothing on systems without THP.
+void advise_huge_pages(void* ptr, size_t size);
+
 // Allocate a memory-aligned matrix as a single block in memory (plus a vector for the pointers).
 // This is important for matrices for which fast access is time-critical, as rows of
 // the matrix will be consecutive in memory and hence access is relatively local.
@@ -39,8 +43,9 @@ char *substr(char* substr, char* str, int a, int b);
 //      float** X = malloc_matrix<float>(400,1000);
 //      ...
 //      free(X);
+// If huge_pages is set, the matrix is backed by transparent huge pages where the system supports them.
 template <typename T>
-T** malloc_matrix(int dim1, int dim2) {
+T** malloc_matrix(int dim1, int dim2, bool huge_pages = false) {
 
     // Compute mem sizes rounded up to nearest multiple of ALIGN_FLOAT
     size_t size_pointer_array = ICEIL(dim1*sizeof(T*), ALIGN_FLOAT);
@@ -49,6 +54,8 @@ T** malloc_matrix(int dim1, int dim2) {
     T** matrix = (T**) mem_align( ALIGN_FLOAT, size_pointer_array + dim1*dim2_padded*sizeof(T) );
     if (matrix == NULL)
         return matrix;
+    if (huge_pages)
+        advise_huge_pages(matrix, size_pointer_array + dim1*dim2_padded*sizeof(T));
 
     T* ptr = (T*) (matrix + (size_pointer_array/sizeof(T*)) );
     for (int i=0; i<dim1; ++i) {